@@ -0,0 +1,14 @@
+# Array iteration: each, each_with_index, map, select
+
+SIZE = 1000
+NUM = 2000
+
+ary = (1..SIZE).to_a
+sum = 0
+NUM.times do
+  ary.each { |x| sum += x }
+  ary.each_with_index { |x, i| sum += i }
+  sum += ary.map { |x| x * 2 }.size
+  sum += ary.select { |x| x % 3 == 0 }.size
+end
+p sum
@@ -0,0 +1,10 @@
+q = (1..10_000).to_a
+200_000.times do |i|
+  q.shift
+  q.push(i)
+end
+
+d = []
+20_000.times do |i|
+  d.unshift(i)
+end
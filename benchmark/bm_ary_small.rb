@@ -0,0 +1,9 @@
+h = {}
+100.times { |i| h[i] = i * 2 }
+n = 0
+5_000.times do
+  h.each { |k, v| n += v }
+  pair = [n, 1]
+  a, b = pair
+  n = a + b
+end
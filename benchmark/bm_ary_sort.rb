@@ -0,0 +1,13 @@
+# Array#sort on Fixnum, Float and String arrays, and sort_by
+
+SIZE = 100000
+
+seed = 12345
+ints = Array.new(SIZE) { seed = (seed * 1103 + 12345) % 1000003 }
+flts = ints.map { |i| i / 7.0 }
+strs = ints.map { |i| i.to_s }
+
+p ints.sort[0]
+p flts.sort[0]
+p strs.sort[0]
+p ints.sort_by { |i| -i }[0]
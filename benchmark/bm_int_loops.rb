@@ -0,0 +1,5 @@
+s = 0
+3_000_000.times { |i| s += i }
+1.upto(3_000_000) { |i| s += i }
+(1..3_000_000).each { |i| s += i }
+1.step(3_000_000, 2) { |i| s += i }
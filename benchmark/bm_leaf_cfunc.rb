@@ -0,0 +1,8 @@
+a = [1,2,3]; s = "abc"; h = {1=>2}
+i = 0; t = 0
+while i < 3_000_000
+  t += a.size + s.size + h.size
+  t += 1 if i.nil?
+  i += 1
+end
+p t
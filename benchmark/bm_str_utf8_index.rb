@@ -0,0 +1,12 @@
+a = "こんにちは世界!" * 300
+b = "こんにちは世界?" * 300
+n = 0
+5.times do
+  i = 0
+  len = a.size
+  while i < len
+    n += 1 if a[i] == b[i]
+    i += 1
+  end
+end
+20_000.times { n += a.size + b.size }
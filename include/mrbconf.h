@@ -26,6 +26,9 @@
 /* represent mrb_value as a word (natural unit of data for the processor) */
 //#define MRB_WORD_BOXING
 
+/* store [k, v] pairs inline in RArray even where that makes heap slots larger */
+//#define MRB_ARY_EMBED_PAIRS
+
 /* argv max size in mrb_funcall */
 //#define MRB_FUNCALL_ARGC_MAX 16
 
@@ -65,6 +68,12 @@
 /* fixed size state atexit stack */
 //#define MRB_FIXED_STATE_ATEXIT_STACK
 
+/* skip CRC verification when loading binaries; only for trusted builds */
+//#define MRB_NO_CRC_CHECK
+
+/* byte-coded iseq with variable length instructions (see mruby/opcode.h) */
+//#define MRB_COMPACT_ISEQ
+
 /* -DDISABLE_XXXX to drop following features */
 //#define DISABLE_STDIO		/* use of stdio */
 
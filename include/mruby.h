@@ -40,7 +40,12 @@ extern "C" {
 #include "mruby/value.h"
 #include "mruby/version.h"
 
+#ifdef MRB_COMPACT_ISEQ
+typedef uint8_t mrb_code;
+#else
 typedef uint32_t mrb_code;
+#endif
+typedef uint32_t mrb_insn;      /* an instruction word (see mruby/opcode.h) */
 typedef uint32_t mrb_aspec;
 
 struct mrb_irep;
@@ -139,6 +144,8 @@ typedef struct mrb_state {
   struct heap_page *heaps;                /* heaps for GC */
   struct heap_page *sweeps;
   struct heap_page *free_heaps;
+  struct image_heap *image_heaps;         /* pages copied from an image, while copying */
+  size_t image_heaps_len;
   size_t live; /* count of live objects */
 #ifdef MRB_GC_FIXED_ARENA
   struct RBasic *arena[MRB_GC_ARENA_SIZE]; /* GC protection array */
@@ -245,6 +252,9 @@ struct RClass * mrb_define_module_under(mrb_state *mrb, struct RClass *outer, co
 #define MRB_ARGS_ANY()      MRB_ARGS_REST()
 /* accept no arguments */
 #define MRB_ARGS_NONE()     ((mrb_aspec)0)
+/* leaf method; takes only self, never raises, yields or calls back into
+   the VM, so it can be called without pushing a callinfo frame */
+#define MRB_ARGS_LEAF()     ((mrb_aspec)1 << 23)
 
 /* compatibility macros; will be removed */
 #define ARGS_REQ(n)         MRB_ARGS_REQ(n)
@@ -297,6 +307,11 @@ mrb_value mrb_str_new_static(mrb_state *mrb, const char *p, size_t len);
 mrb_state* mrb_open(void);
 mrb_state* mrb_open_allocf(mrb_allocf, void *ud);
 mrb_state* mrb_open_core(mrb_allocf, void *ud);
+/* copy an initialized state, made ready by mrb_prepare_image() (it must
+   outlive the copy); NULL if the state cannot be copied, see src/image.c */
+void mrb_prepare_image(mrb_state *image);
+mrb_state* mrb_open_from_image(mrb_state *image);
+mrb_state* mrb_open_from_image_allocf(mrb_state *image, mrb_allocf, void *ud);
 void mrb_close(mrb_state*);
 
 void* mrb_default_allocf(mrb_state*, void*, size_t, void*);
@@ -17,26 +17,82 @@ typedef struct mrb_shared_array {
   mrb_value *ptr;
 } mrb_shared_array;
 
+/* values that fit over the heap fields.  Those are only pointer aligned,
+   so none fit where an mrb_value needs more (a double on 32-bit). */
+#ifdef MRB_WORD_BOXING
+#define MRB_ARY_EMBED_LEN_FIT (sizeof(void*) * 3 / sizeof(mrb_value))
+#else
+#define MRB_ARY_EMBED_LEN_FIT \
+  ((sizeof(mrb_float) > sizeof(void*) || sizeof(mrb_int) > sizeof(void*)) ? 0 : \
+   sizeof(void*) * 3 / sizeof(mrb_value))
+#endif
+
+/* MRB_ARY_EMBED_PAIRS makes room for at least two values so that [k, v]
+   pairs need no buffer; where fewer fit, that makes every heap slot larger */
+#ifdef MRB_ARY_EMBED_PAIRS
+#define MRB_ARY_EMBED_LEN_MAX ((mrb_int)(MRB_ARY_EMBED_LEN_FIT < 2 ? 2 : MRB_ARY_EMBED_LEN_FIT))
+#else
+#define MRB_ARY_EMBED_LEN_MAX ((mrb_int)MRB_ARY_EMBED_LEN_FIT)
+#endif
+
+/* len and ptr live in as.heap only for a non-embedded array; C code
+   reads them through RARRAY_LEN/RARRAY_PTR and changes the length
+   with ARY_SET_LEN (or mrb_ary_resize). */
 struct RArray {
   MRB_OBJECT_HEADER;
-  mrb_int len;
   union {
-    mrb_int capa;
-    mrb_shared_array *shared;
-  } aux;
-  mrb_value *ptr;
+    struct {
+      mrb_int len;
+      union {
+        mrb_int capa;
+        mrb_shared_array *shared;
+      } aux;
+      mrb_value *ptr;
+    } heap;
+#ifdef MRB_ARY_EMBED_PAIRS
+    mrb_value ary[MRB_ARY_EMBED_LEN_MAX];
+#else
+    void *ary[3];
+#endif
+  } as;
 };
 
 #define mrb_ary_ptr(v)    ((struct RArray*)(mrb_ptr(v)))
 #define mrb_ary_value(p)  mrb_obj_value((void*)(p))
 #define RARRAY(v)  ((struct RArray*)(mrb_ptr(v)))
 
-#define RARRAY_LEN(a) (RARRAY(a)->len)
-#define RARRAY_PTR(a) (RARRAY(a)->ptr)
+#define ARY_EMBED_P(a) ((a)->flags & MRB_ARY_EMBED)
+#define ARY_SET_EMBED_FLAG(a) ((a)->flags |= MRB_ARY_EMBED)
+#define ARY_UNSET_EMBED_FLAG(a) ((a)->flags &= ~(MRB_ARY_EMBED|MRB_ARY_EMBED_LEN_MASK))
+#define ARY_EMBED_LEN(a)\
+  (mrb_int)(((a)->flags & MRB_ARY_EMBED_LEN_MASK) >> MRB_ARY_EMBED_LEN_SHIFT)
+#define ARY_SET_EMBED_LEN(a, n) do {\
+  size_t tmp_n = (n);\
+  (a)->flags &= ~MRB_ARY_EMBED_LEN_MASK;\
+  (a)->flags |= (tmp_n) << MRB_ARY_EMBED_LEN_SHIFT;\
+} while (0)
+#define ARY_EMBED_PTR(a) ((mrb_value*)(a)->as.ary)
+#define ARY_LEN(a) (ARY_EMBED_P(a) ? ARY_EMBED_LEN(a) : (a)->as.heap.len)
+#define ARY_PTR(a) (ARY_EMBED_P(a) ? ARY_EMBED_PTR(a) : (a)->as.heap.ptr)
+#define ARY_CAPA(a) (ARY_EMBED_P(a) ? MRB_ARY_EMBED_LEN_MAX : (a)->as.heap.aux.capa)
+#define ARY_SET_LEN(a, n) do {\
+  if (ARY_EMBED_P(a)) {\
+    ARY_SET_EMBED_LEN((a), (n));\
+  } else {\
+    (a)->as.heap.len = (mrb_int)(n);\
+  }\
+} while (0)
+
+#define RARRAY_LEN(a) ARY_LEN(RARRAY(a))
+#define RARRAY_PTR(a) ARY_PTR(RARRAY(a))
 #define MRB_ARY_SHARED      256
+#define MRB_ARY_EMBED       512
+#define MRB_ARY_EMBED_LEN_MASK 0x1800
+#define MRB_ARY_EMBED_LEN_SHIFT 11
 
 void mrb_ary_modify(mrb_state*, struct RArray*);
 void mrb_ary_decref(mrb_state*, mrb_shared_array*);
+void mrb_gc_copy_ary(mrb_state*, struct RArray*);
 mrb_value mrb_ary_new_capa(mrb_state*, mrb_int);
 mrb_value mrb_ary_new(mrb_state *mrb);
 mrb_value mrb_ary_new_from_values(mrb_state *mrb, mrb_int size, const mrb_value *vals);
@@ -69,6 +69,7 @@ struct RClass* mrb_class_real(struct RClass* cl);
 void mrb_gc_mark_mt(mrb_state*, struct RClass*);
 size_t mrb_gc_mark_mt_size(mrb_state*, struct RClass*);
 void mrb_gc_free_mt(mrb_state*, struct RClass*);
+void mrb_gc_copy_mt(mrb_state*, struct RClass*);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
@@ -14,6 +14,8 @@ extern "C" {
 typedef struct mrb_data_type {
   const char *struct_name;
   void (*dfree)(mrb_state *mrb, void*);
+  /* optional; duplicates the data for mrb_open_from_image() */
+  void *(*dcopy)(mrb_state *mrb, const void*);
 } mrb_data_type;
 
 struct RData {
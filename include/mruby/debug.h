@@ -56,6 +56,7 @@ mrb_irep_debug_info_file *mrb_debug_info_append_file(
     mrb_state *mrb, mrb_irep *irep,
     uint32_t start_pos, uint32_t end_pos);
 mrb_irep_debug_info *mrb_debug_info_alloc(mrb_state *mrb, mrb_irep *irep);
+mrb_irep_debug_info *mrb_debug_info_dup(mrb_state *mrb, const mrb_irep_debug_info *d);
 void mrb_debug_info_free(mrb_state *mrb, mrb_irep_debug_info *d);
 
 #if defined(__cplusplus)
@@ -14,7 +14,13 @@ extern "C" {
 #include "mruby.h"
 #include "mruby/irep.h"
 
-int mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int debug_info, uint8_t **bin, size_t *bin_size);
+#define DUMP_DEBUG_INFO 1
+#define DUMP_ENDIAN_BIG 2
+#define DUMP_ENDIAN_LIL 4
+#define DUMP_ENDIAN_NAT 6
+#define DUMP_ENDIAN_MASK 6
+
+int mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int flags, uint8_t **bin, size_t *bin_size);
 #ifdef ENABLE_STDIO
 int mrb_dump_irep_binary(mrb_state*, mrb_irep*, int, FILE*);
 int mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep*, int, FILE *f, const char *initname);
@@ -43,11 +49,18 @@ mrb_irep *mrb_read_irep(mrb_state*, const uint8_t*);
 
 /* Rite Binary File header */
 #define RITE_BINARY_IDENTIFIER         "RITE"
-#define RITE_BINARY_FORMAT_VER         "0002"
+#define RITE_BINARY_IDENTIFIER_LIL     "ETIR"
+#define RITE_BINARY_FORMAT_VER         "0004"
+/* still readable; numbers in the pool were stored as decimal strings */
+#define RITE_BINARY_FORMAT_VER_TEXT_POOL "0003"
+/* still readable; as "0003", and iseq blocks were not padded */
+#define RITE_BINARY_FORMAT_VER_UNPADDED "0002"
 #define RITE_COMPILER_NAME             "MATZ"
 #define RITE_COMPILER_VERSION          "0000"
 
 #define RITE_VM_VER                    "0000"
+/* iseqs in the compact form (MRB_COMPACT_ISEQ) */
+#define RITE_VM_VER_COMPACT            "0001"
 
 #define RITE_BINARY_EOF                "END\0"
 #define RITE_SECTION_IREP_IDENTIFIER   "IREP"
@@ -56,6 +69,9 @@ mrb_irep *mrb_read_irep(mrb_state*, const uint8_t*);
 #define RITE_SECTION_LV_IDENTIFIER     "LVAR"
 
 #define MRB_DUMP_DEFAULT_STR_LEN      128
+#define MRB_DUMP_ALIGNMENT            sizeof(uint32_t)
+/* pool data length of a fixnum (int64) or a float (IEEE 754 double) */
+#define MRB_DUMP_POOL_NUM_LEN         sizeof(uint64_t)
 
 /* binary header */
 struct rite_binary_header {
@@ -125,6 +141,36 @@ uint32_to_bin(uint32_t l, uint8_t *bin)
   return sizeof(uint32_t);
 }
 
+static inline size_t
+uint32l_to_bin(uint32_t l, uint8_t *bin)
+{
+  bin[3] = (l >> 24) & 0xff;
+  bin[2] = (l >> 16) & 0xff;
+  bin[1] = (l >> 8) & 0xff;
+  bin[0] = l & 0xff;
+  return sizeof(uint32_t);
+}
+
+static inline size_t
+uint64l_to_bin(uint64_t l, uint8_t *bin)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(uint64_t); i++) {
+    bin[i] = (l >> (i * 8)) & 0xff;
+  }
+  return sizeof(uint64_t);
+}
+
+static inline size_t
+double_to_bin(double d, uint8_t *bin)
+{
+  union { double d; uint64_t l; } u;
+
+  u.d = d;
+  return uint64l_to_bin(u.l, bin);
+}
+
 static inline uint32_t
 bin_to_uint32(const uint8_t *bin)
 {
@@ -134,6 +180,36 @@ bin_to_uint32(const uint8_t *bin)
          (uint32_t)bin[3];
 }
 
+static inline uint32_t
+bin_to_uint32l(const uint8_t *bin)
+{
+  return (uint32_t)bin[3] << 24 |
+         (uint32_t)bin[2] << 16 |
+         (uint32_t)bin[1] << 8  |
+         (uint32_t)bin[0];
+}
+
+static inline uint64_t
+bin_to_uint64l(const uint8_t *bin)
+{
+  uint64_t l = 0;
+  size_t i;
+
+  for (i = sizeof(uint64_t); i > 0; i--) {
+    l = l << 8 | bin[i - 1];
+  }
+  return l;
+}
+
+static inline double
+bin_to_double(const uint8_t *bin)
+{
+  union { double d; uint64_t l; } u;
+
+  u.l = bin_to_uint64l(bin);
+  return u.d;
+}
+
 static inline uint16_t
 bin_to_uint16(const uint8_t *bin)
 {
@@ -14,6 +14,8 @@ extern "C" {
 typedef void (mrb_each_object_callback)(mrb_state *mrb, struct RBasic *obj, void *data);
 void mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, void *data);
 void mrb_free_context(mrb_state *mrb, struct mrb_context *c);
+struct RBasic *mrb_gc_image_object(mrb_state *mrb, struct RBasic *obj);
+mrb_value mrb_gc_image_value(mrb_state *mrb, mrb_value v);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
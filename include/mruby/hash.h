@@ -46,6 +46,8 @@ struct kh_ht * mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
 void mrb_gc_mark_hash(mrb_state*, struct RHash*);
 size_t mrb_gc_mark_hash_size(mrb_state*, struct RHash*);
 void mrb_gc_free_hash(mrb_state*, struct RHash*);
+mrb_bool mrb_gc_copyable_hash_p(mrb_state*, struct RHash*);
+void mrb_gc_copy_hash(mrb_state*, struct RHash*);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
@@ -19,6 +19,8 @@ enum irep_pool_type {
   IREP_TT_FLOAT,
 };
 
+struct mrb_irep_lazy;
+
 struct mrb_locals {
   mrb_sym name;
   uint16_t r;
@@ -40,11 +42,17 @@ typedef struct mrb_irep {
   const char *filename;
   uint16_t *lines;
   struct mrb_irep_debug_info* debug_info;
+  /* parts of a loaded irep not decoded yet (see load.c) */
+  struct mrb_irep_lazy *lazy;
 
   size_t ilen, plen, slen, rlen, refcnt;
 } mrb_irep;
 
 #define MRB_ISEQ_NO_FREE 1
+#define MRB_IREP_LAZY 2
+#define MRB_IREP_LAZY_P(irep) (((irep)->flags & MRB_IREP_LAZY) != 0)
+/* syms, lv and debug info are owned by another irep (see image.c) */
+#define MRB_IREP_DATA_NO_FREE 4
 
 mrb_irep *mrb_add_irep(mrb_state *mrb);
 mrb_value mrb_load_irep(mrb_state*, const uint8_t*);
@@ -52,6 +60,19 @@ mrb_value mrb_load_irep_cxt(mrb_state*, const uint8_t*, mrbc_context*);
 void mrb_irep_free(mrb_state*, struct mrb_irep*);
 void mrb_irep_incref(mrb_state*, struct mrb_irep*);
 void mrb_irep_decref(mrb_state*, struct mrb_irep*);
+void mrb_irep_load_lazy(mrb_state*, struct mrb_irep*);
+void mrb_irep_load_debug(struct mrb_irep*);
+void mrb_irep_load_all(mrb_state*, struct mrb_irep*);
+void mrb_irep_lazy_free(mrb_state*, struct mrb_irep*);
+
+/* conversion from/to the compact iseq (see mruby/opcode.h) */
+uint8_t *mrb_iseq_encode(mrb_state*, const mrb_insn*, size_t, size_t*);
+mrb_insn *mrb_iseq_decode(mrb_state*, const uint8_t*, size_t, size_t*);
+#ifdef MRB_COMPACT_ISEQ
+size_t mrb_iseq_index(mrb_irep*, const mrb_code*);
+#else
+#define mrb_iseq_index(irep, pc) ((size_t)((pc) - (irep)->iseq))
+#endif
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
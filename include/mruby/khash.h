@@ -213,15 +213,14 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
   kh_##name##_t *kh_copy_##name(mrb_state *mrb, kh_##name##_t *h)       \
   {                                                                     \
     kh_##name##_t *h2;                                                  \
-    khiter_t k, k2;                                                     \
+    khint_t sz = h->n_buckets;                                          \
+    size_t len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0);   \
                                                                         \
-    h2 = kh_init_##name(mrb);                                           \
-    for (k = kh_begin(h); k != kh_end(h); k++) {                        \
-      if (kh_exist(h, k)) {                                             \
-        k2 = kh_put_##name(mrb, h2, kh_key(h, k), NULL);                \
-        if (kh_is_map) kh_value(h2, k2) = kh_value(h, k);               \
-      }                                                                 \
-    }                                                                   \
+    /* same keys in the same number of buckets: copy the table as is */ \
+    h2 = kh_init_##name##_size(mrb, sz);                                \
+    memcpy(h2->keys, h->keys, sizeof(uint8_t)*sz/4+len*sz);             \
+    h2->size = h->size;                                                 \
+    h2->n_occupied = h->n_occupied;                                     \
     return h2;                                                          \
   }
 
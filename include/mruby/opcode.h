@@ -17,25 +17,25 @@
 /*        Ax:OP =      25: 7        */
 /*   A:Bz:Cz:OP = 9:14: 2: 7        */
 
-#define GET_OPCODE(i)            ((int)(((mrb_code)(i)) & 0x7f))
-#define GETARG_A(i)              ((int)((((mrb_code)(i)) >> 23) & 0x1ff))
-#define GETARG_B(i)              ((int)((((mrb_code)(i)) >> 14) & 0x1ff))
-#define GETARG_C(i)              ((int)((((mrb_code)(i)) >>  7) & 0x7f))
-#define GETARG_Bx(i)             ((int)((((mrb_code)(i)) >>  7) & 0xffff))
+#define GET_OPCODE(i)            ((int)(((mrb_insn)(i)) & 0x7f))
+#define GETARG_A(i)              ((int)((((mrb_insn)(i)) >> 23) & 0x1ff))
+#define GETARG_B(i)              ((int)((((mrb_insn)(i)) >> 14) & 0x1ff))
+#define GETARG_C(i)              ((int)((((mrb_insn)(i)) >>  7) & 0x7f))
+#define GETARG_Bx(i)             ((int)((((mrb_insn)(i)) >>  7) & 0xffff))
 #define GETARG_sBx(i)            ((int)(GETARG_Bx(i)-MAXARG_sBx))
-#define GETARG_Ax(i)             ((int32_t)((((mrb_code)(i)) >>  7) & 0x1ffffff))
-#define GETARG_UNPACK_b(i,n1,n2) ((int)((((mrb_code)(i)) >> (7+(n2))) & (((1<<(n1))-1))))
-#define GETARG_UNPACK_c(i,n1,n2) ((int)((((mrb_code)(i)) >> 7) & (((1<<(n2))-1))))
+#define GETARG_Ax(i)             ((int32_t)((((mrb_insn)(i)) >>  7) & 0x1ffffff))
+#define GETARG_UNPACK_b(i,n1,n2) ((int)((((mrb_insn)(i)) >> (7+(n2))) & (((1<<(n1))-1))))
+#define GETARG_UNPACK_c(i,n1,n2) ((int)((((mrb_insn)(i)) >> 7) & (((1<<(n2))-1))))
 #define GETARG_b(i)              GETARG_UNPACK_b(i,14,2)
 #define GETARG_c(i)              GETARG_UNPACK_c(i,14,2)
 
 #define MKOPCODE(op)          ((op) & 0x7f)
-#define MKARG_A(c)            ((mrb_code)((c) & 0x1ff) << 23)
-#define MKARG_B(c)            ((mrb_code)((c) & 0x1ff) << 14)
+#define MKARG_A(c)            ((mrb_insn)((c) & 0x1ff) << 23)
+#define MKARG_B(c)            ((mrb_insn)((c) & 0x1ff) << 14)
 #define MKARG_C(c)            (((c) & 0x7f) <<  7)
-#define MKARG_Bx(v)           ((mrb_code)((v) & 0xffff) << 7)
+#define MKARG_Bx(v)           ((mrb_insn)((v) & 0xffff) << 7)
 #define MKARG_sBx(v)          MKARG_Bx((v)+MAXARG_sBx)
-#define MKARG_Ax(v)           ((mrb_code)((v) & 0x1ffffff) << 7)
+#define MKARG_Ax(v)           ((mrb_insn)((v) & 0x1ffffff) << 7)
 #define MKARG_PACK(b,n1,c,n2) ((((b) & ((1<<n1)-1)) << (7+n2))|(((c) & ((1<<n2)-1)) << 7))
 #define MKARG_bc(b,c)         MKARG_PACK(b,14,c,2)
 
@@ -140,11 +140,12 @@ enum {
   OP_STOP,/*              stop VM                                         */
   OP_ERR,/*       Bx      raise RuntimeError with message Lit(Bx)         */
 
-  OP_RSVD1,/*             reserved instruction #1                         */
+  OP_YIELD,/*     A B C   R(A) := R(A).call(R(A+1),...,R(A+C)) (Syms[B]=:call)*/
   OP_RSVD2,/*             reserved instruction #2                         */
   OP_RSVD3,/*             reserved instruction #3                         */
   OP_RSVD4,/*             reserved instruction #4                         */
   OP_RSVD5,/*             reserved instruction #5                         */
+  MRB_OP_MAX
 };
 
 #define OP_L_STRICT  1
@@ -157,4 +158,91 @@ enum {
 #define OP_R_BREAK  1
 #define OP_R_RETURN 2
 
+/* operand layout of each opcode, for the compact iseq */
+enum mrb_insn_format {
+  MRB_IFMT_Z,                   /* no operand */
+  MRB_IFMT_A,
+  MRB_IFMT_AB,
+  MRB_IFMT_ABC,
+  MRB_IFMT_ABx,                 /* also A:Bz:Cz of OP_LAMBDA */
+  MRB_IFMT_AsBx,
+  MRB_IFMT_Bx,
+  MRB_IFMT_Ax,
+  MRB_IFMT_J,                   /* sBx jump */
+  MRB_IFMT_AJ,                  /* A sBx jump */
+};
+
+extern const uint8_t mrb_insn_format[128];   /* indexed by opcode */
+
+/* compact iseq: an opcode byte followed by the operands in big endian
+   order.  A, B and Bx take a byte each, as does the sBx of OP_LOADI
+   (signed); if one of them does not fit, MRB_INSN_WIDE is set in the
+   opcode byte and they take two bytes.  C is always a byte and Ax
+   three.  Jump offsets are two bytes, counted in bytes from the jump
+   instruction.  mrb_iseq_fetch() returns the instruction as a packed
+   32 bit word, so the GETARG_ macros above apply to both forms. */
+#define MRB_INSN_WIDE 0x80
+#define MRB_ISEQ_JMP_LEN 3      /* length of OP_JMP */
+
+#ifdef MRB_COMPACT_ISEQ
+mrb_insn mrb_iseq_fetch_wide(const mrb_code *pc, int *lenp);
+
+/* decodes an instruction without MRB_INSN_WIDE; constant fmt folds
+   the switch away */
+static inline mrb_insn
+mrb_iseq_fetch_narrow(const mrb_code *pc, int fmt, int *lenp)
+{
+  int op = pc[0];
+
+  switch (fmt) {
+  case MRB_IFMT_Z:
+    *lenp = 1;
+    return MKOPCODE(op);
+  case MRB_IFMT_A:
+    *lenp = 2;
+    return MKOP_A(op, pc[1]);
+  case MRB_IFMT_AB:
+    *lenp = 3;
+    return MKOP_AB(op, pc[1], pc[2]);
+  case MRB_IFMT_ABC:
+    *lenp = 4;
+    return MKOP_ABC(op, pc[1], pc[2], pc[3]);
+  case MRB_IFMT_ABx:
+    *lenp = 3;
+    return MKOP_ABx(op, pc[1], pc[2]);
+  case MRB_IFMT_AsBx:
+    *lenp = 3;
+    return MKOP_AsBx(op, pc[1], (int8_t)pc[2]);
+  case MRB_IFMT_Bx:
+    *lenp = 2;
+    return MKOP_Bx(op, pc[1]);
+  case MRB_IFMT_Ax:
+    *lenp = 4;
+    return MKOP_Ax(op, ((mrb_insn)pc[1]<<16)|(pc[2]<<8)|pc[3]);
+  case MRB_IFMT_J:
+    *lenp = 3;
+    return MKOP_sBx(op, (int16_t)((pc[1]<<8)|pc[2]));
+  default:                      /* MRB_IFMT_AJ */
+    *lenp = 4;
+    return MKOP_AsBx(op, pc[1], (int16_t)((pc[2]<<8)|pc[3]));
+  }
+}
+
+static inline mrb_insn
+mrb_iseq_fetch(const mrb_code *pc, int *lenp)
+{
+  if (pc[0] & MRB_INSN_WIDE) {
+    return mrb_iseq_fetch_wide(pc, lenp);
+  }
+  return mrb_iseq_fetch_narrow(pc, mrb_insn_format[pc[0]], lenp);
+}
+#else
+static inline mrb_insn
+mrb_iseq_fetch(const mrb_code *pc, int *lenp)
+{
+  *lenp = 1;
+  return *pc;
+}
+#endif
+
 #endif  /* OPCODE_H */
@@ -59,6 +59,14 @@ struct RString {
 #define RSTR_SET_NOFREE_FLAG(s) ((s)->flags |= MRB_STR_NOFREE)
 #define RSTR_UNSET_NOFREE_FLAG(s) ((s)->flags &= ~MRB_STR_NOFREE)
 
+#define RSTR_ASCII_P(s) ((s)->flags & MRB_STR_ASCII)
+#define RSTR_SET_ASCII_FLAG(s) ((s)->flags |= MRB_STR_ASCII)
+#define RSTR_UNSET_ASCII_FLAG(s) ((s)->flags &= ~MRB_STR_ASCII)
+
+#define RSTR_INDEXED_P(s) ((s)->flags & MRB_STR_INDEXED)
+#define RSTR_SET_INDEXED_FLAG(s) ((s)->flags |= MRB_STR_INDEXED)
+#define RSTR_UNSET_INDEXED_FLAG(s) ((s)->flags &= ~MRB_STR_INDEXED)
+
 #define mrb_str_ptr(s)       ((struct RString*)(mrb_ptr(s)))
 #define RSTRING(s)           mrb_str_ptr(s)
 #define RSTRING_PTR(s)       RSTR_PTR(RSTRING(s))
@@ -73,8 +81,12 @@ mrb_int mrb_str_strlen(mrb_state*, struct RString*);
 #define MRB_STR_EMBED     4
 #define MRB_STR_EMBED_LEN_MASK 0xf8
 #define MRB_STR_EMBED_LEN_SHIFT 3
+/* cached properties of the contents; cleared by mrb_str_modify() */
+#define MRB_STR_ASCII     256
+#define MRB_STR_INDEXED   512
 
 void mrb_gc_free_str(mrb_state*, struct RString*);
+void mrb_gc_copy_str(mrb_state*, struct RString*);
 void mrb_str_modify(mrb_state*, struct RString*);
 void mrb_str_concat(mrb_state*, mrb_value, mrb_value);
 mrb_value mrb_str_plus(mrb_state*, mrb_value, mrb_value);
@@ -106,6 +118,7 @@ mrb_value mrb_str_append(mrb_state *mrb, mrb_value str, mrb_value str2);
 int mrb_str_cmp(mrb_state *mrb, mrb_value str1, mrb_value str2);
 char *mrb_str_to_cstr(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_pool(mrb_state *mrb, mrb_value str);
+mrb_int mrb_memsearch(const void *x, mrb_int m, const void *y, mrb_int n);
 
 /* For backward compatibility */
 static inline mrb_value
@@ -71,6 +71,8 @@ void mrb_gc_free_gv(mrb_state*);
 void mrb_gc_mark_iv(mrb_state*, struct RObject*);
 size_t mrb_gc_mark_iv_size(mrb_state*, struct RObject*);
 void mrb_gc_free_iv(mrb_state*, struct RObject*);
+void mrb_gc_copy_gv(mrb_state*, mrb_state*);
+void mrb_gc_copy_iv(mrb_state*, struct RObject*);
 
 #if defined(__cplusplus)
 }  /* extern "C" { */
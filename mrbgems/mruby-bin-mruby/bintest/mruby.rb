@@ -44,3 +44,188 @@ EOS
   script.flush
   assert_equal "\"test\"\n\"fin\"\n", `./bin/mruby #{script.path}`
 end
+
+assert('mrb file with either iseq byte order') do
+  script, bin = Tempfile.new('test.rb'), Tempfile.new('test.mrb')
+  script.write "def twice(a)\n  a.map { |x| x * 2 }\nend\np twice([1, 2, 3])\n"
+  script.flush
+  %w(-e -E -g\ -e).each do |opt|
+    `bin/mrbc #{opt} -o #{bin.path} #{script.path}`
+    assert_equal "[2, 4, 6]", `bin/mruby -b #{bin.path}`.chomp
+    assert_equal "[2, 4, 6]", `bin/mruby -b < #{bin.path} -`.chomp
+  end
+end
+
+assert('debug info of nested ireps in mrb file') do
+  script, bin = Tempfile.new('test.rb'), Tempfile.new('test.mrb')
+  script.write "def f\n  [1].map { |x|\n    Proc.new {}.source_location }\nend\np f.first\n"
+  script.flush
+  `bin/mrbc -g -o #{bin.path} #{script.path}`
+  assert_equal "[\"#{script.path}\", 3]", `bin/mruby -b #{bin.path}`.chomp
+end
+
+assert('numeric literals in mrb file') do
+  script, bin = Tempfile.new('test.rb'), Tempfile.new('test.mrb')
+  script.write "p [-42, 1234567, 0.30000000000000004 == 0.1 + 0.2, 2.5e-300, -1.5]\n"
+  script.flush
+  `bin/mrbc -o #{bin.path} #{script.path}`
+  assert_equal `bin/mruby #{script.path}`, `bin/mruby -b #{bin.path}`
+  assert_equal "[-42, 1234567, true, 2.5e-300, -1.5]\n", `bin/mruby -b #{bin.path}`
+end
+
+assert('--cache-dir') do
+  require 'tmpdir'
+  script = Tempfile.new('test.rb')
+  Dir.mktmpdir do |dir|
+    script.write "def f(x)\n  x * 2\nend\np f(21)\n"
+    script.flush
+    assert_equal "42\n", `bin/mruby --cache-dir=#{dir} #{script.path}`
+    assert_equal 1, Dir.glob("#{dir}/*.mrb").size
+    assert_equal "42\n", `bin/mruby --cache-dir=#{dir} #{script.path}`
+    assert_equal 1, Dir.glob("#{dir}/*.mrb").size
+
+    # a changed source is compiled again
+    script.rewind
+    script.write "p :changed\n"
+    script.truncate(script.pos)
+    script.flush
+    assert_equal ":changed\n", `bin/mruby --cache-dir=#{dir} #{script.path}`
+    assert_equal 2, Dir.glob("#{dir}/*.mrb").size
+  end
+end
+
+assert('--cache-dir with a binary cached for another program') do
+  require 'tmpdir'
+  require 'fileutils'
+  a = Tempfile.new('a.rb')
+  b = Tempfile.new('b.rb')
+  Dir.mktmpdir do |dir|
+    a.write "p :a\n"
+    a.flush
+    b.write "p :b\n"
+    b.flush
+    `bin/mruby --cache-dir=#{dir} #{a.path}`
+    a_mrb = Dir.glob("#{dir}/*.mrb")
+    `bin/mruby --cache-dir=#{dir} #{b.path}`
+    b_mrb = Dir.glob("#{dir}/*.mrb") - a_mrb
+    assert_equal [1, 1], [a_mrb.size, b_mrb.size]
+
+    # as if the two programs had the same hash
+    FileUtils.cp b_mrb[0], a_mrb[0]
+    assert_equal ":a\n", `bin/mruby --cache-dir=#{dir} #{a.path}`
+    assert_equal ":a\n", `bin/mruby --cache-dir=#{dir} #{a.path}`
+    assert_equal ":b\n", `bin/mruby --cache-dir=#{dir} #{b.path}`
+  end
+end
+
+assert('mrb file compiled by mrbc -j') do
+  scripts = (1..5).map do |i|
+    script = Tempfile.new("test#{i}.rb")
+    script.write "def f#{i}\n  [#{i}].map { |x| x * 2 }\nend\n$a = ($a || []) + f#{i}\n"
+    script.flush
+    script
+  end
+  last = Tempfile.new('last.rb')
+  last.write "p $a, self\n"
+  last.flush
+  files = (scripts + [last]).map(&:path).join(' ')
+  bins = [1, 2, 8].map do |j|
+    bin = Tempfile.new('test.mrb')
+    `bin/mrbc -g -j#{j} -o #{bin.path} #{files}`
+    assert_equal "[2, 4, 6, 8, 10]\nmain\n", `bin/mruby -b #{bin.path}`
+    File.binread(bin.path)
+  end
+  assert_equal 1, bins.uniq.size
+end
+
+assert('mrb file compiled by mrbc -O') do
+  script = Tempfile.new('test.rb')
+  script.write <<'RUBY'
+DAY = 60*60*24
+def f(x, y = 2)
+  if x > 1
+    return x * y
+    p :dead
+  elsif false
+    p :dead
+  end
+  raise ArgumentError, "#{x}" if x < 0
+  "a" + "b"
+end
+def g(n)
+  r = 0
+  while n > 0
+    n -= 1
+    next if n == 3
+    r += n
+  end
+  r
+end
+begin
+  f(-1)
+rescue ArgumentError => e
+  p e.message
+end
+p DAY, 1 / 2, 1.5 * 2 - 1, f(2), f(2, 3), f(0), g(5)
+RUBY
+  script.flush
+  expected = "\"-1\"\n86400\n0.5\n2.0\n4\n6\n\"ab\"\n7\n"
+  sizes = (0..2).map do |o|
+    bin = Tempfile.new('test.mrb')
+    `bin/mrbc -O#{o} -o #{bin.path} #{script.path}`
+    assert_equal expected, `bin/mruby -b #{bin.path}`
+    File.size(bin.path)
+  end
+  assert_true sizes[0] > sizes[1]
+  assert_true sizes[1] > sizes[2]
+end
+
+assert('mrb file in format 0002') do
+  # compiled by the mrbc of format 0002 from:
+  #
+  #   def f(a, b = 2.5)
+  #     [a, b, -42, 1234567, "#{a} and a literal too long to embed"].map { |x| x }
+  #   end
+  #   p f(1), f(:s, 1 + 0.1)
+  #   p 1 << 20, 1.0e-30, -0.5
+  #   begin
+  #     [1].each { raise "err" }
+  #   rescue => e
+  #     p e.message, e.backtrace
+  #   end
+  dir = File.dirname(__FILE__)
+  expected = <<'EOS'
+[1, 2.5, -42, 1234567, "1 and a literal too long to embed"]
+[:s, 1.10, -42, 1234567, "s and a literal too long to embed"]
+1048576
+1.0e-30
+-0.5
+"err"
+EOS
+  assert_equal expected + "[]\n", `bin/mruby -b #{dir}/format_0002.mrb`
+  assert_equal expected + "[]\n", `bin/mruby -b < #{dir}/format_0002.mrb -`
+  assert_equal expected + "[\"format_0002.rb:9\"]\n", `bin/mruby -b #{dir}/format_0002_g.mrb`
+end
+
+assert('backtraces of mrb file compiled by mrbc -g -j') do
+  lib = Tempfile.new('lib.rb')
+  lib.write "def f(x)\n  raise \"f\#{x}\" if x > 1\n  [x].map { |y| f(y + 1) }\nend\n"
+  lib.flush
+  main = Tempfile.new('main.rb')
+  main.write "begin\n  f(1)\nrescue => e\n  p e.message, e.backtrace\nend\n"
+  main.flush
+  last = Tempfile.new('last.rb')
+  last.write "p :last\nreturn\np :not_reached\n"
+  last.flush
+  files = [lib, main, last].map(&:path).join(' ')
+  bin = Tempfile.new('test.mrb')
+  outputs = ['', '-j2'].map do |opt|
+    `bin/mrbc -g #{opt} -o #{bin.path} #{files}`
+    `bin/mruby -b #{bin.path} 2>&1`.gsub(/^\t\[\d+\] /, "\t")
+  end
+  assert_equal outputs[0], outputs[1]
+  assert_include outputs[1], "#{lib.path}:2:in Object.f"
+  assert_false outputs[1].include?("in Object.call")
+  assert_include outputs[1], "LocalJumpError"
+  assert_false outputs[1].include?(":not_reached")
+end
@@ -5,7 +5,17 @@
 #include "mruby/array.h"
 #include "mruby/compile.h"
 #include "mruby/dump.h"
+#include "mruby/irep.h"
+#include "mruby/proc.h"
 #include "mruby/variable.h"
+#include "mruby/version.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define USE_MMAP
+#endif
 
 #ifndef ENABLE_STDIO
 static void
@@ -21,10 +31,15 @@ p(mrb_state *mrb, mrb_value obj)
 
 void mrb_show_version(mrb_state *);
 void mrb_show_copyright(mrb_state *);
+void mrb_codedump_all(mrb_state*, struct RProc*);
 
 struct _args {
   FILE *rfp;
   char* cmdline;
+  const char *cache_dir;
+  void *map;
+  size_t maplen;
+  uint8_t *cache;
   mrb_bool fname        : 1;
   mrb_bool mrbfile      : 1;
   mrb_bool check_syntax : 1;
@@ -43,6 +58,7 @@ usage(const char *name)
   "-e 'command' one line of script",
   "-v           print version number, then run in verbose mode",
   "--verbose    run in verbose mode",
+  "--cache-dir=dir keep compiled programfiles in dir",
   "--version    print the version",
   "--copyright  print the copyright",
   NULL
@@ -131,6 +147,10 @@ append_cmdline:
         mrb_show_copyright(mrb);
         exit(EXIT_SUCCESS);
       }
+      else if (strncmp((*argv) + 2, "cache-dir=", 10) == 0) {
+        args->cache_dir = (*argv) + 12;
+        break;
+      }
     default:
       return EXIT_FAILURE;
     }
@@ -166,6 +186,194 @@ cleanup(mrb_state *mrb, struct _args *args)
   if (args->argv)
     mrb_free(mrb, args->argv);
   mrb_close(mrb);
+  /* loaded ireps point into the mapping or the cached binary until the
+     state is closed */
+#ifdef USE_MMAP
+  if (args->map)
+    munmap(args->map, args->maplen);
+#endif
+  free(args->cache);
+}
+
+#ifdef USE_MMAP
+/* map a RiteBinary file read-only so that the loader can use symbol
+   names, strings and (native byte order) iseqs in place; the pages are
+   shared between processes loading the same file */
+static const uint8_t *
+map_mrbfile(struct _args *args)
+{
+  struct stat st;
+  void *p;
+  const struct rite_binary_header *header;
+
+  if (fstat(fileno(args->rfp), &st) != 0 || !S_ISREG(st.st_mode) ||
+      (size_t)st.st_size < sizeof(struct rite_binary_header)) {
+    return NULL;
+  }
+  p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fileno(args->rfp), 0);
+  if (p == MAP_FAILED) return NULL;
+  header = (const struct rite_binary_header *)p;
+  if (bin_to_uint32(header->binary_size) > (uint32_t)st.st_size) {
+    /* truncated file; let the stdio loader report it */
+    munmap(p, (size_t)st.st_size);
+    return NULL;
+  }
+  args->map = p;
+  args->maplen = (size_t)st.st_size;
+  return (const uint8_t *)p;
+}
+#endif
+
+/*
+ * The program file compiled to RiteBinary is kept in the cache directory
+ * under a name made from a hash of the mruby version, the file name and
+ * the source.  Those three follow the binary in the file, and the cached
+ * binary is used only when they match, so neither a changed source nor
+ * another program with the same hash is run in its place.
+ */
+struct cache_key {
+  const char *ptr[3];
+  size_t len[3];
+};
+
+static uint64_t
+cache_hash(uint64_t h, const char *s, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)s[i]) * 1099511628211ULL; /* FNV-1a */
+  }
+  return h;
+}
+
+static char*
+read_source(mrb_state *mrb, FILE *fp, size_t *lenp)
+{
+  size_t len = 0, capa = 4096, n;
+  char *buf = (char *)mrb_malloc(mrb, capa);
+
+  while ((n = fread(buf + len, 1, capa - len, fp)) > 0) {
+    len += n;
+    if (len == capa) {
+      capa *= 2;
+      buf = (char *)mrb_realloc(mrb, buf, capa);
+    }
+  }
+  *lenp = len;
+  return buf;
+}
+
+/* the cached binary at path if it was compiled from key; the ireps point
+   into the file contents, which are kept in args->cache */
+static mrb_irep*
+read_cache(mrb_state *mrb, struct _args *args, const char *path, const struct cache_key *key)
+{
+  FILE *fp = fopen(path, "rb");
+  uint8_t *buf = NULL, *p;
+  long size;
+  size_t bsize, klen = 0;
+  mrb_irep *irep = NULL;
+  int i;
+
+  if (fp == NULL) return NULL;
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      (size_t)size < sizeof(struct rite_binary_header) || fseek(fp, 0, SEEK_SET) != 0) {
+    goto done;
+  }
+  buf = (uint8_t *)malloc((size_t)size);
+  if (buf == NULL || fread(buf, (size_t)size, 1, fp) != 1) goto done;
+  bsize = bin_to_uint32(((struct rite_binary_header *)buf)->binary_size);
+  for (i = 0; i < 3; i++) {
+    klen += key->len[i];
+  }
+  if (bsize > (size_t)size || (size_t)size - bsize != klen) goto done;
+  for (p = buf + bsize, i = 0; i < 3; p += key->len[i], i++) {
+    if (memcmp(p, key->ptr[i], key->len[i]) != 0) goto done;
+  }
+  irep = mrb_read_irep(mrb, buf);
+ done:
+  fclose(fp);
+  if (irep) {
+    args->cache = buf;
+  }
+  else {
+    free(buf);
+  }
+  return irep;
+}
+
+static void
+write_cache(mrb_state *mrb, const char *path, mrb_irep *irep, const struct cache_key *key)
+{
+  char tmp[1024];
+  FILE *fp;
+  int n, i;
+
+#ifdef USE_MMAP
+  snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+#else
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+#endif
+  fp = fopen(tmp, "wb");
+  if (fp == NULL) return;
+  n = mrb_dump_irep_binary(mrb, irep, DUMP_DEBUG_INFO, fp);
+  for (i = 0; i < 3 && n == MRB_DUMP_OK; i++) {
+    if (key->len[i] > 0 && fwrite(key->ptr[i], key->len[i], 1, fp) != 1) {
+      n = MRB_DUMP_WRITE_FAULT;
+    }
+  }
+  if (fclose(fp) != 0 || n != MRB_DUMP_OK || rename(tmp, path) != 0) {
+    remove(tmp);
+  }
+}
+
+static mrb_value
+load_cached(mrb_state *mrb, struct _args *args, mrbc_context *c)
+{
+  static const char version[] = MRUBY_VERSION;
+  char path[1000];
+  size_t len;
+  char *src = read_source(mrb, args->rfp, &len);
+  uint64_t h = 14695981039346656037ULL;
+  struct cache_key key;
+  mrb_irep *irep;
+  mrb_value v;
+  mrb_bool no_exec = c->no_exec;
+  int i;
+
+  key.ptr[0] = version;
+  key.len[0] = sizeof(version);
+  key.ptr[1] = args->cmdline;
+  key.len[1] = strlen(args->cmdline) + 1;
+  key.ptr[2] = src;
+  key.len[2] = len;
+  for (i = 0; i < 3; i++) {
+    h = cache_hash(h, key.ptr[i], key.len[i]);
+  }
+  snprintf(path, sizeof(path), "%s/%08lx%08lx.mrb", args->cache_dir,
+           (unsigned long)(h >> 32), (unsigned long)(h & 0xffffffff));
+
+  irep = read_cache(mrb, args, path, &key);
+  if (irep) {
+    struct RProc *proc = mrb_proc_new(mrb, irep);
+
+    mrb_irep_decref(mrb, irep);
+    mrb_free(mrb, src);
+    if (c->dump_result) mrb_codedump_all(mrb, proc);
+    if (no_exec) return mrb_obj_value(proc);
+    return mrb_toplevel_run(mrb, proc);
+  }
+
+  c->no_exec = TRUE;
+  v = mrb_load_nstring_cxt(mrb, src, (int)len, c);
+  c->no_exec = no_exec;
+  if (!mrb->exc && !no_exec) {
+    write_cache(mrb, path, mrb_proc_ptr(v)->body.irep, &key);
+  }
+  mrb_free(mrb, src);
+  if (mrb->exc || no_exec) return v;
+  return mrb_toplevel_run(mrb, mrb_proc_ptr(v));
 }
 
 int
@@ -219,7 +427,20 @@ main(int argc, char **argv)
 
   /* Load program */
   if (args.mrbfile) {
-    v = mrb_load_irep_file_cxt(mrb, args.rfp, c);
+    const uint8_t *bin = NULL;
+
+#ifdef USE_MMAP
+    bin = map_mrbfile(&args);
+#endif
+    if (bin) {
+      v = mrb_load_irep_cxt(mrb, bin, c);
+    }
+    else {
+      v = mrb_load_irep_file_cxt(mrb, args.rfp, c);
+    }
+  }
+  else if (args.rfp && args.fname && args.cache_dir) {
+    v = load_cached(mrb, &args, c);
   }
   else if (args.rfp) {
     v = mrb_load_file_cxt(mrb, args.rfp, c);
@@ -39,6 +39,18 @@ assert('success') do
   assert_equal "", o
 end
 
+assert('keeps iseq byte order') do
+  script_file, compiled = Tempfile.new('script.rb'), Tempfile.new('c.mrb')
+  script_file.write "p 'test'\n"
+  script_file.flush
+  `bin/mrbc -e -g -o #{compiled.path} #{script_file.path}`
+
+  `bin/mruby-strip #{compiled.path}`
+  assert_equal 0, $?.exitstatus
+  assert_equal "ETIR", File.binread(compiled.path, 4)
+  assert_equal `bin/mruby #{script_file.path}`, `bin/mruby -b #{compiled.path}`
+end
+
 assert('check debug section') do
   script_file, with_debug, without_debug =
     Tempfile.new('script.rb'), Tempfile.new('c1.mrb'), Tempfile.new('c2.mrb')
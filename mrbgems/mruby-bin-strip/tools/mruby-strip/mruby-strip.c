@@ -82,6 +82,8 @@ strip(mrb_state *mrb, struct strip_args *args)
     mrb_irep *irep;
     FILE *wfile;
     int dump_result;
+    uint8_t ident[4];
+    int flags = DUMP_ENDIAN_BIG;
 
     filename = args->argv[i];
     rfile = fopen(filename, "rb");
@@ -90,6 +92,12 @@ strip(mrb_state *mrb, struct strip_args *args)
       return EXIT_FAILURE;
     }
 
+    /* keep the iseq byte order of the original file */
+    if (fread(ident, sizeof(ident), 1, rfile) == 1 &&
+        memcmp(ident, RITE_BINARY_IDENTIFIER_LIL, sizeof(ident)) == 0) {
+      flags = DUMP_ENDIAN_LIL;
+    }
+    rewind(rfile);
     irep = mrb_read_irep_file(mrb, rfile);
     fclose(rfile);
     if (irep == NULL) {
@@ -110,7 +118,7 @@ strip(mrb_state *mrb, struct strip_args *args)
     }
 
     /* debug flag must always be false */
-    dump_result = mrb_dump_irep_binary(mrb, irep, FALSE, wfile);
+    dump_result = mrb_dump_irep_binary(mrb, irep, flags, wfile);
 
     fclose(wfile);
     mrb_irep_decref(mrb, irep);
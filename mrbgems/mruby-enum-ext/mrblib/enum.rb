@@ -191,18 +191,14 @@ module Enumerable
   def sort_by(&block)
     return to_enum :sort_by unless block_given?
 
-    ary = []
+    keys = []
     orig = []
-    self.each_with_index{|e, i|
+    self.each{|*val|
+      e = val.__svalue
       orig.push(e)
-      ary.push([block.call(e), i])
+      keys.push(block.call(e))
     }
-    if ary.size > 1
-      __sort_sub__(ary, ::Array.new(ary.size), 0, 0, ary.size - 1) do |a,b|
-        a <=> b
-      end
-    end
-    ary.collect{|e,i| orig[i]}
+    orig.__ary_sort(keys)
   end
 
   NONE = Object.new
@@ -44,6 +44,10 @@ end
 
 assert("Enumerable#sort_by") do
   assert_equal ["car", "train", "bicycle"], %w{car bicycle train}.sort_by {|e| e.length}
+  assert_equal [2, 4, 1, 3, 5], (1..5).sort_by {|e| e % 2}
+  n = 0
+  assert_equal [3, 2, 1], [1, 2, 3].sort_by {|e| n += 1; -e}
+  assert_equal 3, n
 end
 
 assert("Enumerable#first") do
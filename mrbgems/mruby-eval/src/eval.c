@@ -1,8 +1,153 @@
+#include <string.h>
 #include "mruby.h"
 #include "mruby/compile.h"
+#include "mruby/data.h"
 #include "mruby/irep.h"
 #include "mruby/proc.h"
 #include "mruby/opcode.h"
+#include "mruby/variable.h"
+
+/*
+ * Strings evaluated again from the same place reuse the code generated
+ * the first time.  The code depends on the local variables around the
+ * call (see patch_irep()), so the irep of the caller is part of the key
+ * with the source, file name and line.  The last MRB_EVAL_CACHE_SIZE
+ * ireps are kept, most recently used first.
+ */
+#ifndef MRB_EVAL_CACHE_SIZE
+#define MRB_EVAL_CACHE_SIZE 16
+#endif
+
+struct eval_cache_entry {
+  uint32_t hash;
+  mrb_int len;
+  char *src;
+  char *file;
+  mrb_int line;
+  mrb_irep *scope;
+  mrb_irep *irep;
+};
+
+struct eval_cache {
+  int n;
+  struct eval_cache_entry e[MRB_EVAL_CACHE_SIZE];
+};
+
+static void
+eval_cache_entry_free(mrb_state *mrb, struct eval_cache_entry *e)
+{
+  mrb_free(mrb, e->src);
+  mrb_free(mrb, e->file);
+  mrb_irep_decref(mrb, e->scope);
+  mrb_irep_decref(mrb, e->irep);
+}
+
+static void
+eval_cache_free(mrb_state *mrb, void *p)
+{
+  struct eval_cache *cache = (struct eval_cache*)p;
+  int i;
+
+  for (i = 0; i < cache->n; i++) {
+    eval_cache_entry_free(mrb, &cache->e[i]);
+  }
+  mrb_free(mrb, cache);
+}
+
+/* a copy starts empty: the cached ireps belong to the original state */
+static void*
+eval_cache_copy(mrb_state *mrb, const void *p)
+{
+  struct eval_cache *cache = (struct eval_cache*)mrb_malloc(mrb, sizeof(struct eval_cache));
+
+  cache->n = 0;
+  return cache;
+}
+
+static const struct mrb_data_type eval_cache_type = {
+  "eval_cache", eval_cache_free, eval_cache_copy,
+};
+
+static struct eval_cache*
+eval_cache_get(mrb_state *mrb)
+{
+  mrb_value v = mrb_obj_iv_get(mrb, (struct RObject*)mrb->kernel_module, mrb_intern_lit(mrb, "__eval_cache__"));
+
+  return (struct eval_cache*)DATA_PTR(v);
+}
+
+static uint32_t
+eval_hash(const char *s, mrb_int len)
+{
+  uint32_t h = 2166136261U;     /* FNV-1a */
+  mrb_int i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ (unsigned char)s[i]) * 16777619U;
+  }
+  return h;
+}
+
+static mrb_bool
+eval_cache_match(struct eval_cache_entry *e, uint32_t hash, const char *s, mrb_int len,
+                 mrb_irep *scope, const char *file, mrb_int line)
+{
+  if (e->hash != hash || e->len != len || e->scope != scope || e->line != line) return FALSE;
+  if (file ? (!e->file || strcmp(e->file, file) != 0) : e->file != NULL) return FALSE;
+  return memcmp(e->src, s, len) == 0;
+}
+
+static mrb_irep*
+eval_cache_lookup(struct eval_cache *cache, uint32_t hash, const char *s, mrb_int len,
+                  mrb_irep *scope, const char *file, mrb_int line)
+{
+  struct eval_cache_entry e;
+  int i;
+
+  for (i = 0; i < cache->n; i++) {
+    if (eval_cache_match(&cache->e[i], hash, s, len, scope, file, line)) {
+      e = cache->e[i];
+      memmove(&cache->e[1], &cache->e[0], sizeof(struct eval_cache_entry)*i);
+      cache->e[0] = e;
+      return e.irep;
+    }
+  }
+  return NULL;
+}
+
+static char*
+eval_strdup(mrb_state *mrb, const char *s, size_t len)
+{
+  char *p = (char*)mrb_malloc(mrb, len + 1);
+
+  memcpy(p, s, len);
+  p[len] = '\0';
+  return p;
+}
+
+static void
+eval_cache_add(mrb_state *mrb, struct eval_cache *cache, uint32_t hash, const char *s, mrb_int len,
+               mrb_irep *scope, const char *file, mrb_int line, mrb_irep *irep)
+{
+  struct eval_cache_entry e;
+
+  e.hash = hash;
+  e.len = len;
+  e.src = eval_strdup(mrb, s, len);
+  e.file = file ? eval_strdup(mrb, file, strlen(file)) : NULL;
+  e.line = line;
+  e.scope = scope;
+  e.irep = irep;
+  mrb_irep_incref(mrb, scope);
+  mrb_irep_incref(mrb, irep);
+
+  if (cache->n == MRB_EVAL_CACHE_SIZE) {
+    eval_cache_entry_free(mrb, &cache->e[--cache->n]);
+  }
+  memmove(&cache->e[1], &cache->e[0], sizeof(struct eval_cache_entry)*cache->n);
+  cache->e[0] = e;
+  cache->n++;
+}
 
 static struct mrb_irep *
 get_closure_irep(mrb_state *mrb, int level)
@@ -25,7 +170,7 @@ get_closure_irep(mrb_state *mrb, int level)
   return proc->body.irep;
 }
 
-static inline mrb_code
+static inline mrb_insn
 search_variable(mrb_state *mrb, mrb_sym vsym, int bnest)
 {
   mrb_irep *virep;
@@ -50,25 +195,33 @@ search_variable(mrb_state *mrb, mrb_sym vsym, int bnest)
 static void
 patch_irep(mrb_state *mrb, mrb_irep *irep, int bnest)
 {
-  size_t i;
-  mrb_code c;
+  size_t i, ilen;
+  mrb_insn c, *iseq;
 
   for (i = 0; i < irep->rlen; i++) {
     patch_irep(mrb, irep->reps[i], bnest + 1);
   }
 
-  for (i = 0; i < irep->ilen; i++) {
-    c = irep->iseq[i];
+#ifdef MRB_COMPACT_ISEQ
+  /* patched in the packed form, as the instructions change length */
+  iseq = mrb_iseq_decode(mrb, irep->iseq, irep->ilen, &ilen);
+  if (!iseq) return;
+#else
+  iseq = irep->iseq;
+  ilen = irep->ilen;
+#endif
+  for (i = 0; i < ilen; i++) {
+    c = iseq[i];
     switch(GET_OPCODE(c)){
     case OP_SEND:
       if (GETARG_C(c) != 0) {
         break;
       }
       {
-        mrb_code arg = search_variable(mrb, irep->syms[GETARG_B(c)], bnest);
+        mrb_insn arg = search_variable(mrb, irep->syms[GETARG_B(c)], bnest);
         if (arg != 0) {
           /* must replace */
-          irep->iseq[i] = MKOPCODE(OP_GETUPVAR) | MKARG_A(GETARG_A(c)) | arg;
+          iseq[i] = MKOPCODE(OP_GETUPVAR) | MKARG_A(GETARG_A(c)) | arg;
         }
       }
       break;
@@ -76,23 +229,40 @@ patch_irep(mrb_state *mrb, mrb_irep *irep, int bnest)
     case OP_MOVE:
       /* src part */
       if (GETARG_B(c) < irep->nlocals) {
-        mrb_code arg = search_variable(mrb, irep->lv[GETARG_B(c) - 1].name, bnest);
+        mrb_insn arg = search_variable(mrb, irep->lv[GETARG_B(c) - 1].name, bnest);
         if (arg != 0) {
           /* must replace */
-          irep->iseq[i] = MKOPCODE(OP_GETUPVAR) | MKARG_A(GETARG_A(c)) | arg;
+          iseq[i] = MKOPCODE(OP_GETUPVAR) | MKARG_A(GETARG_A(c)) | arg;
         }
       }
       /* dst part */
       if (GETARG_A(c) < irep->nlocals) {
-        mrb_code arg = search_variable(mrb, irep->lv[GETARG_A(c) - 1].name, bnest);
+        mrb_insn arg = search_variable(mrb, irep->lv[GETARG_A(c) - 1].name, bnest);
         if (arg != 0) {
           /* must replace */
-          irep->iseq[i] = MKOPCODE(OP_SETUPVAR) | MKARG_A(GETARG_B(c)) | arg;
+          iseq[i] = MKOPCODE(OP_SETUPVAR) | MKARG_A(GETARG_B(c)) | arg;
         }
       }
       break;
     }
   }
+#ifdef MRB_COMPACT_ISEQ
+  {
+    size_t len;
+    uint8_t *bin = mrb_iseq_encode(mrb, iseq, ilen, &len);
+
+    mrb_free(mrb, iseq);
+    if (!bin) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "too long jump for compact iseq");
+    }
+    if (!(irep->flags & MRB_ISEQ_NO_FREE)) {
+      mrb_free(mrb, irep->iseq);
+    }
+    irep->flags &= ~MRB_ISEQ_NO_FREE;
+    irep->iseq = bin;
+    irep->ilen = len;
+  }
+#endif
 }
 
 static struct RProc*
@@ -102,11 +272,25 @@ create_proc_from_string(mrb_state *mrb, char *s, int len, mrb_value binding, cha
   struct mrb_parser_state *p;
   struct RProc *proc;
   struct REnv *e;
+  struct eval_cache *cache = eval_cache_get(mrb);
+  struct RProc *caller = mrb->c->ci[-1].proc;
+  mrb_irep *scope = NULL, *irep;
+  uint32_t hash = 0;
 
   if (!mrb_nil_p(binding)) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "Binding of eval must be nil.");
   }
 
+  if (!MRB_PROC_CFUNC_P(caller)) {
+    scope = caller->body.irep;
+    hash = eval_hash(s, len);
+    irep = eval_cache_lookup(cache, hash, s, len, scope, file, line);
+    if (irep) {
+      proc = mrb_proc_new(mrb, irep);
+      goto env;
+    }
+  }
+
   cxt = mrbc_context_new(mrb);
   cxt->lineno = line;
   if (file) {
@@ -132,14 +316,6 @@ create_proc_from_string(mrb_state *mrb, char *s, int len, mrb_value binding, cha
   }
 
   proc = mrb_generate_code(mrb, p);
-  e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, (struct RClass*)mrb->c->ci[-1].proc->env);
-  e->mid = mrb->c->ci[-1].mid;
-  e->cioff = mrb->c->ci - mrb->c->cibase - 1;
-  e->stack = mrb->c->ci->stackent;
-  mrb->c->ci->env = e;
-  proc->env = e;
-  patch_irep(mrb, proc->body.irep, 0);
-
   mrb_parser_free(p);
   mrbc_context_free(mrb, cxt);
 
@@ -148,6 +324,19 @@ create_proc_from_string(mrb_state *mrb, char *s, int len, mrb_value binding, cha
     mrb_raise(mrb, E_SCRIPT_ERROR, "codegen error");
   }
 
+  patch_irep(mrb, proc->body.irep, 0);
+  if (scope) {
+    eval_cache_add(mrb, cache, hash, s, len, scope, file, line, proc->body.irep);
+  }
+
+ env:
+  e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, (struct RClass*)mrb->c->ci[-1].proc->env);
+  e->mid = mrb->c->ci[-1].mid;
+  e->cioff = mrb->c->ci - mrb->c->cibase - 1;
+  e->stack = mrb->c->ci->stackent;
+  mrb->c->ci->env = e;
+  proc->env = e;
+
   return proc;
 }
 
@@ -201,6 +390,11 @@ f_instance_eval(mrb_state *mrb, mrb_value self)
 void
 mrb_mruby_eval_gem_init(mrb_state* mrb)
 {
+  struct eval_cache *cache = (struct eval_cache*)mrb_malloc(mrb, sizeof(struct eval_cache));
+
+  cache->n = 0;
+  mrb_obj_iv_set(mrb, (struct RObject*)mrb->kernel_module, mrb_intern_lit(mrb, "__eval_cache__"),
+                 mrb_obj_value(Data_Wrap_Struct(mrb, mrb->object_class, &eval_cache_type, cache)));
   mrb_define_module_function(mrb, mrb->kernel_module, "eval", f_eval, MRB_ARGS_ARG(1, 3));
   mrb_define_method(mrb, mrb->kernel_module, "instance_eval", f_instance_eval, MRB_ARGS_ARG(1, 2));
 }
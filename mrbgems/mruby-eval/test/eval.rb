@@ -60,3 +60,23 @@ assert('String instance_eval') do
   assert_equal('test') { obj.instance_eval('@test') }
   assert_equal('test') { obj.instance_eval { @test } }
 end
+
+assert('eval of the same string again') do
+  def eval_cache_a
+    x = 1
+    eval 'x + 1'
+  end
+  def eval_cache_b
+    eval 'x + 1' rescue :none
+  end
+  sum = 0
+  5.times { |i| sum += eval('i * 2') }
+  assert_equal 20, sum
+  assert_equal [2, 2], [eval_cache_a, eval_cache_a]
+  assert_equal :none, eval_cache_b
+  assert_equal ['a.rb', 3], eval('[__FILE__, __LINE__]', nil, 'a.rb', 3)
+  assert_equal ['b.rb', 3], eval('[__FILE__, __LINE__]', nil, 'b.rb', 3)
+  assert_equal ['b.rb', 5], eval('[__FILE__, __LINE__]', nil, 'b.rb', 5)
+  20.times { |i| eval "#{i}" }
+  assert_equal 2, eval_cache_a
+end
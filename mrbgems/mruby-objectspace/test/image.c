@@ -0,0 +1,104 @@
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/compile.h"
+#include "mruby/data.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+
+/* data without a dcopy function; such an image cannot be copied */
+static const struct mrb_data_type no_copy_type = { "NoCopy", NULL, NULL };
+
+/* the inspected result of code run in mrb, as a string of mrb2 */
+static mrb_value
+run_in(mrb_state *mrb2, mrb_state *mrb, mrb_value code)
+{
+  mrb_value v, s;
+  int ai = mrb_gc_arena_save(mrb);
+
+  v = mrb_load_nstring(mrb, RSTRING_PTR(code), (int)RSTRING_LEN(code));
+  if (mrb->exc) {
+    v = mrb_obj_value(mrb->exc);
+    mrb->exc = NULL;
+  }
+  s = mrb_inspect(mrb, v);
+  v = mrb_str_new(mrb2, RSTRING_PTR(s), RSTRING_LEN(s));
+  mrb_gc_arena_restore(mrb, ai);
+  return v;
+}
+
+static mrb_state*
+open_image(mrb_state *mrb, mrb_value setup)
+{
+  mrb_state *image = mrb_open();
+
+  if (image == NULL) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot open an image");
+  }
+  run_in(mrb, image, setup);
+  mrb_prepare_image(image);
+  return image;
+}
+
+/*
+ * ImageTest.copies(setup, change, probe) runs setup in a new state and
+ * makes it an image; it then opens two copies, runs change in the first,
+ * and returns the result of probe in the first copy, in the second one
+ * and in the image.
+ */
+static mrb_value
+image_copies(mrb_state *mrb, mrb_value self)
+{
+  mrb_value setup, change, probe, result[3];
+  mrb_state *image, *a, *b;
+
+  mrb_get_args(mrb, "SSS", &setup, &change, &probe);
+  image = open_image(mrb, setup);
+  a = mrb_open_from_image(image);
+  b = mrb_open_from_image(image);
+  if (a == NULL || b == NULL) {
+    if (a) mrb_close(a);
+    if (b) mrb_close(b);
+    mrb_close(image);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "cannot copy the image");
+  }
+  run_in(mrb, a, change);
+  mrb_full_gc(a);
+  result[0] = run_in(mrb, a, probe);
+  result[1] = run_in(mrb, b, probe);
+  mrb_close(a);
+  mrb_close(b);
+  result[2] = run_in(mrb, image, probe);
+  mrb_close(image);
+  return mrb_ary_new_from_values(mrb, 3, result);
+}
+
+/* ImageTest.copyable?(setup, data) tells if an image set up so can be copied */
+static mrb_value
+image_copyable_p(mrb_state *mrb, mrb_value self)
+{
+  mrb_value setup;
+  mrb_bool data;
+  mrb_state *image, *copy;
+
+  mrb_get_args(mrb, "Sb", &setup, &data);
+  image = open_image(mrb, setup);
+  if (data) {
+    struct RData *d = mrb_data_object_alloc(image, image->object_class, image, &no_copy_type);
+
+    mrb_gv_set(image, mrb_intern_lit(image, "$data"), mrb_obj_value(d));
+    mrb_prepare_image(image);
+  }
+  copy = mrb_open_from_image(image);
+  if (copy) mrb_close(copy);
+  mrb_close(image);
+  return mrb_bool_value(copy != NULL);
+}
+
+void
+mrb_mruby_objectspace_gem_test(mrb_state *mrb)
+{
+  struct RClass *c = mrb_define_module(mrb, "ImageTest");
+
+  mrb_define_class_method(mrb, c, "copies", image_copies, MRB_ARGS_REQ(3));
+  mrb_define_class_method(mrb, c, "copyable?", image_copyable_p, MRB_ARGS_REQ(2));
+}
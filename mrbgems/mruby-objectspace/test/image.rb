@@ -0,0 +1,35 @@
+assert('copies of an image are isolated') do
+  setup = <<'EOS'
+class ImageTestA
+  def m; :original; end
+  def n; :n; end
+end
+$objects = (1..100).map { |i| [i, "s#{i}" * 8] }
+EOS
+  change = <<'EOS'
+class ImageTestA
+  def m; :changed; end
+  undef n
+end
+String.module_eval { def image_test_extra; :extra; end }
+class Array; def sum_size; size; end; end
+$objects = nil
+GC.start
+EOS
+  probe = <<'EOS'
+a = ImageTestA.new
+[a.m, a.respond_to?(:n), "".respond_to?(:image_test_extra),
+ [].respond_to?(:sum_size), $objects && $objects.last]
+EOS
+  changed, other, image = ImageTest.copies(setup, change, probe)
+  assert_equal '[:changed, false, true, true, nil]', changed
+  assert_equal '[:original, true, false, false, [100, "s100s100s100s100s100s100s100s100"]]', other
+  assert_equal other, image
+end
+
+assert('images that cannot be copied') do
+  assert_true ImageTest.copyable?('$h = { "a" => 1, 2 => 3.0 }', false)
+  assert_false ImageTest.copyable?('$h = { Object.new => 1 }', false)
+  assert_false ImageTest.copyable?('$f = Fiber.new { Fiber.yield }; $f.resume', false)
+  assert_false ImageTest.copyable?('', true)
+end
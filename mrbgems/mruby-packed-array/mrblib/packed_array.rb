@@ -0,0 +1,56 @@
+module PackedArray
+  ##
+  # Calls the given block for each element.
+  def each(&block)
+    return to_enum :each unless block_given?
+
+    idx = 0
+    while idx < self.size
+      yield(self[idx])
+      idx += 1
+    end
+    self
+  end
+
+  ##
+  # Replaces each element in place.
+  #
+  # With +op+ (one of :+, :-, :*, :/) and +x+ (a number, or a
+  # packed array of the same type and size) the whole array is
+  # updated in C; otherwise each element is replaced by the
+  # value of the block.
+  def map!(op=nil, x=nil, &block)
+    return self.__map_op!(op, x) if op
+    return to_enum :map! unless block_given?
+
+    idx = 0
+    while idx < self.size
+      self[idx] = yield(self[idx])
+      idx += 1
+    end
+    self
+  end
+
+  ##
+  # Multiplies every element by +k+ in place.
+  def scale!(k)
+    self.__map_op!(:*, k)
+  end
+
+  def inspect
+    "#{self.class}#{self.to_a.inspect}"
+  end
+  alias to_s inspect
+end
+
+class Float64Array
+  include PackedArray
+end
+
+class Int64Array
+  include PackedArray
+end
+
+class Int32Array
+  include PackedArray
+end
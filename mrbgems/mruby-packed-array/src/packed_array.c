@@ -0,0 +1,779 @@
+/*
+** packed_array.c - Float64Array, Int64Array and Int32Array
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/string.h"
+
+/*
+ * Elements are stored unboxed in one malloc'd buffer.  The bulk
+ * operations below are plain loops over that buffer with no calls
+ * or type checks inside, which the compiler can vectorize.
+ */
+
+enum packed_kind {
+  PACKED_F64,
+  PACKED_I64,
+  PACKED_I32
+};
+
+struct packed_array {
+  enum packed_kind kind;
+  mrb_int len;
+  void *ptr;
+};
+
+static const size_t packed_elem_size[] = {
+  sizeof(double), sizeof(int64_t), sizeof(int32_t)
+};
+
+static void
+packed_free(mrb_state *mrb, void *p)
+{
+  struct packed_array *pa = (struct packed_array*)p;
+
+  mrb_free(mrb, pa->ptr);
+  mrb_free(mrb, pa);
+}
+
+static void*
+packed_copy(mrb_state *mrb, const void *p)
+{
+  const struct packed_array *src = (const struct packed_array*)p;
+  struct packed_array *pa = (struct packed_array*)mrb_malloc(mrb, sizeof(struct packed_array));
+  size_t size = packed_elem_size[src->kind] * src->len;
+
+  *pa = *src;
+  pa->ptr = NULL;
+  if (size > 0) {
+    pa->ptr = mrb_malloc(mrb, size);
+    memcpy(pa->ptr, src->ptr, size);
+  }
+  return pa;
+}
+
+static const struct mrb_data_type packed_f64_type = { "Float64Array", packed_free, packed_copy };
+static const struct mrb_data_type packed_i64_type = { "Int64Array", packed_free, packed_copy };
+static const struct mrb_data_type packed_i32_type = { "Int32Array", packed_free, packed_copy };
+
+static const struct mrb_data_type *packed_types[] = {
+  &packed_f64_type, &packed_i64_type, &packed_i32_type
+};
+
+#define F64(pa) ((double*)(pa)->ptr)
+#define I64(pa) ((int64_t*)(pa)->ptr)
+#define I32(pa) ((int32_t*)(pa)->ptr)
+
+static struct packed_array*
+packed_ptr(mrb_state *mrb, mrb_value obj)
+{
+  if (mrb_type(obj) == MRB_TT_DATA && DATA_PTR(obj)) {
+    const struct mrb_data_type *t = DATA_TYPE(obj);
+
+    if (t == &packed_f64_type || t == &packed_i64_type || t == &packed_i32_type) {
+      return (struct packed_array*)DATA_PTR(obj);
+    }
+  }
+  mrb_raisef(mrb, E_TYPE_ERROR, "%S is not a packed array", mrb_obj_value(mrb_obj_class(mrb, obj)));
+  return NULL;                  /* not reached */
+}
+
+static void
+packed_resize(mrb_state *mrb, struct packed_array *pa, mrb_int len)
+{
+  size_t esize = packed_elem_size[pa->kind];
+
+  if (len < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
+  }
+  if ((size_t)len > SIZE_MAX / esize) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
+  }
+  pa->ptr = mrb_realloc(mrb, pa->ptr, esize * len);
+  if (len > pa->len) {
+    memset((char*)pa->ptr + esize * pa->len, 0, esize * (len - pa->len));
+  }
+  pa->len = len;
+}
+
+static struct packed_array*
+packed_new(mrb_state *mrb, enum packed_kind kind)
+{
+  struct packed_array *pa;
+
+  pa = (struct packed_array*)mrb_malloc(mrb, sizeof(struct packed_array));
+  pa->kind = kind;
+  pa->len = 0;
+  pa->ptr = NULL;
+  return pa;
+}
+
+/* a new, zero filled array of the same class as +self+ */
+static mrb_value
+packed_dup_empty(mrb_state *mrb, mrb_value self, struct packed_array *src)
+{
+  struct packed_array *pa = packed_new(mrb, src->kind);
+  mrb_value obj;
+
+  obj = mrb_obj_value(Data_Wrap_Struct(mrb, mrb_obj_class(mrb, self), packed_types[src->kind], pa));
+  packed_resize(mrb, pa, src->len);
+  return obj;
+}
+
+static double
+num_to_f(mrb_state *mrb, mrb_value v)
+{
+  if (mrb_fixnum_p(v)) return (double)mrb_fixnum(v);
+  if (mrb_float_p(v)) return (double)mrb_float(v);
+  mrb_raisef(mrb, E_TYPE_ERROR, "expected Numeric, got %S", mrb_obj_value(mrb_obj_class(mrb, v)));
+  return 0;                     /* not reached */
+}
+
+static int64_t
+num_to_i(mrb_state *mrb, mrb_value v)
+{
+  if (mrb_fixnum_p(v)) return (int64_t)mrb_fixnum(v);
+  if (mrb_float_p(v)) {
+    mrb_float f = mrb_float(v);
+
+    if (isinf(f)) {
+      mrb_raise(mrb, E_FLOATDOMAIN_ERROR, f < 0 ? "-Infinity" : "Infinity");
+    }
+    if (isnan(f)) {
+      mrb_raise(mrb, E_FLOATDOMAIN_ERROR, "NaN");
+    }
+    /* -2**63 <= f < 2**63, so that the conversion is defined */
+    if (f < -9223372036854775808.0 || 9223372036854775808.0 <= f) {
+      mrb_raisef(mrb, E_RANGE_ERROR, "float %S out of range of integer", v);
+    }
+    return (int64_t)f;
+  }
+  mrb_raisef(mrb, E_TYPE_ERROR, "expected Numeric, got %S", mrb_obj_value(mrb_obj_class(mrb, v)));
+  return 0;                     /* not reached */
+}
+
+static int32_t
+num_to_i32(mrb_state *mrb, mrb_value v)
+{
+  int64_t n = num_to_i(mrb, v);
+
+  if (n < INT32_MIN || INT32_MAX < n) {
+    mrb_raisef(mrb, E_RANGE_ERROR, "%S out of range of Int32Array", v);
+  }
+  return (int32_t)n;
+}
+
+/* Integer result; falls back to Float when it does not fit in a Fixnum */
+static mrb_value
+int_value(mrb_state *mrb, int64_t n)
+{
+  if (n < MRB_INT_MIN || MRB_INT_MAX < n) {
+    return mrb_float_value(mrb, (mrb_float)n);
+  }
+  return mrb_fixnum_value((mrb_int)n);
+}
+
+static mrb_value
+packed_fetch(mrb_state *mrb, struct packed_array *pa, mrb_int i)
+{
+  switch (pa->kind) {
+  case PACKED_F64:
+    return mrb_float_value(mrb, (mrb_float)F64(pa)[i]);
+  case PACKED_I64:
+    return int_value(mrb, I64(pa)[i]);
+  default:
+    return int_value(mrb, I32(pa)[i]);
+  }
+}
+
+static void
+packed_store(mrb_state *mrb, struct packed_array *pa, mrb_int i, mrb_value v)
+{
+  switch (pa->kind) {
+  case PACKED_F64:
+    F64(pa)[i] = num_to_f(mrb, v);
+    break;
+  case PACKED_I64:
+    I64(pa)[i] = num_to_i(mrb, v);
+    break;
+  default:
+    I32(pa)[i] = num_to_i32(mrb, v);
+    break;
+  }
+}
+
+static mrb_value
+packed_initialize(mrb_state *mrb, mrb_value self, enum packed_kind kind)
+{
+  struct packed_array *pa = (struct packed_array*)DATA_PTR(self);
+  mrb_value arg = mrb_fixnum_value(0);
+  mrb_int i;
+
+  if (pa) {
+    packed_free(mrb, pa);
+  }
+  DATA_TYPE(self) = packed_types[kind];
+  DATA_PTR(self) = NULL;
+
+  mrb_get_args(mrb, "|o", &arg);
+  pa = packed_new(mrb, kind);
+  DATA_PTR(self) = pa;
+  if (mrb_fixnum_p(arg)) {
+    packed_resize(mrb, pa, mrb_fixnum(arg));
+  }
+  else if (mrb_array_p(arg)) {
+    packed_resize(mrb, pa, RARRAY_LEN(arg));
+    for (i = 0; i < pa->len && i < RARRAY_LEN(arg); i++) {
+      packed_store(mrb, pa, i, RARRAY_PTR(arg)[i]);
+    }
+  }
+  else {
+    mrb_raise(mrb, E_TYPE_ERROR, "expected Integer size or Array");
+  }
+  return self;
+}
+
+static mrb_value
+packed_f64_initialize(mrb_state *mrb, mrb_value self)
+{
+  return packed_initialize(mrb, self, PACKED_F64);
+}
+
+static mrb_value
+packed_i64_initialize(mrb_state *mrb, mrb_value self)
+{
+  return packed_initialize(mrb, self, PACKED_I64);
+}
+
+static mrb_value
+packed_i32_initialize(mrb_state *mrb, mrb_value self)
+{
+  return packed_initialize(mrb, self, PACKED_I32);
+}
+
+static mrb_value
+packed_initialize_copy(mrb_state *mrb, mrb_value copy)
+{
+  mrb_value src;
+  struct packed_array *s, *d;
+
+  mrb_get_args(mrb, "o", &src);
+  if (mrb_obj_equal(mrb, copy, src)) return copy;
+  if (!mrb_obj_is_instance_of(mrb, src, mrb_obj_class(mrb, copy))) {
+    mrb_raise(mrb, E_TYPE_ERROR, "wrong argument class");
+  }
+  s = packed_ptr(mrb, src);
+  if (DATA_PTR(copy)) {
+    packed_free(mrb, DATA_PTR(copy));
+  }
+  DATA_TYPE(copy) = packed_types[s->kind];
+  DATA_PTR(copy) = d = packed_new(mrb, s->kind);
+  packed_resize(mrb, d, s->len);
+  memcpy(d->ptr, s->ptr, packed_elem_size[s->kind] * s->len);
+  return copy;
+}
+
+/*
+ *  call-seq:
+ *     Float64Array.from_bytes(str)  -> packed_array
+ *
+ *  Builds an array from the native-endian binary image in +str+,
+ *  as produced by #to_bytes.
+ */
+static mrb_value
+packed_s_from_bytes(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value str, obj;
+  struct packed_array *pa;
+  size_t esize;
+
+  mrb_get_args(mrb, "S", &str);
+  obj = mrb_obj_new(mrb, mrb_class_ptr(klass), 0, NULL);
+  pa = packed_ptr(mrb, obj);
+  esize = packed_elem_size[pa->kind];
+  if (RSTRING_LEN(str) % esize != 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "string size is not a multiple of the element size");
+  }
+  packed_resize(mrb, pa, RSTRING_LEN(str) / esize);
+  memcpy(pa->ptr, RSTRING_PTR(str), RSTRING_LEN(str));
+  return obj;
+}
+
+static mrb_value
+packed_to_bytes(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+
+  return mrb_str_new(mrb, (const char*)pa->ptr, packed_elem_size[pa->kind] * pa->len);
+}
+
+static mrb_value
+packed_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(packed_ptr(mrb, self)->len);
+}
+
+static mrb_value
+packed_aref(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_int i;
+
+  mrb_get_args(mrb, "i", &i);
+  if (i < 0) i += pa->len;
+  if (i < 0 || pa->len <= i) return mrb_nil_value();
+  return packed_fetch(mrb, pa, i);
+}
+
+static mrb_value
+packed_aset(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_int i;
+  mrb_value v;
+
+  mrb_get_args(mrb, "io", &i, &v);
+  if (i < 0) i += pa->len;
+  if (i < 0) {
+    mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array", mrb_fixnum_value(i - pa->len));
+  }
+  if (pa->len <= i) {
+    packed_resize(mrb, pa, i + 1);
+  }
+  packed_store(mrb, pa, i, v);
+  return v;
+}
+
+static mrb_value
+packed_to_a(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_value ary = mrb_ary_new_capa(mrb, pa->len);
+  struct RArray *a = mrb_ary_ptr(ary);
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_int i;
+
+  for (i = 0; i < pa->len; i++) {
+    mrb_value v = packed_fetch(mrb, pa, i);
+
+    ARY_PTR(a)[i] = v;
+    ARY_SET_LEN(a, i + 1);
+    mrb_field_write_barrier_value(mrb, (struct RBasic*)a, v);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return ary;
+}
+
+static mrb_value
+packed_fill(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_value v;
+  mrb_int i;
+
+  mrb_get_args(mrb, "o", &v);
+  switch (pa->kind) {
+  case PACKED_F64: {
+    double *p = F64(pa), x = num_to_f(mrb, v);
+    for (i = 0; i < pa->len; i++) p[i] = x;
+    break;
+  }
+  case PACKED_I64: {
+    int64_t *p = I64(pa), x = num_to_i(mrb, v);
+    for (i = 0; i < pa->len; i++) p[i] = x;
+    break;
+  }
+  default: {
+    int32_t *p = I32(pa), x = num_to_i32(mrb, v);
+    for (i = 0; i < pa->len; i++) p[i] = x;
+    break;
+  }
+  }
+  return self;
+}
+
+static mrb_value
+packed_sum(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_int i, n = pa->len;
+
+  switch (pa->kind) {
+  case PACKED_F64: {
+    /* four independent partial sums so the loop can be vectorized */
+    const double *p = F64(pa);
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+      s0 += p[i]; s1 += p[i+1]; s2 += p[i+2]; s3 += p[i+3];
+    }
+    for (; i < n; i++) s0 += p[i];
+    return mrb_float_value(mrb, (mrb_float)((s0 + s1) + (s2 + s3)));
+  }
+  case PACKED_I64: {
+    const int64_t *p = I64(pa);
+    int64_t s = 0;
+    double f;
+
+    for (i = 0; i < n; i++) {
+      if (p[i] > 0 ? s > INT64_MAX - p[i] : s < INT64_MIN - p[i]) break;
+      s += p[i];
+    }
+    if (i == n) return int_value(mrb, s);
+    /* the sum does not fit in 64 bits; go on in Float, as int_value() does */
+    for (f = (double)s; i < n; i++) f += (double)p[i];
+    return mrb_float_value(mrb, (mrb_float)f);
+  }
+  default: {
+    const int32_t *p = I32(pa);
+    int64_t s = 0;
+
+    for (i = 0; i < n; i++) s += p[i];
+    return int_value(mrb, s);
+  }
+  }
+}
+
+static mrb_value
+packed_minmax(mrb_state *mrb, mrb_value self, int max)
+{
+  struct packed_array *pa = packed_ptr(mrb, self);
+  mrb_int i, n = pa->len, at = 0;
+
+  if (n == 0) return mrb_nil_value();
+  switch (pa->kind) {
+  case PACKED_F64: {
+    const double *p = F64(pa);
+    double m = p[0];
+
+    for (i = 1; i < n; i++) {
+      if (max ? p[i] > m : p[i] < m) m = p[i];
+    }
+    return mrb_float_value(mrb, (mrb_float)m);
+  }
+  case PACKED_I64: {
+    const int64_t *p = I64(pa);
+
+    for (i = 1; i < n; i++) {
+      if (max ? p[i] > p[at] : p[i] < p[at]) at = i;
+    }
+    break;
+  }
+  default: {
+    const int32_t *p = I32(pa);
+
+    for (i = 1; i < n; i++) {
+      if (max ? p[i] > p[at] : p[i] < p[at]) at = i;
+    }
+    break;
+  }
+  }
+  return packed_fetch(mrb, pa, at);
+}
+
+static mrb_value
+packed_min(mrb_state *mrb, mrb_value self)
+{
+  return packed_minmax(mrb, self, FALSE);
+}
+
+static mrb_value
+packed_max(mrb_state *mrb, mrb_value self)
+{
+  return packed_minmax(mrb, self, TRUE);
+}
+
+static struct packed_array*
+packed_operand(mrb_state *mrb, struct packed_array *pa, mrb_value other)
+{
+  struct packed_array *pb = packed_ptr(mrb, other);
+
+  if (pb->kind != pa->kind) {
+    mrb_raise(mrb, E_TYPE_ERROR, "packed array element type mismatch");
+  }
+  if (pb->len != pa->len) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "packed array size mismatch");
+  }
+  return pb;
+}
+
+static mrb_value
+packed_dot(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self), *pb;
+  mrb_value other;
+  mrb_int i, n = pa->len;
+
+  mrb_get_args(mrb, "o", &other);
+  pb = packed_operand(mrb, pa, other);
+  switch (pa->kind) {
+  case PACKED_F64: {
+    const double *a = F64(pa), *b = F64(pb);
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+      s0 += a[i] * b[i]; s1 += a[i+1] * b[i+1];
+      s2 += a[i+2] * b[i+2]; s3 += a[i+3] * b[i+3];
+    }
+    for (; i < n; i++) s0 += a[i] * b[i];
+    return mrb_float_value(mrb, (mrb_float)((s0 + s1) + (s2 + s3)));
+  }
+  case PACKED_I64: {
+    const int64_t *a = I64(pa), *b = I64(pb);
+    uint64_t s = 0;
+
+    for (i = 0; i < n; i++) s += (uint64_t)a[i] * (uint64_t)b[i];
+    return int_value(mrb, (int64_t)s);
+  }
+  default: {
+    const int32_t *a = I32(pa), *b = I32(pb);
+    uint64_t s = 0;
+
+    for (i = 0; i < n; i++) s += (uint64_t)((int64_t)a[i] * b[i]);
+    return int_value(mrb, (int64_t)s);
+  }
+  }
+}
+
+/* floor division, as Integer#div; -1 is special-cased to avoid MIN / -1 */
+static int64_t
+int_div(int64_t x, int64_t y)
+{
+  int64_t q;
+
+  if (y == -1) return (int64_t)(0 - (uint64_t)x);
+  q = x / y;
+  if (x % y != 0 && ((x < 0) != (y < 0))) q--;
+  return q;
+}
+
+#define PACKED_LOOP(expr) for (i = 0; i < n; i++) { expr; }
+
+/* elementwise d = a op (b or scalar k); integer arithmetic wraps around */
+#define PACKED_APPLY_INT(T, U) do {\
+  T *dp = (T*)d->ptr, *ap = (T*)a->ptr, *bp = b ? (T*)b->ptr : NULL;\
+  T k = b ? 0 : (T)num_to_i(mrb, s);\
+  switch (op) {\
+  case '+':\
+    if (bp) PACKED_LOOP(dp[i] = (T)((U)ap[i] + (U)bp[i]))\
+    else PACKED_LOOP(dp[i] = (T)((U)ap[i] + (U)k))\
+    break;\
+  case '-':\
+    if (bp) PACKED_LOOP(dp[i] = (T)((U)ap[i] - (U)bp[i]))\
+    else PACKED_LOOP(dp[i] = (T)((U)ap[i] - (U)k))\
+    break;\
+  case '*':\
+    if (bp) PACKED_LOOP(dp[i] = (T)((U)ap[i] * (U)bp[i]))\
+    else PACKED_LOOP(dp[i] = (T)((U)ap[i] * (U)k))\
+    break;\
+  default:\
+    if (bp) {\
+      PACKED_LOOP(if (bp[i] == 0) goto zerodiv)\
+      PACKED_LOOP(dp[i] = (T)int_div(ap[i], bp[i]))\
+    }\
+    else {\
+      if (k == 0) goto zerodiv;\
+      PACKED_LOOP(dp[i] = (T)int_div(ap[i], k))\
+    }\
+    break;\
+  }\
+} while (0)
+
+static void
+packed_apply(mrb_state *mrb, struct packed_array *d, struct packed_array *a,
+             struct packed_array *b, mrb_value s, int op)
+{
+  mrb_int i, n = d->len;
+
+  switch (d->kind) {
+  case PACKED_F64: {
+    double *dp = F64(d), *ap = F64(a), *bp = b ? F64(b) : NULL;
+    double k = b ? 0 : num_to_f(mrb, s);
+
+    switch (op) {
+    case '+':
+      if (bp) PACKED_LOOP(dp[i] = ap[i] + bp[i])
+      else PACKED_LOOP(dp[i] = ap[i] + k)
+      break;
+    case '-':
+      if (bp) PACKED_LOOP(dp[i] = ap[i] - bp[i])
+      else PACKED_LOOP(dp[i] = ap[i] - k)
+      break;
+    case '*':
+      if (bp) PACKED_LOOP(dp[i] = ap[i] * bp[i])
+      else PACKED_LOOP(dp[i] = ap[i] * k)
+      break;
+    default:
+      if (bp) PACKED_LOOP(dp[i] = ap[i] / bp[i])
+      else PACKED_LOOP(dp[i] = ap[i] / k)
+      break;
+    }
+    return;
+  }
+  case PACKED_I64:
+    PACKED_APPLY_INT(int64_t, uint64_t);
+    return;
+  default:
+    PACKED_APPLY_INT(int32_t, uint32_t);
+    return;
+  }
+ zerodiv:
+  mrb_raise(mrb, E_ARGUMENT_ERROR, "divided by 0");
+}
+
+static int
+packed_op_char(mrb_state *mrb, mrb_sym op)
+{
+  const char *name = mrb_sym2name(mrb, op);
+
+  if (name[0] && !name[1] && strchr("+-*/", name[0])) {
+    return name[0];
+  }
+  mrb_raisef(mrb, E_ARGUMENT_ERROR, "unsupported operation %S", mrb_symbol_value(op));
+  return 0;                     /* not reached */
+}
+
+static mrb_value
+packed_binop(mrb_state *mrb, mrb_value self, int op)
+{
+  struct packed_array *pa = packed_ptr(mrb, self), *pb = NULL;
+  mrb_value other, result;
+
+  mrb_get_args(mrb, "o", &other);
+  if (!mrb_fixnum_p(other) && !mrb_float_p(other)) {
+    pb = packed_operand(mrb, pa, other);
+  }
+  result = packed_dup_empty(mrb, self, pa);
+  packed_apply(mrb, (struct packed_array*)DATA_PTR(result), pa, pb, other, op);
+  return result;
+}
+
+static mrb_value
+packed_plus(mrb_state *mrb, mrb_value self)
+{
+  return packed_binop(mrb, self, '+');
+}
+
+static mrb_value
+packed_minus(mrb_state *mrb, mrb_value self)
+{
+  return packed_binop(mrb, self, '-');
+}
+
+static mrb_value
+packed_times(mrb_state *mrb, mrb_value self)
+{
+  return packed_binop(mrb, self, '*');
+}
+
+static mrb_value
+packed_div(mrb_state *mrb, mrb_value self)
+{
+  return packed_binop(mrb, self, '/');
+}
+
+/*
+ *  call-seq:
+ *     ary.__map_op!(op, x)   -> ary
+ *
+ *  Applies <code>elem = elem op x</code> in place, where +op+ is one
+ *  of <code>:+ :- :* :/</code> and +x+ a number or a packed array of
+ *  the same type and size.  Used by #map! and #scale!.
+ */
+static mrb_value
+packed_map_op_bang(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self), *pb = NULL;
+  mrb_sym op;
+  mrb_value x;
+
+  mrb_get_args(mrb, "no", &op, &x);
+  if (!mrb_fixnum_p(x) && !mrb_float_p(x)) {
+    pb = packed_operand(mrb, pa, x);
+  }
+  packed_apply(mrb, pa, pa, pb, x, packed_op_char(mrb, op));
+  return self;
+}
+
+static mrb_value
+packed_eq(mrb_state *mrb, mrb_value self)
+{
+  struct packed_array *pa = packed_ptr(mrb, self), *pb;
+  mrb_value other;
+  mrb_int i;
+
+  mrb_get_args(mrb, "o", &other);
+  if (mrb_obj_equal(mrb, self, other)) return mrb_true_value();
+  if (mrb_type(other) != MRB_TT_DATA || DATA_TYPE(other) != DATA_TYPE(self)) {
+    return mrb_false_value();
+  }
+  pb = packed_ptr(mrb, other);
+  if (pa->len != pb->len) return mrb_false_value();
+  for (i = 0; i < pa->len; i++) {
+    switch (pa->kind) {
+    case PACKED_F64:
+      if (F64(pa)[i] != F64(pb)[i]) return mrb_false_value();
+      break;
+    case PACKED_I64:
+      if (I64(pa)[i] != I64(pb)[i]) return mrb_false_value();
+      break;
+    default:
+      if (I32(pa)[i] != I32(pb)[i]) return mrb_false_value();
+      break;
+    }
+  }
+  return mrb_true_value();
+}
+
+static void
+packed_define(mrb_state *mrb, const char *name, mrb_func_t init)
+{
+  struct RClass *c;
+
+  c = mrb_define_class(mrb, name, mrb->object_class);
+  MRB_SET_INSTANCE_TT(c, MRB_TT_DATA);
+  mrb_include_module(mrb, c, mrb_module_get(mrb, "Enumerable"));
+
+  mrb_define_class_method(mrb, c, "from_bytes", packed_s_from_bytes, MRB_ARGS_REQ(1));
+
+  mrb_define_method(mrb, c, "initialize",      init,                   MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, c, "initialize_copy", packed_initialize_copy, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "size",            packed_size,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "length",          packed_size,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "[]",              packed_aref,            MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "[]=",             packed_aset,            MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, c, "to_a",            packed_to_a,            MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "to_bytes",        packed_to_bytes,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "fill",            packed_fill,            MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "sum",             packed_sum,             MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "min",             packed_min,             MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "max",             packed_max,             MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "dot",             packed_dot,             MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "+",               packed_plus,            MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "-",               packed_minus,           MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "*",               packed_times,           MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "/",               packed_div,             MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "==",              packed_eq,              MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "__map_op!",       packed_map_op_bang,     MRB_ARGS_REQ(2));
+}
+
+void
+mrb_mruby_packed_array_gem_init(mrb_state* mrb)
+{
+  packed_define(mrb, "Float64Array", packed_f64_initialize);
+  packed_define(mrb, "Int64Array", packed_i64_initialize);
+  packed_define(mrb, "Int32Array", packed_i32_initialize);
+}
+
+void
+mrb_mruby_packed_array_gem_final(mrb_state* mrb)
+{
+}
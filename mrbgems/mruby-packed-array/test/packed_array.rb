@@ -0,0 +1,112 @@
+##
+# Float64Array, Int64Array, Int32Array Test
+
+assert('Float64Array.new') do
+  a = Float64Array.new(3)
+  assert_equal 3, a.size
+  assert_equal [0.0, 0.0, 0.0], a.to_a
+  assert_equal [1.0, 2.5], Float64Array.new([1, 2.5]).to_a
+  assert_equal 0, Int32Array.new.size
+  assert_raise(ArgumentError) { Int32Array.new(-1) }
+  assert_raise(TypeError) { Int32Array.new([1, "a"]) }
+end
+
+assert('Float64Array#[] and #[]=') do
+  a = Int32Array.new([1, 2, 3])
+  assert_equal 3, a[-1]
+  assert_nil a[3]
+  a[4] = 7.9
+  assert_equal [1, 2, 3, 0, 7], a.to_a
+  assert_raise(IndexError) { a[-6] = 1 }
+  b = Int64Array.new(1)
+  b[0] = -2.0 ** 63
+  assert_equal(-2.0 ** 63, b[0])
+  assert_raise(RangeError) { b[0] = 2.0 ** 63 }
+  assert_raise(FloatDomainError) { b[0] = 1.0 / 0 }
+  assert_raise(FloatDomainError) { b.fill(0.0 / 0) }
+  assert_raise(FloatDomainError) { Int32Array.new([-1.0 / 0]) }
+  c = Int32Array.new(1)
+  c[0] = -2 ** 31
+  assert_equal(-2 ** 31, c[0])
+  assert_raise(RangeError) { c[0] = 2 ** 40 + 5 }
+  assert_raise(RangeError) { c[0] = 2 ** 31 }
+  assert_raise(RangeError) { c.fill(-2 ** 31 - 1) }
+  assert_raise(RangeError) { Int32Array.new([2.0 ** 31]) }
+  assert_equal(-2 ** 31, c[0])
+end
+
+assert('Float64Array#to_a') do
+  a = Int32Array.new(100)
+  100.times { |i| a[i] = i * i }
+  ary = a.to_a
+  assert_equal 100, ary.size
+  assert_equal 9801, ary[99]
+  assert_equal [0.5] * 70, Float64Array.new([0.5] * 70).to_a
+end
+
+assert('Float64Array#sum, #min, #max, #dot') do
+  a = Float64Array.new([1.5, -2, 3, 4, 0.5])
+  assert_equal 7.0, a.sum
+  assert_equal(-2.0, a.min)
+  assert_equal 4.0, a.max
+  assert_equal 31.5, a.dot(a)
+  b = Int64Array.new([3, -1, 2])
+  assert_equal 4, b.sum
+  assert_equal(-1, b.min)
+  assert_equal 14, b.dot(b)
+  assert_equal 2.0 ** 63, Int64Array.new([2 ** 62, 2 ** 62]).sum
+  assert_equal(-2.0 ** 64, Int64Array.new([-2 ** 63, -2 ** 63, 1]).sum)
+  assert_equal 2 ** 31, Int32Array.new([2 ** 31 - 1, 1]).sum
+  assert_nil Int32Array.new.max
+  assert_raise(ArgumentError) { a.dot(Float64Array.new(1)) }
+  assert_raise(TypeError) { a.dot(b) }
+end
+
+assert('Float64Array elementwise operations') do
+  a = Float64Array.new([1, 2, 3])
+  b = Float64Array.new([4, 5, 6])
+  assert_equal [5.0, 7.0, 9.0], (a + b).to_a
+  assert_equal [-3.0, -3.0, -3.0], (a - b).to_a
+  assert_equal [4.0, 10.0, 18.0], (a * b).to_a
+  assert_equal [0.5, 1.0, 1.5], (a / 2).to_a
+  assert_equal [1.0, 2.0, 3.0], a.to_a
+  assert_equal Float64Array, (a + 1).class
+
+  i = Int32Array.new([7, -7, 2147483647])
+  assert_equal [3, -4, 1073741823], (i / 2).to_a
+  assert_equal [8, -6, -2147483647 - 1], (i + 1).to_a
+  assert_raise(ArgumentError) { i / 0 }
+  assert_raise(ArgumentError) { i / Int32Array.new([1, 0, 1]) }
+end
+
+assert('Float64Array#map! and #scale!') do
+  a = Float64Array.new([1, 2, 3])
+  assert_equal a, a.map!(:+, 1)
+  assert_equal [2.0, 3.0, 4.0], a.to_a
+  a.scale!(0.5)
+  assert_equal [1.0, 1.5, 2.0], a.to_a
+  a.map! { |x| x * x }
+  assert_equal [1.0, 2.25, 4.0], a.to_a
+  assert_raise(ArgumentError) { a.map!(:%, 2) }
+end
+
+assert('Float64Array#to_bytes and .from_bytes') do
+  a = Int32Array.new([1, -2, 3])
+  s = a.to_bytes
+  assert_equal 12, s.size
+  assert_equal a, Int32Array.from_bytes(s)
+  assert_false a == Int64Array.new([1, -2, 3])
+  assert_raise(ArgumentError) { Float64Array.from_bytes("abc") }
+  f = Float64Array.new([0.25, 1e300])
+  assert_equal f.to_a, Float64Array.from_bytes(f.to_bytes).to_a
+end
+
+assert('Float64Array is Enumerable') do
+  a = Int64Array.new([3, 1, 2])
+  assert_equal [1, 2, 3], a.sort
+  assert_equal [6, 2, 4], a.map { |x| x * 2 }
+  b = a.dup
+  b[0] = 9
+  assert_equal 3, a[0]
+  assert_equal "Int64Array[3, 1, 2]", a.inspect
+end
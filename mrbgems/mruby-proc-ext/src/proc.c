@@ -149,9 +149,10 @@ mrb_proc_parameters(mrb_state *mrb, mrb_value self)
   };
   const struct RProc *proc = mrb_proc_ptr(self);
   const struct mrb_irep *irep = proc->body.irep;
+  mrb_insn c;
   mrb_aspec aspec;
   mrb_value parameters;
-  int i, j;
+  int i, j, len;
 
   if (MRB_PROC_CFUNC_P(proc)) {
     // TODO cfunc aspec is not implemented yet
@@ -160,7 +161,8 @@ mrb_proc_parameters(mrb_state *mrb, mrb_value self)
   if (!irep->lv) {
     return mrb_ary_new(mrb);
   }
-  if (GET_OPCODE(*irep->iseq) != OP_ENTER) {
+  c = mrb_iseq_fetch(irep->iseq, &len);
+  if (GET_OPCODE(c) != OP_ENTER) {
     return mrb_ary_new(mrb);
   }
 
@@ -169,7 +171,7 @@ mrb_proc_parameters(mrb_state *mrb, mrb_value self)
     parameters_list[3].name = "opt";
   }
 
-  aspec = GETARG_Ax(*irep->iseq);
+  aspec = GETARG_Ax(c);
   parameters_list[0].size = MRB_ASPEC_REQ(aspec);
   parameters_list[1].size = MRB_ASPEC_OPT(aspec);
   parameters_list[2].size = MRB_ASPEC_REST(aspec);
@@ -1,6 +1,9 @@
 #include "mruby.h"
 #include "mruby/proc.h"
 #include "mruby/class.h"
+#include "mruby/compile.h"
+#include "mruby/irep.h"
+#include "mruby/string.h"
 
 static mrb_value
 return_func_name(mrb_state *mrb, mrb_value self)
@@ -45,6 +48,28 @@ cfunc_without_env(mrb_state *mrb, mrb_value self)
   return mrb_cfunc_env_get(mrb, 0);
 }
 
+static mrb_value
+literal_shared_p(mrb_state *mrb, mrb_value self)
+{
+  struct mrb_parser_state *p;
+  struct RProc *proc;
+  mrb_irep *irep;
+  mrb_value a, b;
+
+  p = mrb_parse_string(mrb, "lambda { 'a literal too long to be embedded' }\n"
+                            "lambda { 'a literal too long to be embedded' }\n", NULL);
+  proc = mrb_generate_code(mrb, p);
+  mrb_parser_free(p);
+  if (!proc) return mrb_nil_value();
+  irep = proc->body.irep;
+  if (irep->rlen != 2 || irep->reps[0]->plen != 1 || irep->reps[1]->plen != 1) {
+    return mrb_nil_value();
+  }
+  a = irep->reps[0]->pool[0];
+  b = irep->reps[1]->pool[0];
+  return mrb_bool_value(RSTRING_PTR(a) == RSTRING_PTR(b));
+}
+
 void mrb_mruby_proc_ext_gem_test(mrb_state *mrb)
 {
   struct RClass *cls;
@@ -53,4 +78,5 @@ void mrb_mruby_proc_ext_gem_test(mrb_state *mrb)
   mrb_define_module_function(mrb, cls, "mrb_proc_new_cfunc_with_env", proc_new_cfunc_with_env, MRB_ARGS_REQ(1));
   mrb_define_module_function(mrb, cls, "mrb_cfunc_env_get", cfunc_env_get, MRB_ARGS_REQ(2));
   mrb_define_module_function(mrb, cls, "cfunc_without_env", cfunc_without_env, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, cls, "literal_shared?", literal_shared_p, MRB_ARGS_NONE());
 }
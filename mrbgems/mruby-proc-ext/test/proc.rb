@@ -86,3 +86,7 @@ assert('mrb_cfunc_env_get') do
 
   assert_equal 1, t.get_int(1)
 end
+
+assert('string literals share one buffer across procs') do
+  assert_true ProcExtTest.literal_shared?
+end
@@ -15,8 +15,17 @@
 
 static char const MT_STATE_KEY[] = "$mrb_i_mt_state";
 
+static void*
+mt_state_copy(mrb_state *mrb, const void *p)
+{
+  mt_state *t = (mt_state *)mrb_malloc(mrb, sizeof(mt_state));
+
+  *t = *(const mt_state *)p;
+  return t;
+}
+
 static const struct mrb_data_type mt_state_type = {
-  MT_STATE_KEY, mrb_free,
+  MT_STATE_KEY, mrb_free, mt_state_copy,
 };
 
 static mrb_value mrb_random_rand(mrb_state *mrb, mrb_value self);
@@ -307,8 +316,7 @@ mrb_ary_sample(mrb_state *mrb, mrb_value ary)
         }
         break;
       }
-      RARRAY_PTR(result)[i] = mrb_fixnum_value(r);
-      RARRAY_LEN(result)++;
+      mrb_ary_push(mrb, result, mrb_fixnum_value(r));
     }
     for (i=0; i<n; i++) {
       RARRAY_PTR(result)[i] = RARRAY_PTR(ary)[mrb_fixnum(RARRAY_PTR(result)[i])];
@@ -91,6 +91,14 @@ assert('String#concat') do
   t << "World!"
   assert_equal "Hello World!", t
   assert_equal "Hello World!", s
+
+  u = "ab"
+  8.times { u << u }
+  assert_equal "ab" * 256, u
+  v = ""
+  1000.times { v << "xyz" }
+  assert_equal 3000, v.size
+  assert_equal "xyz" * 1000, v
 end
 
 assert('String#casecmp') do
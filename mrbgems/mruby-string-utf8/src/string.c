@@ -1,6 +1,8 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/proc.h"
 #include "mruby/string.h"
 #include "mruby/range.h"
 #include "mruby/re.h"
@@ -84,27 +86,188 @@ utf8len(unsigned char* p)
   return len;
 }
 
+/*
+ * Character offsets in a non-ASCII string are found by walking it from
+ * the start.  To keep sequential indexing (s[0], s[1], ...) linear, each
+ * mrb_state remembers, for the last few strings looked up, the last
+ * character position and where it starts, and the character length
+ * once known.  An entry belongs to the string only while it carries
+ * MRB_STR_INDEXED, which mrb_str_modify() clears.  The set hangs off
+ * the env of the methods below.
+ */
+#define UTF8_INDEX_SIZE 4
+
+struct utf8_index {
+  struct RString *str;
+  mrb_int cpos;                 /* character index of the last lookup */
+  mrb_int bpos;                 /* byte offset of that character */
+  mrb_int clen;                 /* character length, -1 if not known yet */
+};
+
+struct utf8_index_set {
+  struct utf8_index ent[UTF8_INDEX_SIZE];
+  int next;                     /* entry to replace on a miss */
+};
+
+static struct utf8_index_set*
+utf8_index_set_new(mrb_state *mrb)
+{
+  struct utf8_index_set *set = (struct utf8_index_set*)mrb_malloc(mrb, sizeof(struct utf8_index_set));
+
+  memset(set, 0, sizeof(struct utf8_index_set));
+  return set;
+}
+
+/* a copy starts empty: the cached strings belong to the original state */
+static void*
+utf8_index_copy(mrb_state *mrb, const void *p)
+{
+  return utf8_index_set_new(mrb);
+}
+
+static const struct mrb_data_type utf8_index_type = {
+  "utf8_index", mrb_free, utf8_index_copy,
+};
+
+static struct utf8_index*
+utf8_index_get(mrb_state *mrb, struct RString *s)
+{
+  struct utf8_index_set *set = (struct utf8_index_set*)DATA_PTR(mrb_cfunc_env_get(mrb, 0));
+  struct utf8_index *ix;
+  int i;
+
+  for (i = 0; i < UTF8_INDEX_SIZE; i++) {
+    if (set->ent[i].str == s) break;
+  }
+  if (i < UTF8_INDEX_SIZE) {
+    ix = &set->ent[i];
+    if (RSTR_INDEXED_P(s)) return ix;
+  }
+  else {
+    /* the evicted string may still carry the flag; it gets a fresh
+       entry when it is looked up again */
+    ix = &set->ent[set->next];
+    set->next = (set->next + 1) % UTF8_INDEX_SIZE;
+    ix->str = s;
+  }
+  ix->cpos = 0;
+  ix->bpos = 0;
+  ix->clen = -1;
+  RSTR_SET_INDEXED_FLAG(s);
+  return ix;
+}
+
+/* high bit of every byte in a word */
+#define ASCII_WORD_MASK (~(uintptr_t)0 / 0xff * 0x80)
+
+/* length of the leading run of ASCII bytes, examined a word at a time */
+static size_t
+ascii_span(const unsigned char *p, const unsigned char *e)
+{
+  const unsigned char *s = p;
+  uintptr_t w;
+
+  while ((size_t)(e - p) >= sizeof(uintptr_t)) {
+    memcpy(&w, p, sizeof(uintptr_t));
+    if (w & ASCII_WORD_MASK) break;
+    p += sizeof(uintptr_t);
+  }
+  while (p < e && *p < 0x80) {
+    p++;
+  }
+  return p - s;
+}
+
+static mrb_bool
+str_ascii_p(struct RString *s)
+{
+  const unsigned char *p = (const unsigned char*)RSTR_PTR(s);
+
+  if (RSTR_ASCII_P(s)) return TRUE;
+  if (ascii_span(p, p + RSTR_LEN(s)) < (size_t)RSTR_LEN(s)) return FALSE;
+  RSTR_SET_ASCII_FLAG(s);
+  return TRUE;
+}
+
 static mrb_int
-mrb_utf8_strlen(mrb_value str, mrb_int len)
+utf8_count(const unsigned char *p, const unsigned char *e)
 {
   mrb_int total = 0;
-  unsigned char* p = (unsigned char*) RSTRING_PTR(str);
-  unsigned char* e = p;
-  e += len < 0 ? RSTRING_LEN(str) : len;
+  size_t n;
+
   while (p<e) {
-    p += utf8len(p);
-    total++;
+    n = ascii_span(p, e);
+    p += n;
+    total += n;
+    if (p<e) {
+      p += utf8len((unsigned char*)p);
+      total++;
+    }
   }
   return total;
 }
 
+static mrb_int
+mrb_utf8_strlen(mrb_state *mrb, mrb_value str, mrb_int len)
+{
+  unsigned char* p = (unsigned char*) RSTRING_PTR(str);
+  struct utf8_index *ix;
+
+  if (str_ascii_p(mrb_str_ptr(str))) {
+    return len < 0 ? RSTRING_LEN(str) : len;
+  }
+  if (len >= 0) {
+    return utf8_count(p, p + len);
+  }
+  ix = utf8_index_get(mrb, mrb_str_ptr(str));
+  if (ix->clen < 0) {
+    ix->clen = ix->cpos + utf8_count(p + ix->bpos, (unsigned char*)RSTRING_END(str));
+  }
+  return ix->clen;
+}
+
+/* byte offset of the idx-th character, or the byte length if beyond */
+static mrb_int
+str_char2byte(mrb_state *mrb, mrb_value str, mrb_int idx)
+{
+  struct RString *s = mrb_str_ptr(str);
+  struct utf8_index *ix;
+  unsigned char *b, *p, *e;
+  mrb_int i;
+
+  if (str_ascii_p(s)) {
+    return idx < RSTR_LEN(s) ? idx : RSTR_LEN(s);
+  }
+  ix = utf8_index_get(mrb, s);
+  b = (unsigned char*)RSTR_PTR(s);
+  e = b + RSTR_LEN(s);
+  if (ix->cpos <= idx) {
+    i = ix->cpos;
+    p = b + ix->bpos;
+  }
+  else {
+    i = 0;
+    p = b;
+  }
+  for (; i < idx && p < e; i++) {
+    p += utf8len(p);
+  }
+  if (p >= e) {
+    p = e;
+    ix->clen = i;
+  }
+  ix->cpos = i;
+  ix->bpos = p - b;
+  return p - b;
+}
+
 static mrb_value
 mrb_str_size(mrb_state *mrb, mrb_value str)
 {
-  return mrb_fixnum_value(mrb_utf8_strlen(str, -1));
+  return mrb_fixnum_value(mrb_utf8_strlen(mrb, str, -1));
 }
 
-#define RSTRING_LEN_UTF8(s) mrb_utf8_strlen(s, -1)
+#define RSTRING_LEN_UTF8(mrb, s) mrb_utf8_strlen(mrb, s, -1)
 
 static mrb_value
 noregexp(mrb_state *mrb, mrb_value self)
@@ -121,61 +284,23 @@ regexp_check(mrb_state *mrb, mrb_value obj)
   }
 }
 
-static inline mrb_int
-mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mrb_int n)
-{
-  const unsigned char *x = xs, *xe = xs + m;
-  const unsigned char *y = ys;
-  int i, qstable[256];
-
-  /* Preprocessing */
-  for (i = 0; i < 256; ++i)
-    qstable[i] = m + 1;
-  for (; x < xe; ++x)
-    qstable[*x] = xe - x;
-  /* Searching */
-  for (; y + m <= ys + n; y += *(qstable + y[m])) {
-    if (*xs == *y && memcmp(xs, y, m) == 0)
-      return y - ys;
-  }
-  return -1;
-}
-static mrb_int
-mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
-{
-  const unsigned char *x = (const unsigned char *)x0, *y = (const unsigned char *)y0;
-
-  if (m > n) return -1;
-  else if (m == n) {
-    return memcmp(x0, y0, m) == 0 ? 0 : -1;
-  }
-  else if (m < 1) {
-    return 0;
-  }
-  else if (m == 1) {
-    const unsigned char *ys = y, *ye = ys + n;
-    for (; y < ye; ++y) {
-      if (*x == *y)
-        return y - ys;
-    }
-    return -1;
-  }
-  return mrb_memsearch_qs((const unsigned char *)x0, m, (const unsigned char *)y0, n);
-}
-
 static mrb_value
 str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
 {
   mrb_int i;
-  unsigned char *p = (unsigned char*) RSTRING_PTR(str), *t;
-  unsigned char *e = p + RSTRING_LEN(str);
+  unsigned char *p, *t, *e;
 
-  for (i = 0; i < beg && p<e; i++) {
-    p += utf8len(p);
+  p = (unsigned char*)RSTRING_PTR(str) + str_char2byte(mrb, str, beg);
+  e = (unsigned char*)RSTRING_END(str);
+  if (RSTR_ASCII_P(mrb_str_ptr(str))) {
+    t = (e - p < len) ? e : p + len;
   }
-  t = p;
-  for (i = 0; i < len && t<e; i++) {
-    t += utf8len(t);
+  else {
+    t = p;
+    for (i = 0; i < len && t<e; i++) {
+      t += utf8len(t);
+    }
+    if (t > e) t = e;
   }
   return mrb_str_new(mrb, (const char*)p, (size_t)(t - p));
 }
@@ -184,7 +309,7 @@ static mrb_value
 str_substr(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
 {
   mrb_value str2;
-  mrb_int len8 = RSTRING_LEN_UTF8(str);
+  mrb_int len8 = RSTRING_LEN_UTF8(mrb, str);
 
   if (len < 0) return mrb_nil_value();
   if (len8 == 0) {
@@ -253,7 +378,7 @@ str_rindex(mrb_state *mrb, mrb_value str, mrb_value sub, mrb_int pos)
   t = RSTRING_PTR(sub);
   if (len) {
     while (sbeg <= s) {
-      if (memcmp(s, t, len) == 0) {
+      if (*s == *t && memcmp(s, t, len) == 0) {
         return s - RSTR_PTR(ps);
       }
       s--;
@@ -291,7 +416,7 @@ num_index:
         mrb_int beg, len;
         mrb_value tmp;
 
-        len = RSTRING_LEN_UTF8(str);
+        len = RSTRING_LEN_UTF8(mrb, str);
         if (mrb_range_beg_len(mrb, indx, &beg, &len, len)) {
           tmp = str_subseq(mrb, str, beg, len);
           return tmp;
@@ -375,13 +500,13 @@ mrb_str_index_m(mrb_state *mrb, mrb_value str)
   }
 
   if (pos == -1) return mrb_nil_value();
-  return mrb_fixnum_value(mrb_utf8_strlen(str, pos));
+  return mrb_fixnum_value(mrb_utf8_strlen(mrb, str, pos));
 }
 
 static mrb_value
 mrb_str_reverse_bang(mrb_state *mrb, mrb_value str)
 {
-  mrb_int utf8_len = mrb_utf8_strlen(str, -1);
+  mrb_int utf8_len = mrb_utf8_strlen(mrb, str, -1);
   if (utf8_len > 1) {
     mrb_int len;
     char *buf;
@@ -461,7 +586,7 @@ mrb_str_rindex_m(mrb_state *mrb, mrb_value str)
   }
 
   if (pos == -1) return mrb_nil_value();
-  return mrb_fixnum_value(mrb_utf8_strlen(str, pos));
+  return mrb_fixnum_value(mrb_utf8_strlen(mrb, str, pos));
 }
 
 static mrb_value
@@ -713,25 +838,38 @@ mrb_str_codepoints(mrb_state *mrb, mrb_value self)
   return result;
 }
 
+/* String methods get the index set as their env */
+static void
+utf8_define_method(mrb_state *mrb, mrb_value set, const char *name, mrb_func_t func)
+{
+  int ai = mrb_gc_arena_save(mrb);
+  struct RProc *p = mrb_proc_new_cfunc_with_env(mrb, func, 1, &set);
+
+  mrb_define_method_raw(mrb, mrb->string_class, mrb_intern_cstr(mrb, name), p);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
 void
 mrb_mruby_string_utf8_gem_init(mrb_state* mrb)
 {
   struct RClass * s = mrb->string_class;
-
-  mrb_define_method(mrb, s, "size", mrb_str_size, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "length", mrb_str_size, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "index", mrb_str_index_m, MRB_ARGS_ANY());
-  mrb_define_method(mrb, s, "[]", mrb_str_aref_m, MRB_ARGS_ANY());
-  mrb_define_method(mrb, s, "ord", mrb_str_ord, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "slice", mrb_str_aref_m, MRB_ARGS_ANY());
-  mrb_define_method(mrb, s, "split", mrb_str_split_m, MRB_ARGS_ANY());
-  mrb_define_method(mrb, s, "reverse",  mrb_str_reverse, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "reverse!", mrb_str_reverse_bang, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "rindex", mrb_str_rindex_m, MRB_ARGS_ANY());
-  mrb_define_method(mrb, s, "chr", mrb_str_chr, MRB_ARGS_NONE());
-  mrb_define_method(mrb, s, "chars", mrb_str_chars, MRB_ARGS_NONE());
+  mrb_value set;
+
+  set = mrb_obj_value(Data_Wrap_Struct(mrb, mrb->object_class, &utf8_index_type, utf8_index_set_new(mrb)));
+  utf8_define_method(mrb, set, "size", mrb_str_size);
+  utf8_define_method(mrb, set, "length", mrb_str_size);
+  utf8_define_method(mrb, set, "index", mrb_str_index_m);
+  utf8_define_method(mrb, set, "[]", mrb_str_aref_m);
+  utf8_define_method(mrb, set, "ord", mrb_str_ord);
+  utf8_define_method(mrb, set, "slice", mrb_str_aref_m);
+  utf8_define_method(mrb, set, "split", mrb_str_split_m);
+  utf8_define_method(mrb, set, "reverse",  mrb_str_reverse);
+  utf8_define_method(mrb, set, "reverse!", mrb_str_reverse_bang);
+  utf8_define_method(mrb, set, "rindex", mrb_str_rindex_m);
+  utf8_define_method(mrb, set, "chr", mrb_str_chr);
+  utf8_define_method(mrb, set, "chars", mrb_str_chars);
   mrb_alias_method(mrb, s, mrb_intern_lit(mrb, "each_char"), mrb_intern_lit(mrb, "chars"));
-  mrb_define_method(mrb, s, "codepoints", mrb_str_codepoints, MRB_ARGS_NONE());
+  utf8_define_method(mrb, set, "codepoints", mrb_str_codepoints);
   mrb_alias_method(mrb, s, mrb_intern_lit(mrb, "each_codepoint"), mrb_intern_lit(mrb, "codepoints"));
 
   mrb_define_method(mrb, mrb->fixnum_class, "chr", mrb_fixnum_chr, MRB_ARGS_NONE());
@@ -11,6 +11,72 @@ assert('String#[]') do
   assert_equal "世", "こんにちは世界"["世"]
 end
 
+assert('String#[] sequential access') do
+  str = "こんにちは世界!" * 20
+  got = ""
+  str.size.times do |i|
+    got << str[i]
+  end
+  assert_equal str, got
+  assert_equal "ん", str[1]
+  assert_equal "!", str[-1]
+  assert_equal "こ", str[8]
+end
+
+assert('String#[] after modification') do
+  str = "こんにちは"
+  assert_equal "は", str[4]
+  str << "世界"
+  assert_equal "世", str[5]
+  str.reverse!
+  assert_equal "界", str[0]
+  assert_equal "は", str[2]
+  str.replace("abcdefg")
+  assert_equal "e", str[4]
+  assert_equal 7, str.size
+  str << "あ"
+  assert_equal "あ", str[7]
+  assert_equal 8, str.size
+end
+
+assert('String#[] on several strings in turn') do
+  strs = (0...6).map { |n| "あいうえお#{n}" * 3 }
+  chars = strs.map { |x| x.chars }
+  strs[0].size.times do |i|
+    strs.each_with_index do |x, n|
+      assert_equal chars[n][i], x[i]
+    end
+    assert_equal chars[1][i] == chars[2][i], strs[1][i] == strs[2][i]
+  end
+  a = strs[0]
+  b = strs[1]
+  assert_equal "え", a[3]
+  assert_equal "え", b[3]
+  a.replace("かきくけこ")
+  assert_equal "け", a[3]
+  assert_equal "え", b[3]
+end
+
+assert('String#size on several strings in turn') do
+  strs = (0...6).map { |n| "あいうえお" * (n + 1) }
+  3.times do
+    strs.each_with_index do |x, n|
+      assert_equal 5 * (n + 1), x.size
+      assert_equal "お", x[-1]
+    end
+  end
+  a = strs[0]
+  b = strs[1]
+  assert_equal 5, a.size
+  assert_equal 10, b.size
+  a << "かき"
+  assert_equal 7, a.size
+  assert_equal 10, b.size
+  b.replace(b[2..-1])
+  assert_equal 8, b.size
+  assert_equal 7, a.size
+end
+
 assert('String#reverse', '15.2.10.5.29') do
   a = 'こんにちは世界!'
   a.reverse
@@ -37,6 +103,13 @@ assert('String#size') do
   assert_equal 8, str.size
   assert_not_equal str.bytesize, str.size
   assert_equal 2, str[1, 2].size
+
+  long = "abcdefghijklmnop" * 4 + str + "qrstuvwxyz" * 3
+  assert_equal 102, long.size
+  long << "あ"
+  assert_equal 103, long.size
+  assert_equal "あ", long[-1]
+  assert_equal 13, "\xF8\x88\x80\x80\x80abcdefgh".size
 end
 
 assert('String#index') do
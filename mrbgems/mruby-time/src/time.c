@@ -163,7 +163,16 @@ struct mrb_time {
   struct tm           datetime;
 };
 
-static const struct mrb_data_type mrb_time_type = { "Time", mrb_free };
+static void*
+mrb_time_copy(mrb_state *mrb, const void *p)
+{
+  struct mrb_time *tm = (struct mrb_time *)mrb_malloc(mrb, sizeof(struct mrb_time));
+
+  *tm = *(const struct mrb_time *)p;
+  return tm;
+}
+
+static const struct mrb_data_type mrb_time_type = { "Time", mrb_free, mrb_time_copy };
 
 /** Updates the datetime of a mrb_time based on it's timezone and
 seconds setting. Returns self on success, NULL of failure. */
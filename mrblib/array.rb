@@ -12,15 +12,10 @@ class Array
   def each(&block)
     return to_enum :each unless block_given?
 
-    idx, length = -1, self.length-1
-    while idx < length and length <= self.length and length = self.length-1
-      elm = self[idx += 1]
-      unless elm
-        if elm == nil and length >= self.length
-          break
-        end
-      end
-      block.call(elm)
+    idx = 0
+    while idx < self.length
+      yield(self[idx])
+      idx += 1
     end
     self
   end
@@ -35,7 +30,7 @@ class Array
 
     idx = 0
     while(idx < length)
-      block.call(idx)
+      yield(idx)
       idx += 1
     end
     self
@@ -51,7 +46,7 @@ class Array
     return to_enum :collect! unless block_given?
 
     self.each_index{|idx|
-      self[idx] = block.call(self[idx])
+      self[idx] = yield(self[idx])
     }
     self
   end
@@ -62,6 +57,71 @@ class Array
   # ISO 15.2.12.5.20
   alias map! collect!
 
+  ##
+  # Calls the given block for each element of +self+
+  # and returns an array of the block values.
+  # Overrides Enumerable#collect to walk +self+ by
+  # index instead of going through +each+.
+  #
+  # ISO 15.3.2.2.3
+  def collect(&block)
+    return to_enum :collect unless block_given?
+
+    ary = []
+    idx = 0
+    while idx < self.length
+      ary.push(yield(self[idx]))
+      idx += 1
+    end
+    ary
+  end
+
+  ##
+  # Alias for collect
+  #
+  # ISO 15.3.2.2.12
+  alias map collect
+
+  ##
+  # Calls the given block for each element of +self+
+  # together with its index.
+  #
+  # ISO 15.3.2.2.5
+  def each_with_index(&block)
+    return to_enum :each_with_index unless block_given?
+
+    idx = 0
+    while idx < self.length
+      yield(self[idx], idx)
+      idx += 1
+    end
+    self
+  end
+
+  ##
+  # Returns an array of the elements of +self+
+  # for which the given block is true.
+  #
+  # ISO 15.3.2.2.8
+  def find_all(&block)
+    return to_enum :find_all unless block_given?
+
+    ary = []
+    idx = 0
+    while idx < self.length
+      elm = self[idx]
+      ary.push(elm) if yield(elm)
+      idx += 1
+    end
+    ary
+  end
+
+  ##
+  # Alias for find_all.
+  #
+  # ISO 15.3.2.2.18
+  alias select find_all
+
   ##
   # Private method for Array creation.
   #
@@ -76,7 +136,7 @@ class Array
 
       idx = 0
       while(idx < size)
-        self[idx] = (block)? block.call(idx): obj
+        self[idx] = (block)? yield(idx): obj
         idx += 1
       end
     end
@@ -186,7 +246,7 @@ class Array
       ret = key
     end
     if ret == nil && block
-      block.call
+      yield
     else
       ret
     end
@@ -212,6 +272,18 @@ class Array
   # Sort all elements and replace +self+ with these
   # elements.
   def sort!(&block)
+    return self.__ary_sort(self) unless block
     self.replace(self.sort(&block))
   end
+
+  ##
+  # Return a sorted copy of +self+. Without a block
+  # the elements are compared natively (see __ary_sort).
+  #
+  # ISO 15.3.2.2.19
+  def sort(&block)
+    return super if block
+    ary = [].replace(self)
+    ary.__ary_sort(ary)
+  end
 end
@@ -25,7 +25,7 @@ module Enumerable
   def all?(&block)
     if block
       self.each{|*val|
-        unless block.call(*val)
+        unless yield(*val)
           return false
         end
       }
@@ -50,7 +50,7 @@ module Enumerable
   def any?(&block)
     if block
       self.each{|*val|
-        if block.call(*val)
+        if yield(*val)
           return true
         end
       }
@@ -76,7 +76,7 @@ module Enumerable
 
     ary = []
     self.each{|*val|
-      ary.push(block.call(*val))
+      ary.push(yield(*val))
     }
     ary
   end
@@ -92,7 +92,7 @@ module Enumerable
   def detect(ifnone=nil, &block)
     ret = ifnone
     self.each{|*val|
-      if block.call(*val)
+      if yield(*val)
         ret = val.__svalue
         break
       end
@@ -112,7 +112,7 @@ module Enumerable
 
     i = 0
     self.each{|*val|
-      block.call(val.__svalue, i)
+      yield(val.__svalue, i)
       i += 1
     }
     self
@@ -150,7 +150,7 @@ module Enumerable
 
     ary = []
     self.each{|*val|
-      ary.push(val.__svalue) if block.call(*val)
+      ary.push(val.__svalue) if yield(*val)
     }
     ary
   end
@@ -168,7 +168,7 @@ module Enumerable
     self.each{|*val|
       sv = val.__svalue
       if pattern === sv
-        ary.push((block)? block.call(*val): sv)
+        ary.push((block)? yield(*val): sv)
       end
     }
     ary
@@ -250,7 +250,7 @@ module Enumerable
         flag = false
       else
         if block
-          result = val if block.call(val, result) > 0
+          result = val if yield(val, result) > 0
         else
           result = val if (val <=> result) > 0
         end
@@ -277,7 +277,7 @@ module Enumerable
         flag = false
       else
         if block
-          result = val if block.call(val, result) < 0
+          result = val if yield(val, result) < 0
         else
           result = val if (val <=> result) < 0
         end
@@ -306,7 +306,7 @@ module Enumerable
     ary_T = []
     ary_F = []
     self.each{|*val|
-      if block.call(*val)
+      if yield(*val)
         ary_T.push(val.__svalue)
       else
         ary_F.push(val.__svalue)
@@ -325,7 +325,7 @@ module Enumerable
   def reject(&block)
     ary = []
     self.each{|*val|
-      ary.push(val.__svalue) unless block.call(*val)
+      ary.push(val.__svalue) unless yield(*val)
     }
     ary
   end
@@ -356,7 +356,7 @@ module Enumerable
     i, j = head, tail  # position to store on the dst ary
 
     (head + 1).upto(tail){|idx|
-      if ((block)? block.call(src[idx], key): (src[idx] <=> key)) > 0
+      if ((block)? yield(src[idx], key): (src[idx] <=> key)) > 0
         # larger than key
         dst[j] = src[idx]
         j -= 1
@@ -387,8 +387,12 @@ module Enumerable
   def sort(&block)
     ary = []
     self.each{|*val| ary.push(val.__svalue)}
-    if ary.size > 1
-      __sort_sub__(ary, ::Array.new(ary.size), 0, 0, ary.size - 1, &block)
+    if block
+      if ary.size > 1
+        __sort_sub__(ary, ::Array.new(ary.size), 0, 0, ary.size - 1, &block)
+      end
+    else
+      ary.__ary_sort(ary)
     end
     ary
   end
@@ -55,7 +55,7 @@ class Hash
   # ISO 15.2.13.4.8
   def delete(key, &block)
     if block && ! self.has_key?(key)
-      block.call(key)
+      yield(key)
     else
       self.__delete(key)
     end
@@ -91,7 +91,7 @@ class Hash
     len = self.size
     i = 0
     while i < len
-      block.call [keys[i], vals[i]]
+      yield [keys[i], vals[i]]
       i += 1
     end
     self
@@ -119,7 +119,7 @@ class Hash
   def each_key(&block)
     return to_enum :each_key unless block_given?
 
-    self.keys.each{|k| block.call(k)}
+    self.keys.each{|k| yield(k)}
     self
   end
 
@@ -145,7 +145,7 @@ class Hash
   def each_value(&block)
     return to_enum :each_value unless block_given?
 
-    self.keys.each{|k| block.call(self[k])}
+    self.keys.each{|k| yield(self[k])}
     self
   end
 
@@ -184,7 +184,7 @@ class Hash
     self.each_key{|k| h[k] = self[k]}
     if block
       other.each_key{|k|
-        h[k] = (self.has_key?(k))? block.call(k, self[k], other[k]): other[k]
+        h[k] = (self.has_key?(k))? yield(k, self[k], other[k]): other[k]
       }
     else
       other.each_key{|k| h[k] = other[k]}
@@ -228,7 +228,7 @@ class Hash
 
     keys = []
     self.each{|k,v|
-      if b.call([k, v])
+      if yield([k, v])
         keys.push(k)
       end
     }
@@ -259,7 +259,7 @@ class Hash
 
     h = {}
     self.each{|k,v|
-      unless b.call([k, v])
+      unless yield([k, v])
         h[k] = v
       end
     }
@@ -281,7 +281,7 @@ class Hash
 
     keys = []
     self.each{|k,v|
-      unless b.call([k, v])
+      unless yield([k, v])
         keys.push(k)
       end
     }
@@ -312,7 +312,7 @@ class Hash
 
     h = {}
     self.each{|k,v|
-      if b.call([k, v])
+      if yield([k, v])
         h[k] = v
       end
     }
@@ -49,7 +49,7 @@ module Integral
 
     i = self.to_i
     while(i >= num)
-      block.call(i)
+      yield(i)
       i -= 1
     end
     self
@@ -74,7 +74,7 @@ module Integral
 
     i = 0
     while i < self
-      block.call i
+      yield i
       i += 1
     end
     self
@@ -90,7 +90,7 @@ module Integral
 
     i = self.to_i
     while(i <= num)
-      block.call(i)
+      yield(i)
       i += 1
     end
     self
@@ -103,10 +103,19 @@ module Integral
   def step(num, step=1, &block)
     return to_enum(:step, num, step) unless block_given?
 
-    i = if num.kind_of? Float then self.to_f else self end
-    while(i <= num)
-      block.call(i)
-      i += step
+    raise ArgumentError, "step can't be 0" if step == 0
+
+    i = if num.kind_of?(Float) || step.kind_of?(Float) then self.to_f else self end
+    if step > 0
+      while i <= num
+        yield i
+        i += step
+      end
+    else
+      while i >= num
+        yield i
+        i += step
+      end
     end
     self
   end
@@ -16,12 +16,17 @@ class Range
     last = self.last
 
     if val.kind_of?(Fixnum) && last.kind_of?(Fixnum) # fixnums are special
-      lim = last
-      lim += 1 unless exclude_end?
       i = val
-      while i < lim
-        block.call(i)
-        i += 1
+      if exclude_end?
+        while i < last
+          yield i
+          i += 1
+        end
+      else
+        while i <= last
+          yield i
+          i += 1
+        end
       end
       return self
     end
@@ -33,12 +38,12 @@ class Range
     return self if (val <=> last) > 0
 
     while((val <=> last) < 0)
-      block.call(val)
+      yield(val)
       val = val.succ
     end
 
     if not exclude_end? and (val <=> last) == 0
-      block.call(val)
+      yield(val)
     end
     self
   end
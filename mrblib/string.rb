@@ -13,10 +13,10 @@ class String
     # expect that str.index accepts an Integer for 1st argument as a byte data
     offset = 0
     while(pos = self.index(0x0a, offset))
-      block.call(self[offset, pos + 1 - offset])
+      yield(self[offset, pos + 1 - offset])
       offset = pos + 1
     end
-    block.call(self[offset, self.size - offset]) if self.size > offset
+    yield(self[offset, self.size - offset]) if self.size > offset
     self
   end
 
@@ -31,7 +31,7 @@ class String
     if args.size == 2
       split(args[0], -1).join(args[1])
     elsif args.size == 1 && block
-      split(args[0], -1).join(block.call(args[0]))
+      split(args[0], -1).join(yield(args[0]))
     else
       raise ArgumentError, "wrong number of arguments"
     end
@@ -78,7 +78,7 @@ class String
     if args.size == 2
       split(args[0], 2).join(args[1])
     elsif args.size == 1 && block
-      split(args[0], 2).join(block.call(args[0]))
+      split(args[0], 2).join(yield(args[0]))
     else
       raise ArgumentError, "wrong number of arguments"
     end
@@ -107,7 +107,7 @@ class String
   def each_char(&block)
     pos = 0
     while(pos < self.size)
-      block.call(self[pos])
+      yield(self[pos])
       pos += 1
     end
     self
@@ -119,7 +119,7 @@ class String
     bytes = self.bytes
     pos = 0
     while(pos < bytes.size)
-      block.call(bytes[pos])
+      yield(bytes[pos])
       pos += 1
     end
     self
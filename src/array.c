@@ -7,6 +7,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/string.h"
 #include "mruby/range.h"
 #include "value_array.h"
@@ -18,6 +19,8 @@
 #define ARY_SHARED_P(a) ((a)->flags & MRB_ARY_SHARED)
 #define ARY_SET_SHARED_FLAG(a) ((a)->flags |= MRB_ARY_SHARED)
 #define ARY_UNSET_SHARED_FLAG(a) ((a)->flags &= ~MRB_ARY_SHARED)
+/* sole owner of a shared buffer; a->as.heap.ptr may point past its head */
+#define ARY_OWNED_P(a) (ARY_SHARED_P(a) && (a)->as.heap.aux.shared->refcnt == 1)
 
 static inline mrb_value
 ary_elt(mrb_value ary, mrb_int offset)
@@ -44,9 +47,14 @@ ary_new_capa(mrb_state *mrb, mrb_int capa)
   }
 
   a = (struct RArray*)mrb_obj_alloc(mrb, MRB_TT_ARRAY, mrb->array_class);
-  a->ptr = (mrb_value *)mrb_malloc(mrb, blen);
-  a->aux.capa = capa;
-  a->len = 0;
+  if (capa <= MRB_ARY_EMBED_LEN_MAX) {
+    ARY_SET_EMBED_FLAG(a);
+  }
+  else {
+    a->as.heap.ptr = (mrb_value *)mrb_malloc(mrb, blen);
+    a->as.heap.aux.capa = capa;
+    a->as.heap.len = 0;
+  }
 
   return a;
 }
@@ -96,8 +104,8 @@ mrb_ary_new_from_values(mrb_state *mrb, mrb_int size, const mrb_value *vals)
 
   ary = mrb_ary_new_capa(mrb, size);
   a = mrb_ary_ptr(ary);
-  array_copy(a->ptr, vals, size);
-  a->len = size;
+  array_copy(ARY_PTR(a), vals, size);
+  ARY_SET_LEN(a, size);
 
   return ary;
 }
@@ -106,11 +114,13 @@ mrb_value
 mrb_assoc_new(mrb_state *mrb, mrb_value car, mrb_value cdr)
 {
   struct RArray *a;
+  mrb_value *p;
 
   a = ary_new_capa(mrb, 2);
-  a->ptr[0] = car;
-  a->ptr[1] = cdr;
-  a->len = 2;
+  p = ARY_PTR(a);
+  p[0] = car;
+  p[1] = cdr;
+  ARY_SET_LEN(a, 2);
   return mrb_obj_value(a);
 }
 
@@ -128,25 +138,27 @@ static void
 ary_modify(mrb_state *mrb, struct RArray *a)
 {
   if (ARY_SHARED_P(a)) {
-    mrb_shared_array *shared = a->aux.shared;
+    mrb_shared_array *shared = a->as.heap.aux.shared;
 
-    if (shared->refcnt == 1 && a->ptr == shared->ptr) {
-      a->ptr = shared->ptr;
-      a->aux.capa = a->len;
+    if (shared->refcnt == 1) {
+      /* take the buffer back, moving elements to its head */
+      value_move(shared->ptr, a->as.heap.ptr, a->as.heap.len);
+      a->as.heap.ptr = shared->ptr;
+      a->as.heap.aux.capa = shared->len;
       mrb_free(mrb, shared);
     }
     else {
       mrb_value *ptr, *p;
       mrb_int len;
 
-      p = a->ptr;
-      len = a->len * sizeof(mrb_value);
+      p = a->as.heap.ptr;
+      len = a->as.heap.len * sizeof(mrb_value);
       ptr = (mrb_value *)mrb_malloc(mrb, len);
       if (p) {
-        array_copy(ptr, p, a->len);
+        array_copy(ptr, p, a->as.heap.len);
       }
-      a->ptr = ptr;
-      a->aux.capa = a->len;
+      a->as.heap.ptr = ptr;
+      a->as.heap.aux.capa = a->as.heap.len;
       mrb_ary_decref(mrb, shared);
     }
     ARY_UNSET_SHARED_FLAG(a);
@@ -160,6 +172,7 @@ mrb_ary_modify(mrb_state *mrb, struct RArray* a)
   ary_modify(mrb, a);
 }
 
+/* a must not be embedded */
 static void
 ary_make_shared(mrb_state *mrb, struct RArray *a)
 {
@@ -167,28 +180,75 @@ ary_make_shared(mrb_state *mrb, struct RArray *a)
     mrb_shared_array *shared = (mrb_shared_array *)mrb_malloc(mrb, sizeof(mrb_shared_array));
 
     shared->refcnt = 1;
-    if (a->aux.capa > a->len) {
-      a->ptr = shared->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*a->len+1);
+    if (a->as.heap.aux.capa > a->as.heap.len) {
+      a->as.heap.ptr = shared->ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*a->as.heap.len+1);
     }
     else {
-      shared->ptr = a->ptr;
+      shared->ptr = a->as.heap.ptr;
     }
-    shared->len = a->len;
-    a->aux.shared = shared;
+    shared->len = a->as.heap.len;
+    a->as.heap.aux.shared = shared;
     ARY_SET_SHARED_FLAG(a);
   }
 }
 
+/* turn a plain heap array into the sole owner of its buffer, keeping the
+   capacity, so that elements can be dropped from or added to the front
+   by moving a->as.heap.ptr */
+static void
+ary_make_owned(mrb_state *mrb, struct RArray *a)
+{
+  mrb_shared_array *shared = (mrb_shared_array *)mrb_malloc(mrb, sizeof(mrb_shared_array));
+
+  shared->refcnt = 1;
+  shared->ptr = a->as.heap.ptr;
+  shared->len = a->as.heap.aux.capa;
+  a->as.heap.aux.shared = shared;
+  ARY_SET_SHARED_FLAG(a);
+}
+
+/* make room for at least n elements before the first one; the head room
+   grows geometrically so that repeated unshift is amortized O(1) */
+static void
+ary_head_room(mrb_state *mrb, struct RArray *a, mrb_int n)
+{
+  mrb_value *ptr;
+  mrb_int len = ARY_LEN(a);
+  mrb_int capa, head;
+
+  if (len + n > ARY_MAX_SIZE / 2) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
+  }
+  capa = (len + n) * 2;
+  if (capa < ARY_DEFAULT_LEN) capa = ARY_DEFAULT_LEN;
+  head = capa - len - (capa - len - n) / 2;
+  ptr = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*capa);
+  array_copy(ptr + head, ARY_PTR(a), len);
+  if (ARY_SHARED_P(a)) {
+    mrb_ary_decref(mrb, a->as.heap.aux.shared);
+  }
+  else if (!ARY_EMBED_P(a)) {
+    mrb_free(mrb, a->as.heap.ptr);
+  }
+  ARY_UNSET_EMBED_FLAG(a);
+  a->as.heap.len = len;
+  a->as.heap.ptr = ptr;
+  a->as.heap.aux.capa = capa;
+  ary_make_owned(mrb, a);
+  a->as.heap.ptr += head;
+}
+
 static void
 ary_expand_capa(mrb_state *mrb, struct RArray *a, mrb_int len)
 {
-  mrb_int capa = a->aux.capa;
+  mrb_int capa = ARY_CAPA(a);
 
   if (len > ARY_MAX_SIZE) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
   }
+  if (len <= capa) return;
 
-  if (capa == 0) {
+  if (capa < ARY_DEFAULT_LEN) {
     capa = ARY_DEFAULT_LEN;
   }
   while (capa < len) {
@@ -197,21 +257,33 @@ ary_expand_capa(mrb_state *mrb, struct RArray *a, mrb_int len)
 
   if (capa > ARY_MAX_SIZE) capa = ARY_MAX_SIZE; /* len <= capa <= ARY_MAX_SIZE */
 
-  if (capa > a->aux.capa) {
-    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+  if (ARY_EMBED_P(a)) {
+    mrb_value *ptr = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*capa);
+    mrb_int elen = ARY_EMBED_LEN(a);
 
-    a->aux.capa = capa;
-    a->ptr = expanded_ptr;
+    array_copy(ptr, ARY_EMBED_PTR(a), elen);
+    ARY_UNSET_EMBED_FLAG(a);
+    a->as.heap.len = elen;
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = ptr;
+  }
+  else {
+    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*capa);
+
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = expanded_ptr;
   }
 }
 
 static void
 ary_shrink_capa(mrb_state *mrb, struct RArray *a)
 {
-  mrb_int capa = a->aux.capa;
+  mrb_int capa;
 
+  if (ARY_EMBED_P(a)) return;
+  capa = a->as.heap.aux.capa;
   if (capa < ARY_DEFAULT_LEN * 2) return;
-  if (capa <= a->len * ARY_SHRINK_RATIO) return;
+  if (capa <= a->as.heap.len * ARY_SHRINK_RATIO) return;
 
   do {
     capa /= 2;
@@ -219,11 +291,11 @@ ary_shrink_capa(mrb_state *mrb, struct RArray *a)
       capa = ARY_DEFAULT_LEN;
       break;
     }
-  } while (capa > a->len * ARY_SHRINK_RATIO);
+  } while (capa > a->as.heap.len * ARY_SHRINK_RATIO);
 
-  if (capa > a->len && capa < a->aux.capa) {
-    a->aux.capa = capa;
-    a->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+  if (capa > a->as.heap.len && capa < a->as.heap.aux.capa) {
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*capa);
   }
 }
 
@@ -234,15 +306,16 @@ mrb_ary_resize(mrb_state *mrb, mrb_value ary, mrb_int new_len)
   struct RArray *a = mrb_ary_ptr(ary);
 
   ary_modify(mrb, a);
-  old_len = RARRAY_LEN(ary);
+  old_len = ARY_LEN(a);
   if (old_len != new_len) {
-    a->len = new_len;
     if (new_len < old_len) {
+      ARY_SET_LEN(a, new_len);
       ary_shrink_capa(mrb, a);
     }
     else {
       ary_expand_capa(mrb, a, new_len);
-      ary_fill_with_nil(a->ptr + old_len, new_len - old_len);
+      ary_fill_with_nil(ARY_PTR(a) + old_len, new_len - old_len);
+      ARY_SET_LEN(a, new_len);
     }
   }
 
@@ -263,13 +336,25 @@ mrb_ary_s_create(mrb_state *mrb, mrb_value self)
 static void
 ary_concat(mrb_state *mrb, struct RArray *a, mrb_value *ptr, mrb_int blen)
 {
-  mrb_int len = a->len + blen;
+  mrb_int alen = ARY_LEN(a);
+  mrb_int len = alen + blen;
 
   ary_modify(mrb, a);
-  if (a->aux.capa < len) ary_expand_capa(mrb, a, len);
-  array_copy(a->ptr+a->len, ptr, blen);
+  if (ARY_CAPA(a) < len) {
+    ptrdiff_t off = -1;
+
+    /* ptr may point into a itself (a.concat(a)) */
+    if (ptr >= ARY_PTR(a) && ptr < ARY_PTR(a) + alen) {
+      off = ptr - ARY_PTR(a);
+    }
+    ary_expand_capa(mrb, a, len);
+    if (off != -1) {
+      ptr = ARY_PTR(a) + off;
+    }
+  }
+  array_copy(ARY_PTR(a)+alen, ptr, blen);
   mrb_write_barrier(mrb, (struct RBasic*)a);
-  a->len = len;
+  ARY_SET_LEN(a, len);
 }
 
 void
@@ -277,7 +362,7 @@ mrb_ary_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RArray *a2 = mrb_ary_ptr(other);
 
-  ary_concat(mrb, mrb_ary_ptr(self), a2->ptr, a2->len);
+  ary_concat(mrb, mrb_ary_ptr(self), ARY_PTR(a2), ARY_LEN(a2));
 }
 
 static mrb_value
@@ -298,14 +383,15 @@ mrb_ary_plus(mrb_state *mrb, mrb_value self)
   struct RArray *a2;
   mrb_value ary;
   mrb_value *ptr;
-  mrb_int blen;
+  mrb_int blen, len1;
 
   mrb_get_args(mrb, "a", &ptr, &blen);
-  ary = mrb_ary_new_capa(mrb, a1->len + blen);
+  len1 = ARY_LEN(a1);
+  ary = mrb_ary_new_capa(mrb, len1 + blen);
   a2 = mrb_ary_ptr(ary);
-  array_copy(a2->ptr, a1->ptr, a1->len);
-  array_copy(a2->ptr + a1->len, ptr, blen);
-  a2->len = a1->len + blen;
+  array_copy(ARY_PTR(a2), ARY_PTR(a1), len1);
+  array_copy(ARY_PTR(a2) + len1, ptr, blen);
+  ARY_SET_LEN(a2, len1 + blen);
 
   return ary;
 }
@@ -314,11 +400,11 @@ static void
 ary_replace(mrb_state *mrb, struct RArray *a, mrb_value *argv, mrb_int len)
 {
   ary_modify(mrb, a);
-  if (a->aux.capa < len)
+  if (ARY_CAPA(a) < len)
     ary_expand_capa(mrb, a, len);
-  array_copy(a->ptr, argv, len);
+  array_copy(ARY_PTR(a), argv, len);
   mrb_write_barrier(mrb, (struct RBasic*)a);
-  a->len = len;
+  ARY_SET_LEN(a, len);
 }
 
 void
@@ -326,7 +412,7 @@ mrb_ary_replace(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RArray *a2 = mrb_ary_ptr(other);
 
-  ary_replace(mrb, mrb_ary_ptr(self), a2->ptr, a2->len);
+  ary_replace(mrb, mrb_ary_ptr(self), ARY_PTR(a2), ARY_LEN(a2));
 }
 
 static mrb_value
@@ -347,7 +433,7 @@ mrb_ary_times(mrb_state *mrb, mrb_value self)
   struct RArray *a2;
   mrb_value ary;
   mrb_value *ptr;
-  mrb_int times;
+  mrb_int times, len1;
 
   mrb_get_args(mrb, "i", &times);
   if (times < 0) {
@@ -355,14 +441,15 @@ mrb_ary_times(mrb_state *mrb, mrb_value self)
   }
   if (times == 0) return mrb_ary_new(mrb);
 
-  ary = mrb_ary_new_capa(mrb, a1->len * times);
+  len1 = ARY_LEN(a1);
+  ary = mrb_ary_new_capa(mrb, len1 * times);
   a2 = mrb_ary_ptr(ary);
-  ptr = a2->ptr;
+  ptr = ARY_PTR(a2);
   while (times--) {
-    array_copy(ptr, a1->ptr, a1->len);
-    ptr += a1->len;
-    a2->len += a1->len;
+    array_copy(ptr, ARY_PTR(a1), len1);
+    ptr += len1;
   }
+  ARY_SET_LEN(a2, ptr - ARY_PTR(a2));
 
   return ary;
 }
@@ -372,12 +459,12 @@ mrb_ary_reverse_bang(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  if (a->len > 1) {
+  if (ARY_LEN(a) > 1) {
     mrb_value *p1, *p2;
 
     ary_modify(mrb, a);
-    p1 = a->ptr;
-    p2 = a->ptr + a->len - 1;
+    p1 = ARY_PTR(a);
+    p2 = p1 + ARY_LEN(a) - 1;
 
     while (p1 < p2) {
       mrb_value tmp = *p1;
@@ -393,19 +480,20 @@ mrb_ary_reverse(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self), *b;
   mrb_value ary;
+  mrb_int len = ARY_LEN(a);
 
-  ary = mrb_ary_new_capa(mrb, a->len);
+  ary = mrb_ary_new_capa(mrb, len);
   b = mrb_ary_ptr(ary);
-  if (a->len > 0) {
+  if (len > 0) {
     mrb_value *p1, *p2, *e;
 
-    p1 = a->ptr;
-    e  = p1 + a->len;
-    p2 = b->ptr + a->len - 1;
+    p1 = ARY_PTR(a);
+    e  = p1 + len;
+    p2 = ARY_PTR(b) + len - 1;
     while (p1 < e) {
       *p2-- = *p1++;
     }
-    b->len = a->len;
+    ARY_SET_LEN(b, len);
   }
   return ary;
 }
@@ -414,11 +502,28 @@ void
 mrb_ary_push(mrb_state *mrb, mrb_value ary, mrb_value elem)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len;
 
+  if (ARY_OWNED_P(a)) {
+    mrb_shared_array *shared = a->as.heap.aux.shared;
+
+    if (a->as.heap.ptr + a->as.heap.len == shared->ptr + shared->len) {
+      /* tail is full; slide elements to the head if that frees enough */
+      if (a->as.heap.ptr - shared->ptr < a->as.heap.len) goto L_EXPAND;
+      value_move(shared->ptr, a->as.heap.ptr, a->as.heap.len);
+      a->as.heap.ptr = shared->ptr;
+    }
+    a->as.heap.ptr[a->as.heap.len++] = elem;
+    mrb_field_write_barrier_value(mrb, (struct RBasic*)a, elem);
+    return;
+  }
+ L_EXPAND:
   ary_modify(mrb, a);
-  if (a->len == a->aux.capa)
-    ary_expand_capa(mrb, a, a->len + 1);
-  a->ptr[a->len++] = elem;
+  len = ARY_LEN(a);
+  if (len == ARY_CAPA(a))
+    ary_expand_capa(mrb, a, len + 1);
+  ARY_PTR(a)[len] = elem;
+  ARY_SET_LEN(a, len + 1);
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, elem);
 }
 
@@ -440,9 +545,11 @@ mrb_value
 mrb_ary_pop(mrb_state *mrb, mrb_value ary)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len = ARY_LEN(a);
 
-  if (a->len == 0) return mrb_nil_value();
-  return a->ptr[--a->len];
+  if (len == 0) return mrb_nil_value();
+  ARY_SET_LEN(a, len - 1);
+  return ARY_PTR(a)[len - 1];
 }
 
 #define ARY_SHIFT_SHARED_MIN 10
@@ -451,30 +558,31 @@ mrb_value
 mrb_ary_shift(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
+  mrb_int len = ARY_LEN(a);
   mrb_value val;
 
-  if (a->len == 0) return mrb_nil_value();
+  if (len == 0) return mrb_nil_value();
   if (ARY_SHARED_P(a)) {
   L_SHIFT:
-    val = a->ptr[0];
-    a->ptr++;
-    a->len--;
+    val = a->as.heap.ptr[0];
+    a->as.heap.ptr++;
+    a->as.heap.len--;
     return val;
   }
-  if (a->len > ARY_SHIFT_SHARED_MIN) {
-    ary_make_shared(mrb, a);
+  if (len > ARY_SHIFT_SHARED_MIN) {
+    ary_make_owned(mrb, a);
     goto L_SHIFT;
   }
   else {
-    mrb_value *ptr = a->ptr;
-    mrb_int size = a->len;
+    mrb_value *ptr = ARY_PTR(a);
+    mrb_int size = len;
 
     val = *ptr;
     while (--size) {
       *ptr = *(ptr+1);
       ++ptr;
     }
-    --a->len;
+    ARY_SET_LEN(a, len - 1);
   }
   return val;
 }
@@ -488,20 +596,13 @@ mrb_ary_unshift(mrb_state *mrb, mrb_value self, mrb_value item)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  if (ARY_SHARED_P(a)
-      && a->aux.shared->refcnt == 1 /* shared only referenced from this array */
-      && a->ptr - a->aux.shared->ptr >= 1) /* there's room for unshifted item */ {
-    a->ptr--;
-    a->ptr[0] = item;
+  if (!ARY_OWNED_P(a)
+      || a->as.heap.ptr - a->as.heap.aux.shared->ptr < 1) /* no room for unshifted item */ {
+    ary_head_room(mrb, a, 1);
   }
-  else {
-    ary_modify(mrb, a);
-    if (a->aux.capa < a->len + 1)
-      ary_expand_capa(mrb, a, a->len + 1);
-    value_move(a->ptr + 1, a->ptr, a->len);
-    a->ptr[0] = item;
-  }
-  a->len++;
+  a->as.heap.ptr--;
+  a->as.heap.ptr[0] = item;
+  a->as.heap.len++;
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, item);
 
   return self;
@@ -515,20 +616,14 @@ mrb_ary_unshift_m(mrb_state *mrb, mrb_value self)
   mrb_int len;
 
   mrb_get_args(mrb, "*", &vals, &len);
-  if (ARY_SHARED_P(a)
-      && a->aux.shared->refcnt == 1 /* shared only referenced from this array */
-      && a->ptr - a->aux.shared->ptr >= len) /* there's room for unshifted item */ {
-    a->ptr -= len;
-  }
-  else {
-    ary_modify(mrb, a);
-    if (len == 0) return self;
-    if (a->aux.capa < a->len + len)
-      ary_expand_capa(mrb, a, a->len + len);
-    value_move(a->ptr + len, a->ptr, a->len);
+  if (len == 0) return self;
+  if (!ARY_OWNED_P(a)
+      || a->as.heap.ptr - a->as.heap.aux.shared->ptr < len) /* no room for unshifted items */ {
+    ary_head_room(mrb, a, len);
   }
-  array_copy(a->ptr, vals, len);
-  a->len += len;
+  a->as.heap.ptr -= len;
+  array_copy(a->as.heap.ptr, vals, len);
+  a->as.heap.len += len;
   while (len--) {
     mrb_field_write_barrier_value(mrb, (struct RBasic*)a, vals[len]);
   }
@@ -540,35 +635,37 @@ mrb_value
 mrb_ary_ref(mrb_state *mrb, mrb_value ary, mrb_int n)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len = ARY_LEN(a);
 
   /* range check */
-  if (n < 0) n += a->len;
-  if (n < 0 || a->len <= n) return mrb_nil_value();
+  if (n < 0) n += len;
+  if (n < 0 || len <= n) return mrb_nil_value();
 
-  return a->ptr[n];
+  return ARY_PTR(a)[n];
 }
 
 void
 mrb_ary_set(mrb_state *mrb, mrb_value ary, mrb_int n, mrb_value val)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len = ARY_LEN(a);
 
   ary_modify(mrb, a);
   /* range check */
   if (n < 0) {
-    n += a->len;
+    n += len;
     if (n < 0) {
-      mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array", mrb_fixnum_value(n - a->len));
+      mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array", mrb_fixnum_value(n - len));
     }
   }
-  if (a->len <= n) {
-    if (a->aux.capa <= n)
+  if (len <= n) {
+    if (ARY_CAPA(a) <= n)
       ary_expand_capa(mrb, a, n + 1);
-    ary_fill_with_nil(a->ptr + a->len, n + 1 - a->len);
-    a->len = n + 1;
+    ary_fill_with_nil(ARY_PTR(a) + len, n + 1 - len);
+    ARY_SET_LEN(a, n + 1);
   }
 
-  a->ptr[n] = val;
+  ARY_PTR(a)[n] = val;
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, val);
 }
 
@@ -576,29 +673,34 @@ mrb_value
 mrb_ary_splice(mrb_state *mrb, mrb_value ary, mrb_int head, mrb_int len, mrb_value rpl)
 {
   struct RArray *a = mrb_ary_ptr(ary);
-  mrb_int tail, size;
-  mrb_value *argv;
+  mrb_int alen, tail, size;
+  mrb_value *argv, *ptr;
   mrb_int i, argc;
 
   ary_modify(mrb, a);
+  alen = ARY_LEN(a);
 
   /* len check */
   if (len < 0) mrb_raisef(mrb, E_INDEX_ERROR, "negative length (%S)", mrb_fixnum_value(len));
 
   /* range check */
   if (head < 0) {
-    head += a->len;
+    head += alen;
     if (head < 0) {
       mrb_raise(mrb, E_INDEX_ERROR, "index is out of array");
     }
   }
-  if (a->len < len || a->len < head + len) {
-    len = a->len - head;
+  if (alen < len || alen < head + len) {
+    len = alen - head;
   }
   tail = head + len;
 
   /* size check */
   if (mrb_array_p(rpl)) {
+    if (mrb_ary_ptr(rpl) == a) {
+      /* a[i, n] = a; the storage may move below */
+      rpl = mrb_ary_new_from_values(mrb, alen, ARY_PTR(a));
+    }
     argc = RARRAY_LEN(rpl);
     argv = RARRAY_PTR(rpl);
   }
@@ -608,23 +710,24 @@ mrb_ary_splice(mrb_state *mrb, mrb_value ary, mrb_int head, mrb_int len, mrb_val
   }
   size = head + argc;
 
-  if (tail < a->len) size += a->len - tail;
-  if (size > a->aux.capa)
+  if (tail < alen) size += alen - tail;
+  if (size > ARY_CAPA(a))
     ary_expand_capa(mrb, a, size);
 
-  if (head > a->len) {
-    ary_fill_with_nil(a->ptr + a->len, head - a->len);
+  ptr = ARY_PTR(a);
+  if (head > alen) {
+    ary_fill_with_nil(ptr + alen, head - alen);
   }
-  else if (head < a->len) {
-    value_move(a->ptr + head + argc, a->ptr + tail, a->len - tail);
+  else if (head < alen) {
+    value_move(ptr + head + argc, ptr + tail, alen - tail);
   }
 
   for (i = 0; i < argc; i++) {
-    *(a->ptr + head + i) = *(argv + i);
+    *(ptr + head + i) = *(argv + i);
     mrb_field_write_barrier_value(mrb, (struct RBasic*)a, argv[i]);
   }
 
-  a->len = size;
+  ARY_SET_LEN(a, size);
 
   return ary;
 }
@@ -639,17 +742,46 @@ mrb_ary_decref(mrb_state *mrb, mrb_shared_array *shared)
   }
 }
 
+/* give an array copied from an image a buffer of its own and relocate
+   its elements */
+void
+mrb_gc_copy_ary(mrb_state *mrb, struct RArray *a)
+{
+  mrb_value *ptr;
+  mrb_int i, len = ARY_LEN(a);
+
+  if (ARY_EMBED_P(a)) {
+    ptr = ARY_EMBED_PTR(a);
+  }
+  else {
+    mrb_int capa = ARY_SHARED_P(a) ? len : a->as.heap.aux.capa;
+
+    ptr = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*capa);
+    array_copy(ptr, a->as.heap.ptr, len);
+    ARY_UNSET_SHARED_FLAG(a);
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = ptr;
+  }
+  for (i = 0; i < len; i++) {
+    ptr[i] = mrb_gc_image_value(mrb, ptr[i]);
+  }
+}
+
 static mrb_value
 ary_subseq(mrb_state *mrb, struct RArray *a, mrb_int beg, mrb_int len)
 {
   struct RArray *b;
 
+  if (ARY_EMBED_P(a) || len <= MRB_ARY_EMBED_LEN_MAX) {
+    /* short slices are copied inline rather than sharing the buffer */
+    return mrb_ary_new_from_values(mrb, len, ARY_PTR(a)+beg);
+  }
   ary_make_shared(mrb, a);
   b  = (struct RArray*)mrb_obj_alloc(mrb, MRB_TT_ARRAY, mrb->array_class);
-  b->ptr = a->ptr + beg;
-  b->len = len;
-  b->aux.shared = a->aux.shared;
-  b->aux.shared->refcnt++;
+  b->as.heap.ptr = a->as.heap.ptr + beg;
+  b->as.heap.len = len;
+  b->as.heap.aux.shared = a->as.heap.aux.shared;
+  b->as.heap.aux.shared->refcnt++;
   ARY_SET_SHARED_FLAG(b);
 
   return mrb_obj_value(b);
@@ -707,7 +839,7 @@ mrb_ary_aget(mrb_state *mrb, mrb_value self)
     switch (mrb_type(index)) {
       /* a[n..m] */
     case MRB_TT_RANGE:
-      if (mrb_range_beg_len(mrb, index, &i, &len, a->len)) {
+      if (mrb_range_beg_len(mrb, index, &i, &len, ARY_LEN(a))) {
         return ary_subseq(mrb, a, i, len);
       }
       else {
@@ -721,11 +853,11 @@ mrb_ary_aget(mrb_state *mrb, mrb_value self)
   }
 
   i = aget_index(mrb, index);
-  if (i < 0) i += a->len;
-  if (i < 0 || a->len < i) return mrb_nil_value();
+  if (i < 0) i += ARY_LEN(a);
+  if (i < 0 || ARY_LEN(a) < i) return mrb_nil_value();
   if (len < 0) return mrb_nil_value();
-  if (a->len == i) return mrb_ary_new(mrb);
-  if (len > a->len - i) len = a->len - i;
+  if (ARY_LEN(a) == i) return mrb_ary_new(mrb);
+  if (len > ARY_LEN(a) - i) len = ARY_LEN(a) - i;
 
   return ary_subseq(mrb, a, i, len);
 }
@@ -805,19 +937,19 @@ mrb_ary_delete_at(mrb_state *mrb, mrb_value self)
   mrb_int len;
 
   mrb_get_args(mrb, "i", &index);
-  if (index < 0) index += a->len;
-  if (index < 0 || a->len <= index) return mrb_nil_value();
+  if (index < 0) index += ARY_LEN(a);
+  if (index < 0 || ARY_LEN(a) <= index) return mrb_nil_value();
 
   ary_modify(mrb, a);
-  val = a->ptr[index];
+  val = ARY_PTR(a)[index];
 
-  ptr = a->ptr + index;
-  len = a->len - index;
+  ptr = ARY_PTR(a) + index;
+  len = ARY_LEN(a) - index;
   while (--len) {
     *ptr = *(ptr+1);
     ++ptr;
   }
-  --a->len;
+  ARY_SET_LEN(a, ARY_LEN(a) - 1);
 
   ary_shrink_capa(mrb, a);
 
@@ -831,17 +963,17 @@ mrb_ary_first(mrb_state *mrb, mrb_value self)
   mrb_int size;
 
   if (mrb_get_args(mrb, "|i", &size) == 0) {
-    return (a->len > 0)? a->ptr[0]: mrb_nil_value();
+    return (ARY_LEN(a) > 0)? ARY_PTR(a)[0]: mrb_nil_value();
   }
   if (size < 0) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
   }
 
-  if (size > a->len) size = a->len;
+  if (size > ARY_LEN(a)) size = ARY_LEN(a);
   if (ARY_SHARED_P(a)) {
     return ary_subseq(mrb, a, 0, size);
   }
-  return mrb_ary_new_from_values(mrb, size, a->ptr);
+  return mrb_ary_new_from_values(mrb, size, ARY_PTR(a));
 }
 
 static mrb_value
@@ -851,16 +983,16 @@ mrb_ary_last(mrb_state *mrb, mrb_value self)
   mrb_int size;
 
   if (mrb_get_args(mrb, "|i", &size) == 0)
-    return (a->len > 0)? a->ptr[a->len - 1]: mrb_nil_value();
+    return (ARY_LEN(a) > 0)? ARY_PTR(a)[ARY_LEN(a) - 1]: mrb_nil_value();
 
   if (size < 0) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
   }
-  if (size > a->len) size = a->len;
+  if (size > ARY_LEN(a)) size = ARY_LEN(a);
   if (ARY_SHARED_P(a) || size > ARY_DEFAULT_LEN) {
-    return ary_subseq(mrb, a, a->len - size, size);
+    return ary_subseq(mrb, a, ARY_LEN(a) - size, size);
   }
-  return mrb_ary_new_from_values(mrb, size, a->ptr + a->len - size);
+  return mrb_ary_new_from_values(mrb, size, ARY_PTR(a) + ARY_LEN(a) - size);
 }
 
 static mrb_value
@@ -912,7 +1044,7 @@ mrb_ary_size(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  return mrb_fixnum_value(a->len);
+  return mrb_fixnum_value(ARY_LEN(a));
 }
 
 mrb_value
@@ -921,15 +1053,14 @@ mrb_ary_clear(mrb_state *mrb, mrb_value self)
   struct RArray *a = mrb_ary_ptr(self);
 
   if (ARY_SHARED_P(a)) {
-    mrb_ary_decref(mrb, a->aux.shared);
+    mrb_ary_decref(mrb, a->as.heap.aux.shared);
     ARY_UNSET_SHARED_FLAG(a);
   }
-  else {
-    mrb_free(mrb, a->ptr);
+  else if (!ARY_EMBED_P(a)) {
+    mrb_free(mrb, a->as.heap.ptr);
   }
-  a->len = 0;
-  a->aux.capa = 0;
-  a->ptr = 0;
+  ARY_SET_EMBED_FLAG(a);
+  ARY_SET_EMBED_LEN(a, 0);
 
   return self;
 }
@@ -939,7 +1070,7 @@ mrb_ary_empty_p(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  return mrb_bool_value(a->len == 0);
+  return mrb_bool_value(ARY_LEN(a) == 0);
 }
 
 mrb_value
@@ -1070,6 +1201,161 @@ mrb_ary_cmp(mrb_state *mrb, mrb_value ary1)
   return ary2;
 }
 
+#define SORT_RUN 16
+
+enum sort_kind {
+  SORT_NUMERIC,
+  SORT_STRING,
+  SORT_GENERIC
+};
+
+static enum sort_kind
+sort_kind_of(mrb_state *mrb, const mrb_value *keys, mrb_int len)
+{
+  mrb_int i;
+
+  for (i = 0; i < len; i++) {
+    if (!mrb_fixnum_p(keys[i]) && !mrb_float_p(keys[i])) break;
+  }
+  if (i == len) return SORT_NUMERIC;
+  for (i = 0; i < len; i++) {
+    if (!mrb_string_p(keys[i]) || mrb_obj_class(mrb, keys[i]) != mrb->string_class) break;
+  }
+  if (i == len) return SORT_STRING;
+  return SORT_GENERIC;
+}
+
+static int
+sort_cmp(mrb_state *mrb, enum sort_kind kind, mrb_value a, mrb_value b)
+{
+  mrb_value c;
+  mrb_float x, y;
+  int ai;
+
+  switch (kind) {
+  case SORT_NUMERIC:
+    if (mrb_fixnum_p(a) && mrb_fixnum_p(b)) {
+      return (mrb_fixnum(a) > mrb_fixnum(b)) - (mrb_fixnum(a) < mrb_fixnum(b));
+    }
+    x = mrb_fixnum_p(a) ? (mrb_float)mrb_fixnum(a) : mrb_float(a);
+    y = mrb_fixnum_p(b) ? (mrb_float)mrb_fixnum(b) : mrb_float(b);
+    if (x > y) return 1;
+    if (x < y) return -1;
+    if (x == y) return 0;
+    break;                      /* NaN */
+  case SORT_STRING:
+    return mrb_str_cmp(mrb, a, b);
+  default:
+    ai = mrb_gc_arena_save(mrb);
+    c = mrb_funcall(mrb, a, "<=>", 1, b);
+    mrb_gc_arena_restore(mrb, ai);
+    if (mrb_fixnum_p(c)) {
+      return (mrb_fixnum(c) > 0) - (mrb_fixnum(c) < 0);
+    }
+    if (mrb_float_p(c)) {
+      return (mrb_float(c) > 0) - (mrb_float(c) < 0);
+    }
+    break;
+  }
+  mrb_raisef(mrb, E_ARGUMENT_ERROR, "comparison of %S with %S failed",
+             mrb_obj_value(mrb_obj_class(mrb, a)), mrb_obj_value(mrb_obj_class(mrb, b)));
+  return 0;                     /* not reached */
+}
+
+/*
+ * Stable merge sort of the index permutation +perm+ by +keys+.
+ * Short runs are insertion sorted first, and a merge is skipped
+ * when its two halves are already in order, so sorted and nearly
+ * sorted input costs about n comparisons.
+ */
+static void
+sort_perm(mrb_state *mrb, enum sort_kind kind, const mrb_value *keys, mrb_int *perm, mrb_int *work, mrb_int len)
+{
+  mrb_int *src = perm, *dst = work, *t;
+  mrb_int width, lo, mid, hi, i, j, k, v;
+
+  for (lo = 0; lo < len; lo += SORT_RUN) {
+    hi = (lo + SORT_RUN < len) ? lo + SORT_RUN : len;
+    for (i = lo + 1; i < hi; i++) {
+      v = perm[i];
+      for (j = i; j > lo && sort_cmp(mrb, kind, keys[perm[j-1]], keys[v]) > 0; j--) {
+        perm[j] = perm[j-1];
+      }
+      perm[j] = v;
+    }
+  }
+  for (width = SORT_RUN; width < len; width *= 2) {
+    for (lo = 0; lo < len; lo += 2 * width) {
+      mid = (lo + width < len) ? lo + width : len;
+      hi = (mid + width < len) ? mid + width : len;
+      if (mid == hi || sort_cmp(mrb, kind, keys[src[mid-1]], keys[src[mid]]) <= 0) {
+        for (k = lo; k < hi; k++) dst[k] = src[k];
+        continue;
+      }
+      i = lo; j = mid; k = lo;
+      while (i < mid && j < hi) {
+        if (sort_cmp(mrb, kind, keys[src[j]], keys[src[i]]) < 0) {
+          dst[k++] = src[j++];
+        }
+        else {
+          dst[k++] = src[i++];
+        }
+      }
+      while (i < mid) dst[k++] = src[i++];
+      while (j < hi) dst[k++] = src[j++];
+    }
+    t = src; src = dst; dst = t;
+  }
+  if (src != perm) {
+    for (k = 0; k < len; k++) perm[k] = src[k];
+  }
+}
+
+/*
+ *  call-seq:
+ *     ary.__ary_sort(keys)   -> ary
+ *
+ *  Sorts +ary+ in place by the corresponding elements of +keys+
+ *  (which may be +ary+ itself).  Fixnum/Float and String keys are
+ *  compared directly; anything else goes through <code><=></code>.
+ *  Used by Array#sort, Enumerable#sort and Enumerable#sort_by.
+ */
+static mrb_value
+mrb_ary_sort_by_keys(mrb_state *mrb, mrb_value self)
+{
+  mrb_value keys, vals, buf;
+  mrb_value *kp, *vp;
+  mrb_int len, i, *perm;
+
+  mrb_get_args(mrb, "A", &keys);
+  len = RARRAY_LEN(self);
+  if (RARRAY_LEN(keys) != len) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "sort keys size mismatch");
+  }
+  if (len < 2) return self;
+  if ((size_t)len > SIZE_MAX / sizeof(mrb_int) / 2) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
+  }
+
+  /* private copies: <=> may modify the receiver while we sort */
+  keys = mrb_ary_new_from_values(mrb, len, RARRAY_PTR(keys));
+  vals = mrb_ary_new_from_values(mrb, len, RARRAY_PTR(self));
+  buf = mrb_str_buf_new(mrb, sizeof(mrb_int) * len * 2);
+  perm = (mrb_int*)RSTRING_PTR(buf);
+  for (i = 0; i < len; i++) {
+    perm[i] = i;
+  }
+  kp = RARRAY_PTR(keys);
+  sort_perm(mrb, sort_kind_of(mrb, kp, len), kp, perm, perm + len, len);
+
+  vp = RARRAY_PTR(vals);
+  for (i = 0; i < len; i++) {
+    kp[i] = vp[perm[i]];
+  }
+  ary_replace(mrb, mrb_ary_ptr(self), kp, len);
+  return self;
+}
+
 void
 mrb_init_array(mrb_state *mrb)
 {
@@ -1088,13 +1374,13 @@ mrb_init_array(mrb_state *mrb)
   mrb_define_method(mrb, a, "clear",           mrb_ary_clear,        MRB_ARGS_NONE()); /* 15.2.12.5.6  */
   mrb_define_method(mrb, a, "concat",          mrb_ary_concat_m,     MRB_ARGS_REQ(1)); /* 15.2.12.5.8  */
   mrb_define_method(mrb, a, "delete_at",       mrb_ary_delete_at,    MRB_ARGS_REQ(1)); /* 15.2.12.5.9  */
-  mrb_define_method(mrb, a, "empty?",          mrb_ary_empty_p,      MRB_ARGS_NONE()); /* 15.2.12.5.12 */
+  mrb_define_method(mrb, a, "empty?",          mrb_ary_empty_p,      MRB_ARGS_LEAF()); /* 15.2.12.5.12 */
   mrb_define_method(mrb, a, "first",           mrb_ary_first,        MRB_ARGS_OPT(1)); /* 15.2.12.5.13 */
   mrb_define_method(mrb, a, "index",           mrb_ary_index_m,      MRB_ARGS_REQ(1)); /* 15.2.12.5.14 */
   mrb_define_method(mrb, a, "initialize_copy", mrb_ary_replace_m,    MRB_ARGS_REQ(1)); /* 15.2.12.5.16 */
   mrb_define_method(mrb, a, "join",            mrb_ary_join_m,       MRB_ARGS_ANY());  /* 15.2.12.5.17 */
   mrb_define_method(mrb, a, "last",            mrb_ary_last,         MRB_ARGS_ANY());  /* 15.2.12.5.18 */
-  mrb_define_method(mrb, a, "length",          mrb_ary_size,         MRB_ARGS_NONE()); /* 15.2.12.5.19 */
+  mrb_define_method(mrb, a, "length",          mrb_ary_size,         MRB_ARGS_LEAF()); /* 15.2.12.5.19 */
   mrb_define_method(mrb, a, "pop",             mrb_ary_pop,          MRB_ARGS_NONE()); /* 15.2.12.5.21 */
   mrb_define_method(mrb, a, "push",            mrb_ary_push_m,       MRB_ARGS_ANY());  /* 15.2.12.5.22 */
   mrb_define_method(mrb, a, "replace",         mrb_ary_replace_m,    MRB_ARGS_REQ(1)); /* 15.2.12.5.23 */
@@ -1102,10 +1388,11 @@ mrb_init_array(mrb_state *mrb)
   mrb_define_method(mrb, a, "reverse!",        mrb_ary_reverse_bang, MRB_ARGS_NONE()); /* 15.2.12.5.25 */
   mrb_define_method(mrb, a, "rindex",          mrb_ary_rindex_m,     MRB_ARGS_REQ(1)); /* 15.2.12.5.26 */
   mrb_define_method(mrb, a, "shift",           mrb_ary_shift,        MRB_ARGS_NONE()); /* 15.2.12.5.27 */
-  mrb_define_method(mrb, a, "size",            mrb_ary_size,         MRB_ARGS_NONE()); /* 15.2.12.5.28 */
+  mrb_define_method(mrb, a, "size",            mrb_ary_size,         MRB_ARGS_LEAF()); /* 15.2.12.5.28 */
   mrb_define_method(mrb, a, "slice",           mrb_ary_aget,         MRB_ARGS_ANY());  /* 15.2.12.5.29 */
   mrb_define_method(mrb, a, "unshift",         mrb_ary_unshift_m,    MRB_ARGS_ANY());  /* 15.2.12.5.30 */
 
   mrb_define_method(mrb, a, "__ary_eq",        mrb_ary_eq,           MRB_ARGS_REQ(1));
   mrb_define_method(mrb, a, "__ary_cmp",       mrb_ary_cmp,           MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, a, "__ary_sort",      mrb_ary_sort_by_keys,  MRB_ARGS_REQ(1));
 }
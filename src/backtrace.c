@@ -89,8 +89,8 @@ output_backtrace(mrb_state *mrb, mrb_int ciidx, mrb_code *pc0, output_stream_fun
       else {
         pc = pc0;
       }
-      filename = mrb_debug_get_filename(irep, (uint32_t)(pc - irep->iseq));
-      lineno = mrb_debug_get_line(irep, (uint32_t)(pc - irep->iseq));
+      filename = mrb_debug_get_filename(irep, (uint32_t)mrb_iseq_index(irep, pc));
+      lineno = mrb_debug_get_line(irep, (uint32_t)mrb_iseq_index(irep, pc));
     }
     if (lineno == -1) continue;
     if (ci->target_class == ci->proc->target_class)
@@ -15,6 +15,7 @@
 #include "mruby/variable.h"
 #include "mruby/error.h"
 #include "mruby/data.h"
+#include "mruby/gc.h"
 
 KHASH_DEFINE(mt, mrb_sym, struct RProc*, TRUE, kh_int_hash_func, kh_int_hash_equal)
 
@@ -50,6 +51,21 @@ mrb_gc_free_mt(mrb_state *mrb, struct RClass *c)
   kh_destroy(mt, mrb, c->mt);
 }
 
+void
+mrb_gc_copy_mt(mrb_state *mrb, struct RClass *c)
+{
+  khiter_t k;
+  khash_t(mt) *h;
+
+  if (!c->mt) return;
+  h = c->mt = kh_copy(mt, mrb, c->mt);
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      kh_value(h, k) = (struct RProc*)mrb_gc_image_object(mrb, (struct RBasic*)kh_value(h, k));
+    }
+  }
+}
+
 static void
 name_class(mrb_state *mrb, struct RClass *c, mrb_sym name)
 {
@@ -336,6 +352,9 @@ mrb_define_method_id(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_func_t f
   int ai = mrb_gc_arena_save(mrb);
 
   p = mrb_proc_new_cfunc(mrb, func);
+  if (aspec & MRB_ARGS_LEAF()) {
+    p->flags |= MRB_PROC_LEAF;
+  }
   p->target_class = c;
   mrb_define_method_raw(mrb, c, mid, p);
   mrb_gc_arena_restore(mrb, ai);
@@ -437,8 +456,56 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
   if (argc < 0) {
     struct RArray *a = mrb_ary_ptr(mrb->c->stack[1]);
 
-    argc = a->len;
-    sp = a->ptr;
+    argc = ARY_LEN(a);
+    sp = ARY_PTR(a);
+  }
+  else {
+    /* fast path for the most common specs, taken before the generic
+       parser when the arguments are known to match */
+    switch (format[0]) {
+    case '\0':
+      if (argc == 0) goto fast_done;
+      break;
+    case 'o':
+      {
+        /* "o", "oo", "o|i", "oo|o"... with only the leading objects given */
+        const char *f = format;
+
+        while (*f == 'o') f++;
+        if (argc == f - format && (*f == '\0' || (*f == '|' && !strpbrk(f, "?&*")))) {
+          for (; i < argc; i++) {
+            *va_arg(ap, mrb_value*) = sp[i];
+          }
+          goto fast_done;
+        }
+      }
+      break;
+    case 'i':
+      if (format[1] == '\0' && argc == 1 && mrb_fixnum_p(sp[0])) {
+        *va_arg(ap, mrb_int*) = mrb_fixnum(sp[0]);
+        i = 1;
+        goto fast_done;
+      }
+      break;
+    case '*':
+      if (format[1] == '\0') {
+        mrb_value **var = va_arg(ap, mrb_value**);
+
+        *va_arg(ap, mrb_int*) = argc;
+        *var = (argc > 0) ? sp : NULL;
+        i = argc;
+        goto fast_done;
+      }
+      break;
+    case '&':
+      if (format[1] == '\0' && argc == 0) {
+        *va_arg(ap, mrb_value*) = sp[0];
+        goto fast_done;
+      }
+      break;
+    default:
+      break;
+    }
   }
   while ((c = *format++)) {
     switch (c) {
@@ -565,8 +632,8 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         if (i < argc) {
           aa = to_ary(mrb, *sp++);
           a = mrb_ary_ptr(aa);
-          *pb = a->ptr;
-          *pl = a->len;
+          *pb = ARY_PTR(a);
+          *pl = ARY_LEN(a);
           i++;
         }
       }
@@ -718,6 +785,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
   if (!c && argc > i) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments");
   }
+fast_done:
   va_end(ap);
   return i;
 }
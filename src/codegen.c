@@ -6,6 +6,7 @@
 
 #include <ctype.h>
 #include <limits.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include "mruby.h"
@@ -14,6 +15,7 @@
 #include "mruby/numeric.h"
 #include "mruby/string.h"
 #include "mruby/debug.h"
+#include "mruby/khash.h"
 #include "node.h"
 #include "mruby/opcode.h"
 #include "mruby/re.h"
@@ -37,6 +39,29 @@ struct loopinfo {
   struct loopinfo *prev;
 };
 
+struct litinfo {
+  mrb_value str;
+  struct litinfo *next;
+};
+
+static inline khint_t
+lit_hash_func(mrb_state *mrb, mrb_value str)
+{
+  khint_t h = (khint_t)RSTRING_LEN(str);
+  const char *p = RSTRING_PTR(str);
+  mrb_int i;
+
+  for (i=0; i<RSTRING_LEN(str); i++) {
+    h = (h << 5) - h + *p++;
+  }
+  return h;
+}
+#define lit_hash_equal(mrb,a,b) (RSTRING_LEN(a) == RSTRING_LEN(b) &&\
+  memcmp(RSTRING_PTR(a), RSTRING_PTR(b), RSTRING_LEN(a)) == 0)
+
+KHASH_DECLARE(litset, mrb_value, char, FALSE)
+KHASH_DEFINE(litset, mrb_value, char, FALSE, lit_hash_func, lit_hash_equal)
+
 typedef struct scope {
   mrb_state *mrb;
   mrb_pool *mpool;
@@ -51,13 +76,14 @@ typedef struct scope {
   int lastlabel;
   int ainfo:15;
   mrb_bool mscope:1;
+  uint8_t optimize;             /* optimization level (mrbc -O) */
 
   struct loopinfo *loop;
   int ensure_level;
   char const *filename;
   uint16_t lineno;
 
-  mrb_code *iseq;
+  mrb_insn *iseq;
   uint16_t *lines;
   int icapa;
 
@@ -73,6 +99,9 @@ typedef struct scope {
   int debug_start_pos;
   uint16_t filename_index;
   parser_state* parser;
+
+  struct litinfo *lits;         /* long string literals (outermost scope only) */
+  khash_t(litset) *litset;      /* index of lits by content */
 } codegen_scope;
 
 static codegen_scope* scope_new(mrb_state *mrb, codegen_scope *prev, node *lv);
@@ -141,11 +170,12 @@ new_label(codegen_scope *s)
 }
 
 static inline int
-genop(codegen_scope *s, mrb_code i)
+genop(codegen_scope *s, mrb_insn i)
 {
   if (s->pc == s->icapa) {
     s->icapa *= 2;
-    s->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->icapa);
+    s->iseq = (mrb_insn *)codegen_realloc(s, s->iseq, sizeof(mrb_insn)*s->icapa);
+    s->irep->iseq = (mrb_code*)s->iseq;
     if (s->lines) {
       s->lines = (uint16_t*)codegen_realloc(s, s->lines, sizeof(short)*s->icapa);
       s->irep->lines = s->lines;
@@ -162,11 +192,11 @@ genop(codegen_scope *s, mrb_code i)
 #define VAL    1
 
 static int
-genop_peep(codegen_scope *s, mrb_code i, int val)
+genop_peep(codegen_scope *s, mrb_insn i, int val)
 {
   /* peephole optimization */
   if (s->lastlabel != s->pc && s->pc > 0) {
-    mrb_code i0 = s->iseq[s->pc-1];
+    mrb_insn i0 = s->iseq[s->pc-1];
     int c1 = GET_OPCODE(i);
     int c0 = GET_OPCODE(i0);
 
@@ -351,7 +381,7 @@ static inline void
 dispatch(codegen_scope *s, int pc)
 {
   int diff = s->pc - pc;
-  mrb_code i = s->iseq[pc];
+  mrb_insn i = s->iseq[pc];
   int c = GET_OPCODE(i);
 
   s->lastlabel = s->pc;
@@ -374,7 +404,7 @@ dispatch(codegen_scope *s, int pc)
 static void
 dispatch_linked(codegen_scope *s, int pc)
 {
-  mrb_code i;
+  mrb_insn i;
   int pos;
 
   if (!pc) return;
@@ -404,6 +434,37 @@ push_(codegen_scope *s)
 #define pop_n(n) (s->sp-=(n))
 #define cursp() (s->sp)
 
+/* string literals too long to be embedded share one buffer per
+   distinct value across the whole compilation unit */
+static mrb_value
+str_pool(codegen_scope *s, mrb_value str)
+{
+  codegen_scope *root = s;
+  struct litinfo *li;
+  khiter_t k;
+
+  if (RSTRING_LEN(str) <= RSTRING_EMBED_LEN_MAX) {
+    return mrb_str_pool(s->mrb, str);
+  }
+  while (root->prev) {
+    root = root->prev;
+  }
+  if (!root->litset) {
+    root->litset = kh_init(litset, s->mrb);
+  }
+  k = kh_get(litset, s->mrb, root->litset, str);
+  if (k != kh_end(root->litset)) {
+    return mrb_str_pool(s->mrb, kh_key(root->litset, k));
+  }
+  li = (struct litinfo *)mrb_pool_alloc(root->mpool, sizeof(struct litinfo));
+  if (!li) codegen_error(s, "pool memory allocation");
+  li->str = mrb_str_pool(s->mrb, str);
+  li->next = root->lits;
+  root->lits = li;
+  kh_put(litset, s->mrb, root->litset, li->str);
+  return li->str;
+}
+
 static inline int
 new_lit(codegen_scope *s, mrb_value val)
 {
@@ -451,7 +512,7 @@ new_lit(codegen_scope *s, mrb_value val)
 
   switch (mrb_type(val)) {
   case MRB_TT_STRING:
-    *pv = mrb_str_pool(s->mrb, val);
+    *pv = str_pool(s, val);
     break;
 
   case MRB_TT_FLOAT:
@@ -546,7 +607,7 @@ for_body(codegen_scope *s, node *tree)
   int idx;
   struct loopinfo *lp;
   node *n2;
-  mrb_code c;
+  mrb_insn c;
 
   /* generate receiver */
   codegen(s, tree->cdr->car, VAL);
@@ -586,7 +647,7 @@ for_body(codegen_scope *s, node *tree)
 static int
 lambda_body(codegen_scope *s, node *tree, int blk)
 {
-  mrb_code c;
+  mrb_insn c;
   codegen_scope *parent = s;
   s = scope_new(s->mrb, s, tree->car);
   s->mscope = !blk;
@@ -1131,6 +1192,145 @@ readint_mrb_int(codegen_scope *s, const char *p, int base, mrb_bool neg, mrb_boo
   return result;
 }
 
+static mrb_bool const_call(codegen_scope *s, node *tree, mrb_value *v);
+
+/* value of a literal operand for constant folding (-O2) */
+static mrb_bool
+const_value(codegen_scope *s, node *tree, mrb_value *v)
+{
+  mrb_bool overflow;
+
+  switch ((intptr_t)tree->car) {
+  case NODE_INT:
+    tree = tree->cdr;
+    *v = mrb_fixnum_value(readint_mrb_int(s, (char*)tree->car, (intptr_t)tree->cdr->car, FALSE, &overflow));
+    return !overflow;
+
+  case NODE_FLOAT:
+    *v = mrb_float_value(s->mrb, str_to_mrb_float((char*)tree->cdr));
+    return TRUE;
+
+  case NODE_NEGATE:
+    tree = tree->cdr;
+    switch ((intptr_t)tree->car) {
+    case NODE_INT:
+      tree = tree->cdr;
+      *v = mrb_fixnum_value(readint_mrb_int(s, (char*)tree->car, (intptr_t)tree->cdr->car, TRUE, &overflow));
+      return !overflow;
+    case NODE_FLOAT:
+      *v = mrb_float_value(s->mrb, -str_to_mrb_float((char*)tree->cdr));
+      return TRUE;
+    default:
+      return FALSE;
+    }
+
+  case NODE_STR:
+    tree = tree->cdr;
+    *v = mrb_str_new(s->mrb, (char*)tree->car, (intptr_t)tree->cdr);
+    return TRUE;
+
+  case NODE_BEGIN:
+    tree = tree->cdr;
+    if (!tree || tree->cdr) return FALSE;
+    return const_value(s, tree->car, v);
+
+  case NODE_CALL:
+    return const_call(s, tree->cdr, v);
+
+  default:
+    return FALSE;
+  }
+}
+
+/* folds a binary operator call on literals.  Numeric operators give
+   what OP_ADD, OP_SUB, OP_MUL and OP_DIV would, which do not look at
+   redefined methods anyway; String#+ is assumed not to be redefined. */
+static mrb_bool
+const_call(codegen_scope *s, node *tree, mrb_value *v)
+{
+  node *args = tree->cdr->cdr->car;
+  mrb_value x, y;
+  mrb_float a, b, f;
+  mrb_int len;
+  const char *name;
+
+  if (!args || args->cdr || !args->car || args->car->cdr) return FALSE;
+  name = mrb_sym2name_len(s->mrb, sym(tree->cdr->car), &len);
+  if (len != 1) return FALSE;
+  if (!const_value(s, tree->car, &x) || !const_value(s, args->car->car, &y)) return FALSE;
+
+  if (mrb_string_p(x) || mrb_string_p(y)) {
+    if (name[0] != '+' || !mrb_string_p(x) || !mrb_string_p(y)) return FALSE;
+    *v = mrb_str_plus(s->mrb, x, y);
+    return TRUE;
+  }
+  if (mrb_fixnum_p(x) && mrb_fixnum_p(y)) {
+    switch (name[0]) {
+    case '+':
+      *v = mrb_fixnum_plus(s->mrb, x, y);
+      return TRUE;
+    case '-':
+      *v = mrb_fixnum_minus(s->mrb, x, y);
+      return TRUE;
+    case '*':
+      *v = mrb_fixnum_mul(s->mrb, x, y);
+      return TRUE;
+    }
+  }
+  a = mrb_fixnum_p(x) ? (mrb_float)mrb_fixnum(x) : mrb_float(x);
+  b = mrb_fixnum_p(y) ? (mrb_float)mrb_fixnum(y) : mrb_float(y);
+  switch (name[0]) {
+  case '+': f = a + b; break;
+  case '-': f = a - b; break;
+  case '*': f = a * b; break;
+  case '/': f = a / b; break;
+  default: return FALSE;
+  }
+  if (!isfinite(f)) return FALSE;
+  *v = mrb_float_value(s->mrb, f);
+  return TRUE;
+}
+
+static void
+gen_const(codegen_scope *s, mrb_value v)
+{
+  if (mrb_fixnum_p(v) && mrb_fixnum(v) < MAXARG_sBx && mrb_fixnum(v) > -MAXARG_sBx) {
+    genop(s, MKOP_AsBx(OP_LOADI, cursp(), mrb_fixnum(v)));
+  }
+  else {
+    int off = new_lit(s, v);
+
+    genop(s, MKOP_ABx(mrb_string_p(v) ? OP_STRING : OP_LOADL, cursp(), off));
+  }
+  push();
+}
+
+/* receiverless `raise'; code after it is not generated at -O2 */
+static mrb_bool
+raise_p(codegen_scope *s, node *tree)
+{
+  mrb_sym mid;
+
+  if ((intptr_t)tree->car != NODE_FCALL) return FALSE;
+  mid = sym(tree->cdr->cdr->car);
+  return mid == mrb_intern_lit(s->mrb, "raise") || mid == mrb_intern_lit(s->mrb, "fail");
+}
+
+/* truth value of a literal condition; -1 if unknown */
+static int
+const_cond(node *tree)
+{
+  switch ((intptr_t)tree->car) {
+  case NODE_TRUE: case NODE_INT: case NODE_FLOAT:
+  case NODE_STR: case NODE_SYM:
+    return 1;
+  case NODE_FALSE: case NODE_NIL:
+    return 0;
+  default:
+    return -1;
+  }
+}
+
 static void
 codegen(codegen_scope *s, node *tree, int val)
 {
@@ -1156,6 +1356,10 @@ codegen(codegen_scope *s, node *tree, int val)
       push();
     }
     while (tree) {
+      if (s->optimize > 1 && tree->cdr && raise_p(s, tree->car)) {
+        codegen(s, tree->car, val);
+        break;
+      }
       codegen(s, tree->car, tree->cdr ? NOVAL : val);
       tree = tree->cdr;
     }
@@ -1287,6 +1491,19 @@ codegen(codegen_scope *s, node *tree, int val)
       int pos1, pos2;
       node *e = tree->cdr->cdr->car;
 
+      if (s->optimize > 0 && tree->car && const_cond(tree->car) >= 0) {
+        /* branch on a literal */
+        node *n = const_cond(tree->car) ? tree->cdr->car : e;
+
+        if (n) {
+          codegen(s, n, val);
+        }
+        else if (val) {
+          genop(s, MKOP_A(OP_LOADNIL, cursp()));
+          push();
+        }
+        break;
+      }
       codegen(s, tree->car, VAL);
       pop();
       pos1 = genop_peep(s, MKOP_AsBx(OP_JMPNOT, cursp(), 0), NOVAL);
@@ -1445,6 +1662,17 @@ codegen(codegen_scope *s, node *tree, int val)
 
   case NODE_FCALL:
   case NODE_CALL:
+    if (val && s->optimize > 1 && nt == NODE_CALL) {
+      int ai = mrb_gc_arena_save(s->mrb);
+      mrb_value v;
+
+      if (const_call(s, tree, &v)) {
+        gen_const(s, v);
+        mrb_gc_arena_restore(s->mrb, ai);
+        break;
+      }
+      mrb_gc_arena_restore(s->mrb, ai);
+    }
     gen_call(s, tree, 0, 0, val);
     break;
 
@@ -1765,7 +1993,7 @@ codegen(codegen_scope *s, node *tree, int val)
       }
       pop_n(n+1);
       if (sendv) n = CALL_MAXARGS;
-      genop(s, MKOP_ABC(OP_SEND, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "call")), n));
+      genop(s, MKOP_ABC(OP_YIELD, cursp(), new_msym(s, mrb_intern_lit(s->mrb, "call")), n));
       if (val) push();
     }
     break;
@@ -1953,7 +2181,7 @@ codegen(codegen_scope *s, node *tree, int val)
       char *p = (char*)tree->car;
       int base = (intptr_t)tree->cdr->car;
       mrb_int i;
-      mrb_code co;
+      mrb_insn co;
       mrb_bool overflow;
 
       i = readint_mrb_int(s, p, base, FALSE, &overflow);
@@ -2009,7 +2237,7 @@ codegen(codegen_scope *s, node *tree, int val)
           char *p = (char*)tree->car;
           int base = (intptr_t)tree->cdr->car;
           mrb_int i;
-          mrb_code co;
+          mrb_insn co;
           mrb_bool overflow;
 
           i = readint_mrb_int(s, p, base, TRUE, &overflow);
@@ -2486,8 +2714,8 @@ scope_new(mrb_state *mrb, codegen_scope *prev, node *lv)
   p->irep->reps = (mrb_irep**)mrb_malloc(mrb, sizeof(mrb_irep*)*p->rcapa);
 
   p->icapa = 1024;
-  p->iseq = (mrb_code*)mrb_malloc(mrb, sizeof(mrb_code)*p->icapa);
-  p->irep->iseq = p->iseq;
+  p->iseq = (mrb_insn*)mrb_malloc(mrb, sizeof(mrb_insn)*p->icapa);
+  p->irep->iseq = (mrb_code*)p->iseq;
 
   p->pcapa = 32;
   p->irep->pool = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value)*p->pcapa);
@@ -2536,10 +2764,230 @@ scope_new(mrb_state *mrb, codegen_scope *prev, node *lv)
   }
   p->parser = prev->parser;
   p->filename_index = prev->filename_index;
+  p->optimize = prev->optimize;
 
   return p;
 }
 
+/* instruction flags for optimize_iseq() */
+#define ISEQ_REACHED 1
+#define ISEQ_LABEL   2
+#define ISEQ_TABLE   4          /* jump table after OP_ENTER */
+#define ISEQ_DROP    8
+
+/* follows a jump through OP_JMP and through conditional jumps on the
+   same register, whose outcome is already known */
+static int
+jump_target(mrb_insn *iseq, int len, int pc)
+{
+  mrb_insn c = iseq[pc];
+  int op = GET_OPCODE(c);
+  int t = pc + GETARG_sBx(c);
+  int n;
+
+  for (n=0; n<len && t>=0 && t<len; n++) {
+    mrb_insn c2 = iseq[t];
+    int op2 = GET_OPCODE(c2);
+
+    if (op2 == OP_JMP && GETARG_sBx(c2) != 0) {
+      t += GETARG_sBx(c2);
+    }
+    else if (op != OP_JMP && (op2 == OP_JMPIF || op2 == OP_JMPNOT) &&
+             GETARG_A(c2) == GETARG_A(c)) {
+      t += (op2 == op) ? GETARG_sBx(c2) : 1;
+    }
+    else {
+      break;
+    }
+  }
+  return t;
+}
+
+static void
+iseq_reach(codegen_scope *s, uint8_t *flags, int *stack)
+{
+  mrb_insn *iseq = s->iseq;
+  int len = s->pc;
+  int sp = 0;
+
+  memset(flags, 0, len);
+  flags[0] = ISEQ_REACHED;
+  stack[sp++] = 0;
+  while (sp > 0) {
+    int pc = stack[--sp];
+    mrb_insn c = iseq[pc];
+    int next[3], n = 0, i;
+
+    switch (GET_OPCODE(c)) {
+    case OP_JMP:
+      next[n++] = pc + GETARG_sBx(c);
+      break;
+    case OP_JMPIF:
+    case OP_JMPNOT:
+    case OP_ONERR:
+      next[n++] = pc + GETARG_sBx(c);
+      next[n++] = pc + 1;
+      break;
+    case OP_ENTER:
+      next[n++] = pc + 1;
+      if (MRB_ASPEC_OPT(GETARG_Ax(c)) > 0) {
+        for (i=1; i<=MRB_ASPEC_OPT(GETARG_Ax(c))+1 && pc+i<len; i++) {
+          flags[pc+i] |= ISEQ_TABLE|ISEQ_LABEL;
+          if (!(flags[pc+i] & ISEQ_REACHED)) {
+            flags[pc+i] |= ISEQ_REACHED;
+            stack[sp++] = pc+i;
+          }
+        }
+      }
+      break;
+    case OP_RETURN:
+    case OP_TAILCALL:
+    case OP_STOP:
+    case OP_RAISE:
+    case OP_ERR:
+      break;
+    default:
+      next[n++] = pc + 1;
+      break;
+    }
+    for (i=0; i<n; i++) {
+      int t = next[i];
+
+      if (t < 0 || t >= len) continue;
+      if (i == 0 && t != pc + 1) flags[t] |= ISEQ_LABEL;
+      if (!(flags[t] & ISEQ_REACHED)) {
+        flags[t] |= ISEQ_REACHED;
+        stack[sp++] = t;
+      }
+    }
+  }
+}
+
+/* -O1 pass over the finished iseq: jump threading, removal of
+   unreachable code, of jumps to the next instruction and of redundant
+   OP_MOVE; repeated while the code keeps shrinking */
+static void
+optimize_iseq(codegen_scope *s)
+{
+  mrb_insn *iseq = s->iseq;
+  int len = s->pc;
+  uint8_t *flags = (uint8_t*)codegen_palloc(s, len);
+  int *tmp = (int*)codegen_palloc(s, sizeof(int)*(len+1));
+  int pass, pc, t;
+
+  for (pass=0; pass<8 && len>0; pass++) {
+    mrb_bool changed = FALSE;
+    int n;
+
+    for (pc=0; pc<len; pc++) {
+      mrb_insn c = iseq[pc];
+      int op = GET_OPCODE(c);
+
+      if (op != OP_JMP && op != OP_JMPIF && op != OP_JMPNOT) continue;
+      t = jump_target(iseq, len, pc);
+      if (t != pc + GETARG_sBx(c) && t-pc >= -MAXARG_sBx && t-pc <= MAXARG_sBx) {
+        iseq[pc] = MKOP_AsBx(op, GETARG_A(c), t-pc);
+        changed = TRUE;
+      }
+    }
+
+    iseq_reach(s, flags, tmp);
+
+    for (pc=0; pc<len; pc++) {
+      mrb_insn c = iseq[pc];
+
+      if (!(flags[pc] & ISEQ_REACHED)) {
+        changed = TRUE;
+        continue;
+      }
+      if (flags[pc] & ISEQ_DROP) continue;
+      switch (GET_OPCODE(c)) {
+      case OP_JMP:
+        if (flags[pc] & ISEQ_TABLE) break;
+        t = pc + GETARG_sBx(c);
+        if (GET_OPCODE(iseq[t]) == OP_RETURN || GET_OPCODE(iseq[t]) == OP_RAISE) {
+          /* jump to return */
+          iseq[pc] = iseq[t];
+          changed = TRUE;
+          break;
+        }
+        /* fall through */
+      case OP_JMPIF:
+      case OP_JMPNOT:
+        if (flags[pc] & ISEQ_TABLE) break;
+        t = pc + GETARG_sBx(c);
+        if (t <= pc) break;
+        for (n=pc+1; n<t; n++) {
+          if ((flags[n] & (ISEQ_REACHED|ISEQ_DROP)) == ISEQ_REACHED) break;
+        }
+        if (n == t) {
+          /* jump to the next instruction */
+          flags[pc] |= ISEQ_DROP;
+          changed = TRUE;
+        }
+        break;
+      case OP_MOVE:
+        if (GETARG_A(c) == GETARG_B(c)) {
+          flags[pc] |= ISEQ_DROP;
+          changed = TRUE;
+          break;
+        }
+        if (pc+1 < len && GET_OPCODE(iseq[pc+1]) == OP_MOVE &&
+            (flags[pc+1] & (ISEQ_REACHED|ISEQ_DROP)) == ISEQ_REACHED) {
+          mrb_insn c2 = iseq[pc+1];
+
+          if (GETARG_A(c2) == GETARG_A(c) && GETARG_B(c2) != GETARG_A(c)) {
+            /* R(A) overwritten before use */
+            flags[pc] |= ISEQ_DROP;
+            changed = TRUE;
+          }
+          else if (GETARG_A(c2) == GETARG_B(c) && GETARG_B(c2) == GETARG_A(c) &&
+                   !(flags[pc+1] & ISEQ_LABEL)) {
+            /* moving back */
+            flags[pc+1] |= ISEQ_DROP;
+            changed = TRUE;
+          }
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    if (!changed) break;
+
+    /* compaction; tmp[pc] is the new position of pc, or of the next
+       remaining instruction for the dropped ones */
+    n = 0;
+    for (pc=0; pc<len; pc++) {
+      tmp[pc] = n;
+      if ((flags[pc] & (ISEQ_REACHED|ISEQ_DROP)) == ISEQ_REACHED) n++;
+    }
+    tmp[len] = n;
+    for (pc=0; pc<len; pc++) {
+      mrb_insn c = iseq[pc];
+
+      if ((flags[pc] & (ISEQ_REACHED|ISEQ_DROP)) != ISEQ_REACHED) continue;
+      switch (GET_OPCODE(c)) {
+      case OP_JMP:
+      case OP_JMPIF:
+      case OP_JMPNOT:
+      case OP_ONERR:
+        t = tmp[pc + GETARG_sBx(c)];
+        c = MKOP_AsBx(GET_OPCODE(c), GETARG_A(c), t - tmp[pc]);
+        break;
+      default:
+        break;
+      }
+      iseq[tmp[pc]] = c;
+      if (s->lines) {
+        s->lines[tmp[pc]] = s->lines[pc];
+      }
+    }
+    len = n;
+  }
+  s->pc = len;
+}
+
 static void
 scope_finish(codegen_scope *s)
 {
@@ -2550,8 +2998,25 @@ scope_finish(codegen_scope *s)
 
   irep->flags = 0;
   if (s->iseq) {
+    if (s->optimize > 0 && s->debug_start_pos == 0) {
+      optimize_iseq(s);
+    }
+#ifdef MRB_COMPACT_ISEQ
+    {
+      size_t len;
+      uint8_t *bin = mrb_iseq_encode(mrb, s->iseq, s->pc, &len);
+
+      if (!bin) {
+        codegen_error(s, "too long jump for compact iseq");
+      }
+      mrb_free(mrb, s->iseq);
+      irep->iseq = bin;
+      irep->ilen = len;
+    }
+#else
     irep->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->pc);
     irep->ilen = s->pc;
+#endif
     if (s->lines) {
       irep->lines = (uint16_t *)codegen_realloc(s, s->lines, sizeof(uint16_t)*s->pc);
     }
@@ -2671,7 +3136,7 @@ print_r(mrb_state *mrb, mrb_irep *irep, size_t n, int pre)
 #define RAB 3
 
 static void
-print_lv(mrb_state *mrb, mrb_irep *irep, mrb_code c, int r)
+print_lv(mrb_state *mrb, mrb_irep *irep, mrb_insn c, int r)
 {
   int pre = 0;
 
@@ -2698,15 +3163,25 @@ codedump(mrb_state *mrb, mrb_irep *irep)
 #ifdef ENABLE_STDIO
   int i;
   int ai;
-  mrb_code c;
+  mrb_insn c;
+  mrb_insn *iseq;
+  size_t ilen;
   const char *file = NULL, *next_file;
   int32_t line;
 
   if (!irep) return;
+#ifdef MRB_COMPACT_ISEQ
+  /* shown in the packed form, jumps counting instructions */
+  iseq = mrb_iseq_decode(mrb, irep->iseq, irep->ilen, &ilen);
+  if (!iseq) return;
+#else
+  iseq = irep->iseq;
+  ilen = irep->ilen;
+#endif
   printf("irep %p nregs=%d nlocals=%d pools=%d syms=%d reps=%d\n", irep,
          irep->nregs, irep->nlocals, (int)irep->plen, (int)irep->slen, (int)irep->rlen);
 
-  for (i = 0; i < (int)irep->ilen; i++) {
+  for (i = 0; i < (int)ilen; i++) {
     ai = mrb_gc_arena_save(mrb);
 
     next_file = mrb_debug_get_filename(irep, i);
@@ -2723,7 +3198,7 @@ codedump(mrb_state *mrb, mrb_irep *irep)
     }
 
     printf("%03d ", i);
-    c = irep->iseq[i];
+    c = iseq[i];
     switch (GET_OPCODE(c)) {
     case OP_NOP:
       printf("OP_NOP\n");
@@ -2849,6 +3324,17 @@ codedump(mrb_state *mrb, mrb_irep *irep)
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
              GETARG_C(c));
       break;
+    case OP_YIELD:
+      if (irep->syms[GETARG_B(c)]) {
+        printf("OP_YIELD\tR%d\t:%s\t%d\n", GETARG_A(c),
+               mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+               GETARG_C(c));
+      }
+      else {
+        /* the top level of mrbc -j calls the files without a name */
+        printf("OP_YIELD\tR%d\t\t%d\n", GETARG_A(c), GETARG_C(c));
+      }
+      break;
     case OP_TAILCALL:
       printf("OP_TAILCALL\tR%d\t:%s\t%d\n", GETARG_A(c),
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
@@ -3074,6 +3560,9 @@ codedump(mrb_state *mrb, mrb_irep *irep)
     mrb_gc_arena_restore(mrb, ai);
   }
   printf("\n");
+#ifdef MRB_COMPACT_ISEQ
+  mrb_free(mrb, iseq);
+#endif
 #endif
 }
 
@@ -3082,6 +3571,7 @@ codedump_recur(mrb_state *mrb, mrb_irep *irep)
 {
   size_t i;
 
+  if (MRB_IREP_LAZY_P(irep)) mrb_irep_load_lazy(mrb, irep);
   codedump(mrb, irep);
   for (i=0; i<irep->rlen; i++) {
     codedump_recur(mrb, irep->reps[i]);
@@ -3107,12 +3597,14 @@ mrb_generate_code(mrb_state *mrb, parser_state *p)
   scope->parser = p;
   scope->filename = p->filename;
   scope->filename_index = p->current_filename_index;
+  scope->optimize = p->optimize;
 
   MRB_TRY(&scope->jmp) {
     /* prepare irep */
     codegen(scope, p->tree, NOVAL);
     proc = mrb_proc_new(mrb, scope->irep);
     mrb_irep_decref(mrb, scope->irep);
+    if (scope->litset) kh_destroy(litset, mrb, scope->litset);
     mrb_pool_close(scope->mpool);
     return proc;
   }
@@ -3121,6 +3613,7 @@ mrb_generate_code(mrb_state *mrb, parser_state *p)
       scope->irep->filename = NULL;
     }
     mrb_irep_decref(mrb, scope->irep);
+    if (scope->litset) kh_destroy(litset, mrb, scope->litset);
     mrb_pool_close(scope->mpool);
     return NULL;
   }
@@ -9,7 +9,7 @@ get_file(mrb_irep_debug_info *info, uint32_t pc)
   mrb_irep_debug_info_file **ret;
   int32_t count;
 
-  if (pc >= info->pc_count) { return NULL; }
+  if (pc >= info->pc_count || info->flen == 0) { return NULL; }
   /* get upper bound */
   ret = info->files;
   count =  info->flen;
@@ -54,6 +54,7 @@ mrb_debug_get_filename(mrb_irep *irep, uint32_t pc)
 {
   if (irep && pc < irep->ilen) {
     mrb_irep_debug_info_file* f = NULL;
+    if (irep->lazy) mrb_irep_load_debug(irep);
     if (!irep->debug_info) { return irep->filename; }
     else if ((f = get_file(irep->debug_info, pc))) {
       return f->filename;
@@ -67,6 +68,7 @@ mrb_debug_get_line(mrb_irep *irep, uint32_t pc)
 {
   if (irep && pc < irep->ilen) {
     mrb_irep_debug_info_file* f = NULL;
+    if (irep->lazy) mrb_irep_load_debug(irep);
     if (!irep->debug_info) {
       return irep->lines? irep->lines[pc] : -1;
     }
@@ -198,6 +200,35 @@ mrb_debug_info_append_file(mrb_state *mrb, mrb_irep *irep,
   return ret;
 }
 
+mrb_irep_debug_info *
+mrb_debug_info_dup(mrb_state *mrb, const mrb_irep_debug_info *d)
+{
+  mrb_irep_debug_info *ret;
+  mrb_irep_debug_info_file *f;
+  size_t size;
+  uint16_t i;
+
+  ret = (mrb_irep_debug_info *)mrb_malloc(mrb, sizeof(*ret));
+  *ret = *d;
+  ret->files = NULL;
+  if (d->flen > 0) {
+    ret->files = (mrb_irep_debug_info_file**)mrb_malloc(mrb, sizeof(mrb_irep_debug_info_file*) * d->flen);
+  }
+  for (i = 0; i < d->flen; ++i) {
+    f = (mrb_irep_debug_info_file *)mrb_malloc(mrb, sizeof(*f));
+    *f = *d->files[i];
+    size = f->line_type == mrb_debug_line_ary ? sizeof(uint16_t) : sizeof(mrb_irep_debug_info_line);
+    size *= f->line_entry_count;
+    f->lines.ptr = NULL;
+    if (size > 0) {
+      f->lines.ptr = mrb_malloc(mrb, size);
+      memcpy(f->lines.ptr, d->files[i]->lines.ptr, size);
+    }
+    ret->files[i] = f;
+  }
+  return ret;
+}
+
 void
 mrb_debug_info_free(mrb_state *mrb, mrb_irep_debug_info *d)
 {
@@ -12,10 +12,11 @@
 #include "mruby/irep.h"
 #include "mruby/numeric.h"
 #include "mruby/debug.h"
+#include "dump_util.h"
 
 #ifdef ENABLE_STDIO
 
-static size_t get_irep_record_size_1(mrb_state *mrb, mrb_irep *irep);
+static size_t get_irep_record_size_1(mrb_state *mrb, mrb_irep *irep, size_t pos);
 
 #if UINT32_MAX > SIZE_MAX
 # error This code cannot be built on your environment.
@@ -33,11 +34,11 @@ get_irep_header_size(mrb_state *mrb)
 }
 
 static ptrdiff_t
-write_irep_header(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_irep_header(mrb_state *mrb, mrb_irep *irep, uint8_t *buf, size_t pos)
 {
   uint8_t *cur = buf;
 
-  cur += uint32_to_bin(get_irep_record_size_1(mrb, irep), cur);  /* record size */
+  cur += uint32_to_bin(get_irep_record_size_1(mrb, irep, pos), cur);  /* record size */
   cur += uint16_to_bin((uint16_t)irep->nlocals, cur);  /* number of local variable */
   cur += uint16_to_bin((uint16_t)irep->nregs, cur);  /* number of register variable */
   cur += uint16_to_bin((uint16_t)irep->rlen, cur);  /* number of child irep */
@@ -47,26 +48,50 @@ write_irep_header(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
 
 
 static size_t
-get_iseq_block_size(mrb_state *mrb, mrb_irep *irep)
+get_iseq_block_size(mrb_state *mrb, mrb_irep *irep, size_t pos)
 {
   size_t size = 0;
 
   size += sizeof(uint32_t); /* ilen */
+#ifdef MRB_COMPACT_ISEQ
+  size += irep->ilen; /* iseq(n) */
+#else
+  size += iseq_padding(pos + size); /* padding */
   size += sizeof(uint32_t) * irep->ilen; /* iseq(n) */
+#endif
 
   return size;
 }
 
 static ptrdiff_t
-write_iseq_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_iseq_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf, size_t pos, int flags)
 {
   uint8_t *cur = buf;
+#ifdef MRB_COMPACT_ISEQ
+
+  /* bytes in the compact form do not depend on the byte order */
+  cur += uint32_to_bin(irep->ilen, cur); /* length in bytes */
+  memcpy(cur, irep->iseq, irep->ilen);
+  cur += irep->ilen;
+#else
   uint32_t iseq_no;
 
   cur += uint32_to_bin(irep->ilen, cur); /* number of opcode */
-  for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
-    cur += uint32_to_bin(irep->iseq[iseq_no], cur); /* opcode */
+  cur += iseq_padding(pos + (cur - buf)); /* padding (zero filled) */
+  if ((flags & DUMP_ENDIAN_MASK) == DUMP_ENDIAN_NAT) {
+    flags = bigendian_p() ? DUMP_ENDIAN_BIG : DUMP_ENDIAN_LIL;
+  }
+  if (flags & DUMP_ENDIAN_LIL) {
+    for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
+      cur += uint32l_to_bin(irep->iseq[iseq_no], cur); /* opcode */
+    }
   }
+  else {
+    for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
+      cur += uint32_to_bin(irep->iseq[iseq_no], cur); /* opcode */
+    }
+  }
+#endif
 
   return cur - buf;
 }
@@ -77,8 +102,6 @@ get_pool_block_size(mrb_state *mrb, mrb_irep *irep)
 {
   size_t size = 0;
   size_t pool_no;
-  mrb_value str;
-  char buf[32];
 
   size += sizeof(uint32_t); /* plen */
   size += irep->plen * (sizeof(uint8_t) + sizeof(uint16_t)); /* len(n) */
@@ -88,21 +111,8 @@ get_pool_block_size(mrb_state *mrb, mrb_irep *irep)
 
     switch (mrb_type(irep->pool[pool_no])) {
     case MRB_TT_FIXNUM:
-      str = mrb_fixnum_to_str(mrb, irep->pool[pool_no], 10);
-      {
-        mrb_int len = RSTRING_LEN(str);
-        mrb_assert_int_fit(mrb_int, len, size_t, SIZE_MAX);
-        size += (size_t)len;
-      }
-      break;
-
     case MRB_TT_FLOAT:
-      {
-        int len;
-        len = mrb_float_to_str(buf, mrb_float(irep->pool[pool_no]));
-        mrb_assert_int_fit(mrb_int, len, size_t, SIZE_MAX);
-        size += (size_t)len;
-      }
+      size += MRB_DUMP_POOL_NUM_LEN;
       break;
 
     case MRB_TT_STRING:
@@ -128,9 +138,8 @@ write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
   size_t pool_no;
   uint8_t *cur = buf;
   uint16_t len;
-  mrb_value str;
   const char *char_ptr;
-  char char_buf[30];
+  uint8_t num_buf[MRB_DUMP_POOL_NUM_LEN];
 
   cur += uint32_to_bin(irep->plen, cur); /* number of pool */
 
@@ -140,26 +149,14 @@ write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
     switch (mrb_type(irep->pool[pool_no])) {
     case MRB_TT_FIXNUM:
       cur += uint8_to_bin(IREP_TT_FIXNUM, cur); /* data type */
-      str = mrb_fixnum_to_str(mrb, irep->pool[pool_no], 10);
-      char_ptr = RSTRING_PTR(str);
-      {
-        mrb_int tlen;
-
-        tlen = RSTRING_LEN(str);
-        mrb_assert_int_fit(mrb_int, tlen, uint16_t, UINT16_MAX);
-        len = (uint16_t)tlen;
-      }
+      len = (uint16_t)uint64l_to_bin((uint64_t)(int64_t)mrb_fixnum(irep->pool[pool_no]), num_buf);
+      char_ptr = (const char*)num_buf;
       break;
 
     case MRB_TT_FLOAT:
       cur += uint8_to_bin(IREP_TT_FLOAT, cur); /* data type */
-      {
-        int tlen;
-        tlen = mrb_float_to_str(char_buf, mrb_float(irep->pool[pool_no]));
-        mrb_assert_int_fit(int, tlen, uint16_t, UINT16_MAX);
-        len = (uint16_t)tlen;
-      }
-      char_ptr = &char_buf[0];
+      len = (uint16_t)double_to_bin((double)mrb_float(irep->pool[pool_no]), num_buf);
+      char_ptr = (const char*)num_buf;
       break;
 
     case MRB_TT_STRING:
@@ -237,57 +234,60 @@ write_syms_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
   return cur - buf;
 }
 
+/* pos is the offset of the record from the top of the binary */
 static size_t
-get_irep_record_size_1(mrb_state *mrb, mrb_irep *irep)
+get_irep_record_size_1(mrb_state *mrb, mrb_irep *irep, size_t pos)
 {
   size_t size = 0;
 
   size += get_irep_header_size(mrb);
-  size += get_iseq_block_size(mrb, irep);
+  size += get_iseq_block_size(mrb, irep, pos + size);
   size += get_pool_block_size(mrb, irep);
   size += get_syms_block_size(mrb, irep);
   return size;
 }
 
 static size_t
-get_irep_record_size(mrb_state *mrb, mrb_irep *irep)
+get_irep_record_size(mrb_state *mrb, mrb_irep *irep, size_t pos)
 {
   size_t size = 0;
   size_t irep_no;
 
-  size = get_irep_record_size_1(mrb, irep);
+  size = get_irep_record_size_1(mrb, irep, pos);
   for (irep_no = 0; irep_no < irep->rlen; irep_no++) {
-    size += get_irep_record_size(mrb, irep->reps[irep_no]);
+    size += get_irep_record_size(mrb, irep->reps[irep_no], pos + size);
   }
   return size;
 }
 
 static int
-write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin, size_t *irep_record_size)
+write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t* bin, size_t *irep_record_size, size_t pos, int flags)
 {
   uint32_t i;
+  uint8_t *cur = bin;
 
   if (irep == NULL) {
     return MRB_DUMP_INVALID_IREP;
   }
 
-  *irep_record_size = get_irep_record_size_1(mrb, irep);
+  *irep_record_size = get_irep_record_size_1(mrb, irep, pos);
   if (*irep_record_size == 0) {
     return MRB_DUMP_GENERAL_FAILURE;
   }
 
   memset(bin, 0, *irep_record_size);
 
-  bin += write_irep_header(mrb, irep, bin);
-  bin += write_iseq_block(mrb, irep, bin);
-  bin += write_pool_block(mrb, irep, bin);
-  bin += write_syms_block(mrb, irep, bin);
+  cur += write_irep_header(mrb, irep, cur, pos);
+  cur += write_iseq_block(mrb, irep, cur, pos + (cur - bin), flags);
+  cur += write_pool_block(mrb, irep, cur);
+  cur += write_syms_block(mrb, irep, cur);
+  bin = cur;
 
   for (i = 0; i < irep->rlen; i++) {
     int result;
     size_t rsize;
 
-    result = write_irep_record(mrb, irep->reps[i], bin, &rsize);
+    result = write_irep_record(mrb, irep->reps[i], bin, &rsize, pos + *irep_record_size, flags);
     if (result != MRB_DUMP_OK) {
       return result;
     }
@@ -319,13 +319,17 @@ write_section_irep_header(mrb_state *mrb, size_t section_size, uint8_t *bin)
 
   mrb_assert_int_fit(size_t, section_size, uint32_t, UINT32_MAX);
   uint32_to_bin((uint32_t)section_size, header->section_size);
+#ifdef MRB_COMPACT_ISEQ
+  memcpy(header->rite_version, RITE_VM_VER_COMPACT, sizeof(header->rite_version));
+#else
   memcpy(header->rite_version, RITE_VM_VER, sizeof(header->rite_version));
+#endif
 
   return MRB_DUMP_OK;
 }
 
 static int
-write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin)
+write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, int flags)
 {
   int result;
   size_t section_size = 0; /* size of irep record */
@@ -339,7 +343,7 @@ write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin)
   cur += sizeof(struct rite_section_irep_header);
   section_size += sizeof(struct rite_section_irep_header);
 
-  result = write_irep_record(mrb, irep, cur, &rsize);
+  result = write_irep_record(mrb, irep, cur, &rsize, sizeof(struct rite_binary_header) + section_size, flags);
   if (result != MRB_DUMP_OK) {
     return result;
   }
@@ -372,7 +376,7 @@ get_lineno_record_size(mrb_state *mrb, mrb_irep *irep)
   }
   size += sizeof(uint32_t); /* niseq */
   if (irep->lines) {
-    size += sizeof(uint16_t) * irep->ilen; /* lineno */
+    size += sizeof(uint16_t) * mrb_iseq_index(irep, irep->iseq + irep->ilen); /* lineno */
   }
 
   return size;
@@ -402,9 +406,11 @@ write_lineno_record_1(mrb_state *mrb, mrb_irep *irep, uint8_t* bin)
   }
 
   if (irep->lines) {
-    mrb_assert_int_fit(size_t, irep->ilen, uint32_t, UINT32_MAX);
-    cur += uint32_to_bin((uint32_t)(irep->ilen), cur); /* niseq */
-    for (iseq_no = 0; iseq_no < irep->ilen; iseq_no++) {
+    size_t niseq = mrb_iseq_index(irep, irep->iseq + irep->ilen);
+
+    mrb_assert_int_fit(size_t, niseq, uint32_t, UINT32_MAX);
+    cur += uint32_to_bin((uint32_t)niseq, cur); /* niseq */
+    for (iseq_no = 0; iseq_no < niseq; iseq_no++) {
       cur += uint16_to_bin(irep->lines[iseq_no], cur); /* opcode */
     }
   }
@@ -795,13 +801,21 @@ lv_section_exit:
 }
 
 static int
-write_rite_binary_header(mrb_state *mrb, size_t binary_size, uint8_t *bin)
+write_rite_binary_header(mrb_state *mrb, size_t binary_size, uint8_t *bin, int flags)
 {
   struct rite_binary_header *header = (struct rite_binary_header *)bin;
   uint16_t crc;
   uint32_t offset;
 
-  memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify));
+  if ((flags & DUMP_ENDIAN_MASK) == DUMP_ENDIAN_NAT) {
+    flags = bigendian_p() ? DUMP_ENDIAN_BIG : DUMP_ENDIAN_LIL;
+  }
+  if (flags & DUMP_ENDIAN_LIL) {
+    memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER_LIL, sizeof(header->binary_identify));
+  }
+  else {
+    memcpy(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify));
+  }
   memcpy(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version));
   memcpy(header->compiler_name, RITE_COMPILER_NAME, sizeof(header->compiler_name));
   memcpy(header->compiler_version, RITE_COMPILER_VERSION, sizeof(header->compiler_version));
@@ -842,7 +856,7 @@ is_lv_defined(mrb_irep *irep)
 }
 
 int
-mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int debug_info, uint8_t **bin, size_t *bin_size)
+mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int flags, uint8_t **bin, size_t *bin_size)
 {
   int result = MRB_DUMP_GENERAL_FAILURE;
   size_t section_irep_size;
@@ -856,12 +870,13 @@ mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int debug_info, uint8_t **bin, siz
     *bin = NULL;
     return MRB_DUMP_GENERAL_FAILURE;
   }
+  mrb_irep_load_all(mrb, irep);
 
   section_irep_size = sizeof(struct rite_section_irep_header);
-  section_irep_size += get_irep_record_size(mrb, irep);
+  section_irep_size += get_irep_record_size(mrb, irep, sizeof(struct rite_binary_header) + section_irep_size);
 
   /* DEBUG section size */
-  if (debug_info) {
+  if (flags & DUMP_DEBUG_INFO) {
     if (debug_info_defined) {
       section_lineno_size += sizeof(struct rite_section_debug_header);
       /* filename table */
@@ -894,14 +909,14 @@ mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int debug_info, uint8_t **bin, siz
   }
   cur += sizeof(struct rite_binary_header);
 
-  result = write_section_irep(mrb, irep, cur);
+  result = write_section_irep(mrb, irep, cur, flags);
   if (result != MRB_DUMP_OK) {
     goto error_exit;
   }
   cur += section_irep_size;
 
   /* write DEBUG section */
-  if (debug_info) {
+  if (flags & DUMP_DEBUG_INFO) {
     if (debug_info_defined) {
       result = write_section_debug(mrb, irep, cur, filenames, filenames_len);
     }
@@ -923,7 +938,7 @@ mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, int debug_info, uint8_t **bin, siz
   }
 
   write_footer(mrb, cur);
-  write_rite_binary_header(mrb, *bin_size, *bin);
+  write_rite_binary_header(mrb, *bin_size, *bin, flags);
 
 error_exit:
   if (result != MRB_DUMP_OK) {
@@ -940,7 +955,7 @@ error_exit:
 }
 
 int
-mrb_dump_irep_binary(mrb_state *mrb, mrb_irep *irep, int debug_info, FILE* fp)
+mrb_dump_irep_binary(mrb_state *mrb, mrb_irep *irep, int flags, FILE* fp)
 {
   uint8_t *bin = NULL;
   size_t bin_size = 0;
@@ -950,7 +965,7 @@ mrb_dump_irep_binary(mrb_state *mrb, mrb_irep *irep, int debug_info, FILE* fp)
     return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  result = mrb_dump_irep(mrb, irep, debug_info, &bin, &bin_size);
+  result = mrb_dump_irep(mrb, irep, flags, &bin, &bin_size);
   if (result == MRB_DUMP_OK) {
     if (fwrite(bin, sizeof(bin[0]), bin_size, fp) != bin_size) {
       result = MRB_DUMP_WRITE_FAULT;
@@ -978,7 +993,7 @@ is_valid_c_symbol_name(const char *name)
 }
 
 int
-mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep *irep, int debug_info, FILE *fp, const char *initname)
+mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep *irep, int flags, FILE *fp, const char *initname)
 {
   uint8_t *bin = NULL;
   size_t bin_size = 0, bin_idx = 0;
@@ -988,10 +1003,19 @@ mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep *irep, int debug_info, FILE *fp, co
     return MRB_DUMP_INVALID_ARGUMENT;
   }
 
-  result = mrb_dump_irep(mrb, irep, debug_info, &bin, &bin_size);
+  result = mrb_dump_irep(mrb, irep, flags, &bin, &bin_size);
   if (result == MRB_DUMP_OK) {
     fprintf(fp, "#include <stdint.h>\n"); /* for uint8_t under at least Darwin */
-    fprintf(fp, "const uint8_t %s[] = {", initname);
+    /* aligned so that native byte order iseqs can be executed in place */
+    fprintf(fp,
+            "const uint8_t\n"
+            "#if defined __GNUC__\n"
+            "__attribute__((aligned(%u)))\n"
+            "#elif defined _MSC_VER\n"
+            "__declspec(align(%u))\n"
+            "#endif\n"
+            "%s[] = {",
+            (unsigned)MRB_DUMP_ALIGNMENT, (unsigned)MRB_DUMP_ALIGNMENT, initname);
     while (bin_idx < bin_size) {
       if (bin_idx % 16 == 0) fputs("\n", fp);
       fprintf(fp, "0x%02x,", bin[bin_idx++]);
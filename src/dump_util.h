@@ -0,0 +1,31 @@
+/*
+** dump_util.h - helpers shared by dump.c and load.c
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRB_DUMP_UTIL_H
+#define MRB_DUMP_UTIL_H
+
+#include "mruby/dump.h"
+
+static inline int
+bigendian_p(void)
+{
+  int i;
+  char *p;
+
+  i = 1;
+  p = (char*)&i;
+  return p[0]?0:1;
+}
+
+/* iseq blocks are padded so that the instructions start at an offset
+   (from the top of the binary) aligned to MRB_DUMP_ALIGNMENT */
+static inline size_t
+iseq_padding(size_t offset)
+{
+  return (MRB_DUMP_ALIGNMENT - offset % MRB_DUMP_ALIGNMENT) % MRB_DUMP_ALIGNMENT;
+}
+
+#endif  /* MRB_DUMP_UTIL_H */
@@ -257,6 +257,12 @@ struct heap_page {
   RVALUE objects[MRB_HEAP_PAGE_SIZE];
 };
 
+/* an image page and its copy; see mrb_gc_copy_heap() */
+struct image_heap {
+  struct heap_page *image;
+  struct heap_page *copy;
+};
+
 static void
 link_heap_page(mrb_state *mrb, struct heap_page *page)
 {
@@ -363,6 +369,7 @@ mrb_free_heap(mrb_state *mrb)
     }
     mrb_free(mrb, tmp);
   }
+  mrb_free(mrb, mrb->image_heaps);
 }
 
 static void
@@ -553,8 +560,8 @@ gc_mark_children(mrb_state *mrb, struct RBasic *obj)
       struct RArray *a = (struct RArray*)obj;
       size_t i, e;
 
-      for (i=0,e=a->len; i<e; i++) {
-        mrb_gc_mark_value(mrb, a->ptr[i]);
+      for (i=0,e=ARY_LEN(a); i<e; i++) {
+        mrb_gc_mark_value(mrb, ARY_PTR(a)[i]);
       }
     }
     break;
@@ -644,9 +651,9 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
 
   case MRB_TT_ARRAY:
     if (obj->flags & MRB_ARY_SHARED)
-      mrb_ary_decref(mrb, ((struct RArray*)obj)->aux.shared);
-    else
-      mrb_free(mrb, ((struct RArray*)obj)->ptr);
+      mrb_ary_decref(mrb, ((struct RArray*)obj)->as.heap.aux.shared);
+    else if (!(obj->flags & MRB_ARY_EMBED))
+      mrb_free(mrb, ((struct RArray*)obj)->as.heap.ptr);
     break;
 
   case MRB_TT_HASH:
@@ -782,7 +789,7 @@ gc_gray_mark(mrb_state *mrb, struct RBasic *obj)
   case MRB_TT_ARRAY:
     {
       struct RArray *a = (struct RArray*)obj;
-      children += a->len;
+      children += ARY_LEN(a);
     }
     break;
 
@@ -1320,6 +1327,136 @@ mrb_objspace_each_objects(mrb_state *mrb, mrb_each_object_callback *callback, vo
   }
 }
 
+/*
+ * Heap copy for mrb_open_from_image().  The pages of the image are
+ * duplicated in order; an object keeps its index in the copy of its
+ * page.  The pairs of pages are kept, sorted by the image page address,
+ * and mrb_gc_image_object() finds the copy of an image object from them.
+ * The copies still point into the image; the code owning each object
+ * type relocates them with mrb_gc_image_object() and mrb_gc_image_value().
+ * The image is only read, so several states can be copied from it at
+ * once.  The pairs are freed when the copy is done.
+ */
+static int
+image_heap_cmp(const void *a, const void *b)
+{
+  uintptr_t x = (uintptr_t)((const struct image_heap*)a)->image;
+  uintptr_t y = (uintptr_t)((const struct image_heap*)b)->image;
+
+  return (x > y) - (x < y);
+}
+
+void
+mrb_gc_copy_heap(mrb_state *mrb, mrb_state *image)
+{
+  struct heap_page *page, *copy, *last = NULL;
+  RVALUE *p, *q, *e;
+  size_t n = 0;
+
+  mrb_assert(image->gc_state == GC_STATE_NONE && image->atomic_gray_list == NULL);
+  mrb->heaps = NULL;
+  mrb->free_heaps = NULL;
+  mrb->sweeps = NULL;
+  for (page = image->heaps; page; page = page->next) {
+    n++;
+  }
+  mrb->image_heaps = (struct image_heap *)mrb_malloc(mrb, sizeof(struct image_heap)*n);
+  mrb->image_heaps_len = n;
+  n = 0;
+  for (page = image->heaps; page; page = page->next) {
+    copy = (struct heap_page *)mrb_malloc(mrb, sizeof(struct heap_page));
+    mrb->image_heaps[n].image = page;
+    mrb->image_heaps[n].copy = copy;
+    n++;
+    *copy = *page;
+    copy->freelist = NULL;
+    copy->prev = last;
+    copy->next = NULL;
+    copy->free_prev = NULL;
+    copy->free_next = NULL;
+    if (last) last->next = copy;
+    else mrb->heaps = copy;
+    last = copy;
+
+    for (p = page->objects, q = copy->objects, e=p+MRB_HEAP_PAGE_SIZE; p<e; p++, q++) {
+      if (p->as.free.tt == MRB_TT_FREE) {
+        q->as.free.next = copy->freelist;
+        copy->freelist = &q->as.basic;
+      }
+      else {
+        q->as.basic.gcnext = NULL;
+      }
+    }
+    if (copy->freelist) {
+      link_free_heap_page(mrb, copy);
+    }
+  }
+  qsort(mrb->image_heaps, n, sizeof(struct image_heap), image_heap_cmp);
+
+  mrb->live = image->live;
+  mrb->gc_state = GC_STATE_NONE;
+  mrb->current_white_part = image->current_white_part;
+  mrb->gray_list = NULL;
+  mrb->atomic_gray_list = NULL;
+  mrb->gc_live_after_mark = image->gc_live_after_mark;
+  mrb->gc_threshold = image->gc_threshold;
+  mrb->gc_interval_ratio = image->gc_interval_ratio;
+  mrb->gc_step_ratio = image->gc_step_ratio;
+  mrb->gc_full = image->gc_full;
+  mrb->is_generational_gc_mode = image->is_generational_gc_mode;
+  mrb->majorgc_old_threshold = image->majorgc_old_threshold;
+}
+
+static struct RBasic*
+image_object(mrb_state *mrb, struct RBasic *obj)
+{
+  size_t lo = 0, hi = mrb->image_heaps_len;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    struct image_heap *h = &mrb->image_heaps[mid];
+    RVALUE *p = (RVALUE*)obj;
+
+    if (p < h->image->objects) {
+      hi = mid;
+    }
+    else if (p >= h->image->objects + MRB_HEAP_PAGE_SIZE) {
+      lo = mid + 1;
+    }
+    else {
+      return &h->copy->objects[p - h->image->objects].as.basic;
+    }
+  }
+  return NULL;
+}
+
+/* the copy in mrb of obj, an object of the image mrb was copied from */
+struct RBasic*
+mrb_gc_image_object(mrb_state *mrb, struct RBasic *obj)
+{
+  struct RBasic *copy;
+
+  if (obj == NULL) return NULL;
+  copy = image_object(mrb, obj);
+  mrb_assert(copy != NULL);
+  return copy;
+}
+
+mrb_value
+mrb_gc_image_value(mrb_state *mrb, mrb_value v)
+{
+  struct RBasic *copy;
+
+  if (mrb_immediate_p(v)) return v;
+  copy = image_object(mrb, mrb_basic_ptr(v));
+#ifdef MRB_WORD_BOXING
+  /* pool floats are outside the heap; they stay with the image */
+  if (copy == NULL && mrb_float_p(v)) return v;
+#endif
+  mrb_assert(copy != NULL);
+  return mrb_obj_value(copy);
+}
+
 #ifdef GC_TEST
 #ifdef GC_DEBUG
 static mrb_value gc_test(mrb_state *, mrb_value);
@@ -0,0 +1,545 @@
+/*
+** image.c - open a state from an initialized one
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include "mruby.h"
+#include "mruby/array.h"
+#include "mruby/class.h"
+#include "mruby/data.h"
+#include "mruby/gc.h"
+#include "mruby/hash.h"
+#include "mruby/irep.h"
+#include "mruby/khash.h"
+#include "mruby/proc.h"
+#include "mruby/range.h"
+#include "mruby/string.h"
+#include "mruby/variable.h"
+
+/*
+ * mrb_open_from_image() opens a state by copying an initialized one,
+ * the image, instead of running the core and gem initializers again.
+ * The heap pages are copied as they are; then every pointer into the
+ * image is relocated to its copy, and the ireps of the procs are copied
+ * along with their pools.
+ *
+ * The copy shares read-only data with the image: symbol names, static
+ * string buffers, and the code and debug info of ireps.
+ *
+ * mrb_prepare_image() gets a state ready to be an image: it decodes the
+ * lazily loaded ireps and finishes any GC cycle.  Copying only reads the
+ * image, so several states may be copied from it at once, from several
+ * threads, as long as the image does not run meanwhile.  Copies use the
+ * code of its ireps, so it must stay open, and keep the procs they were
+ * copied from (not redefine or remove those methods), while they are in
+ * use.
+ * An image that is not prepared, in the middle of running code, with
+ * live fibers, with hashes keyed by objects or holding data objects
+ * whose type has no dcopy function cannot be copied.
+ */
+
+void mrb_gc_copy_heap(mrb_state *mrb, mrb_state *image);
+void mrb_copy_symtbl(mrb_state *mrb, mrb_state *image);
+
+#define irep_hash_func(mrb,key) kh_int_hash_func(mrb,(khint_t)((uintptr_t)(key)>>3))
+#define irep_hash_equal(mrb,a,b) ((a) == (b))
+
+KHASH_DECLARE(irepmap, mrb_irep*, mrb_irep*, TRUE)
+KHASH_DEFINE(irepmap, mrb_irep*, mrb_irep*, TRUE, irep_hash_func, irep_hash_equal)
+
+struct image_copy {
+  mrb_state *image;
+  khash_t(irepmap) *ireps;      /* image irep -> its copy */
+  mrb_bool ok;
+};
+
+#define IMAGE_PTR(mrb,type,p) ((type*)mrb_gc_image_object(mrb, (struct RBasic*)(p)))
+
+static void
+load_ireps_i(mrb_state *image, struct RBasic *obj, void *data)
+{
+  struct RProc *p = (struct RProc*)obj;
+
+  if (obj->tt == MRB_TT_PROC && !MRB_PROC_CFUNC_P(p) && p->body.irep) {
+    mrb_irep_load_all(image, p->body.irep);
+  }
+}
+
+void
+mrb_prepare_image(mrb_state *image)
+{
+  /* decoding ireps may allocate objects */
+  mrb_objspace_each_objects(image, load_ireps_i, NULL);
+  mrb_full_gc(image);
+}
+
+static mrb_bool
+irep_loaded_p(mrb_irep *irep)
+{
+  size_t i;
+
+  if (irep->lazy || (irep->flags & MRB_IREP_LAZY)) return FALSE;
+  for (i = 0; i < irep->rlen; i++) {
+    if (!irep_loaded_p(irep->reps[i])) return FALSE;
+  }
+  return TRUE;
+}
+
+static void
+check_object_i(mrb_state *image, struct RBasic *obj, void *data)
+{
+  struct image_copy *ic = (struct image_copy*)data;
+  struct mrb_context *c = image->root_c;
+
+  switch (obj->tt) {
+  case MRB_TT_PROC:
+    {
+      struct RProc *p = (struct RProc*)obj;
+
+      if (!MRB_PROC_CFUNC_P(p) && p->body.irep && !irep_loaded_p(p->body.irep)) {
+        ic->ok = FALSE;
+      }
+    }
+    break;
+
+  case MRB_TT_ICLASS:
+    {
+      struct RClass *k = (struct RClass*)obj;
+      struct RClass *m = k->c;
+
+      if (k->mt != m->mt || (k->iv && k->iv != m->iv)) {
+        ic->ok = FALSE;
+      }
+    }
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+
+      if (MRB_ENV_STACK_SHARED_P(e) &&
+          (e->stack < c->stbase || e->stack > c->stend)) {
+        ic->ok = FALSE;
+      }
+    }
+    break;
+
+  case MRB_TT_FIBER:
+    {
+      struct mrb_context *cxt = ((struct RFiber*)obj)->cxt;
+
+      if (cxt && cxt != c) {
+        ic->ok = FALSE;
+      }
+    }
+    break;
+
+  case MRB_TT_HASH:
+    if (!mrb_gc_copyable_hash_p(image, (struct RHash*)obj)) {
+      ic->ok = FALSE;
+    }
+    break;
+
+  case MRB_TT_DATA:
+    {
+      struct RData *d = (struct RData*)obj;
+
+      if (d->data && !(d->type && d->type->dcopy)) {
+        ic->ok = FALSE;
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+static mrb_bool
+image_copyable_p(mrb_state *image)
+{
+  struct image_copy ic;
+  struct mrb_context *c = image->root_c;
+
+  /* see mrb_prepare_image(); the image is never changed here */
+  if (image->gc_state != GC_STATE_NONE || image->gray_list || image->atomic_gray_list) {
+    return FALSE;
+  }
+
+  if (image->c != c || image->jmp) return FALSE;
+  if (c->cibase && (c->ci != c->cibase || c->ci->ridx > 0 || c->ci->eidx > 0)) {
+    return FALSE;
+  }
+  ic.image = image;
+  ic.ok = TRUE;
+  mrb_objspace_each_objects(image, check_object_i, &ic);
+  return ic.ok;
+}
+
+static mrb_value
+copy_pool_str(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = (struct RString*)mrb_malloc(mrb, sizeof(struct RString));
+
+  *s = *mrb_str_ptr(str);
+  s->c = mrb->string_class;
+  mrb_gc_copy_str(mrb, s);
+  return mrb_obj_value(s);
+}
+
+static mrb_irep*
+copy_irep(mrb_state *mrb, struct image_copy *ic, mrb_irep *src)
+{
+  mrb_irep *irep;
+  khiter_t k;
+  size_t i;
+
+  k = kh_get(irepmap, mrb, ic->ireps, src);
+  if (k != kh_end(ic->ireps)) {
+    return kh_value(ic->ireps, k);
+  }
+  irep = mrb_add_irep(mrb);
+  k = kh_put(irepmap, mrb, ic->ireps, src);
+  kh_value(ic->ireps, k) = irep;
+
+  /* counts the references made while copying */
+  irep->refcnt = 0;
+  irep->nlocals = src->nlocals;
+  irep->nregs = src->nregs;
+  irep->ilen = src->ilen;
+  irep->plen = src->plen;
+  irep->slen = src->slen;
+  irep->rlen = src->rlen;
+
+  /* code and debug info are never modified; use the image's */
+  irep->flags = src->flags | MRB_ISEQ_NO_FREE | MRB_IREP_DATA_NO_FREE;
+  irep->iseq = src->iseq;
+  irep->syms = src->syms;
+  irep->lv = src->lv;
+  irep->filename = src->filename;
+  irep->lines = src->lines;
+  irep->debug_info = src->debug_info;
+
+  /* pool strings are objects of this state */
+  if (src->plen > 0) {
+    irep->pool = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value)*src->plen);
+    for (i = 0; i < src->plen; i++) {
+      mrb_value v = src->pool[i];
+
+      switch (mrb_type(v)) {
+      case MRB_TT_STRING:
+        irep->pool[i] = copy_pool_str(mrb, v);
+        break;
+      case MRB_TT_FLOAT:
+        irep->pool[i] = mrb_float_pool(mrb, mrb_float(v));
+        break;
+      default:
+        irep->pool[i] = v;
+        break;
+      }
+    }
+  }
+  if (src->rlen > 0) {
+    irep->reps = (mrb_irep**)mrb_malloc(mrb, sizeof(mrb_irep*)*src->rlen);
+    for (i = 0; i < src->rlen; i++) {
+      irep->reps[i] = copy_irep(mrb, ic, src->reps[i]);
+      mrb_irep_incref(mrb, irep->reps[i]);
+    }
+  }
+  return irep;
+}
+
+/* the stack and callinfo of the root context; objects are relocated later */
+static struct mrb_context*
+copy_context(mrb_state *mrb, struct mrb_context *c)
+{
+  static const struct mrb_context mrb_context_zero = { 0 };
+  struct mrb_context *c2;
+  size_t i, e, n;
+
+  c2 = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
+  *c2 = mrb_context_zero;
+  if (c->stbase) {
+    n = c->stend - c->stbase;
+    e = c->stack - c->stbase;
+    if (c->ci) e += c->ci->nregs;
+    if (e > n) e = n;
+    c2->stbase = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value)*n);
+    for (i = 0; i < e; i++) {
+      mrb_value v = c->stbase[i];
+
+      if (!mrb_immediate_p(v) && mrb_basic_ptr(v)->tt == MRB_TT_FREE) {
+        v = mrb_nil_value();
+      }
+      c2->stbase[i] = mrb_gc_image_value(mrb, v);
+    }
+    for (; i < n; i++) {
+      c2->stbase[i] = mrb_nil_value();
+    }
+    c2->stack = c2->stbase + (c->stack - c->stbase);
+    c2->stend = c2->stbase + n;
+  }
+  if (c->cibase) {
+    n = c->ciend - c->cibase;
+    c2->cibase = (mrb_callinfo*)mrb_malloc(mrb, sizeof(mrb_callinfo)*n);
+    memcpy(c2->cibase, c->cibase, sizeof(mrb_callinfo)*n);
+    c2->ci = c2->cibase + (c->ci - c->cibase);
+    c2->ciend = c2->cibase + n;
+  }
+  if (c->rescue) {
+    c2->rescue = (mrb_code**)mrb_malloc(mrb, sizeof(mrb_code*)*c->rsize);
+    c2->rsize = c->rsize;
+  }
+  if (c->ensure) {
+    c2->ensure = (struct RProc**)mrb_calloc(mrb, c->esize, sizeof(struct RProc*));
+    c2->esize = c->esize;
+  }
+  c2->status = c->status;
+  c2->fib = IMAGE_PTR(mrb, struct RFiber, c->fib);
+  return c2;
+}
+
+static mrb_code*
+relocate_pc(mrb_state *mrb, struct RProc *p, mrb_code *pc)
+{
+  mrb_irep *irep, *irep2;
+
+  if (!p || MRB_PROC_CFUNC_P(p) || !pc) return NULL;
+  irep = p->body.irep;
+  irep2 = IMAGE_PTR(mrb, struct RProc, p)->body.irep;
+  if (pc < irep->iseq || pc > irep->iseq + irep->ilen) return NULL;
+  return irep2->iseq + (pc - irep->iseq);
+}
+
+static void
+relocate_callinfo(mrb_state *mrb, struct mrb_context *c)
+{
+  struct mrb_context *c2 = mrb->root_c;
+  mrb_callinfo *ci;
+
+  if (!c2->cibase) return;
+  for (ci = c2->cibase; ci <= c2->ci; ci++) {
+    ci->pc = relocate_pc(mrb, ci->proc, ci->pc);
+    ci->err = relocate_pc(mrb, ci->proc, ci->err);
+    if (ci->stackent) {
+      ci->stackent = c2->stbase + (ci->stackent - c->stbase);
+    }
+    ci->proc = IMAGE_PTR(mrb, struct RProc, ci->proc);
+    ci->env = IMAGE_PTR(mrb, struct REnv, ci->env);
+    ci->target_class = IMAGE_PTR(mrb, struct RClass, ci->target_class);
+  }
+}
+
+static void
+copy_object_i(mrb_state *mrb, struct RBasic *obj, void *data)
+{
+  struct image_copy *ic = (struct image_copy*)data;
+
+  if (obj->tt == MRB_TT_FREE || obj->tt == MRB_TT_ICLASS) return;
+  obj->c = IMAGE_PTR(mrb, struct RClass, obj->c);
+  switch (obj->tt) {
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+    {
+      struct RClass *c = (struct RClass*)obj;
+
+      mrb_gc_copy_mt(mrb, c);
+      c->super = IMAGE_PTR(mrb, struct RClass, c->super);
+    }
+    /* fall through */
+
+  case MRB_TT_OBJECT:
+  case MRB_TT_EXCEPTION:
+    mrb_gc_copy_iv(mrb, (struct RObject*)obj);
+    break;
+
+  case MRB_TT_DATA:
+    {
+      struct RData *d = (struct RData*)obj;
+
+      mrb_gc_copy_iv(mrb, (struct RObject*)obj);
+      if (d->data) {
+        d->data = d->type->dcopy(mrb, d->data);
+      }
+    }
+    break;
+
+  case MRB_TT_PROC:
+    {
+      struct RProc *p = (struct RProc*)obj;
+
+      if (!MRB_PROC_CFUNC_P(p) && p->body.irep) {
+        p->body.irep = copy_irep(mrb, ic, p->body.irep);
+        mrb_irep_incref(mrb, p->body.irep);
+      }
+      p->target_class = IMAGE_PTR(mrb, struct RClass, p->target_class);
+      p->env = IMAGE_PTR(mrb, struct REnv, p->env);
+    }
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+
+      if (MRB_ENV_STACK_SHARED_P(e)) {
+        e->stack = mrb->root_c->stbase + (e->stack - ic->image->root_c->stbase);
+      }
+      else if (e->stack) {
+        mrb_value *stack = e->stack;
+        int i, len = (int)MRB_ENV_STACK_LEN(e);
+
+        e->stack = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value)*len);
+        for (i = 0; i < len; i++) {
+          e->stack[i] = mrb_gc_image_value(mrb, stack[i]);
+        }
+      }
+    }
+    break;
+
+  case MRB_TT_FIBER:
+    {
+      struct RFiber *f = (struct RFiber*)obj;
+
+      if (f->cxt) {
+        f->cxt = mrb->root_c;
+      }
+    }
+    break;
+
+  case MRB_TT_ARRAY:
+    mrb_gc_copy_ary(mrb, (struct RArray*)obj);
+    break;
+
+  case MRB_TT_HASH:
+    mrb_gc_copy_iv(mrb, (struct RObject*)obj);
+    mrb_gc_copy_hash(mrb, (struct RHash*)obj);
+    break;
+
+  case MRB_TT_STRING:
+    mrb_gc_copy_str(mrb, (struct RString*)obj);
+    break;
+
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = (struct RRange*)obj;
+
+      if (r->edges) {
+        mrb_range_edges *edges = r->edges;
+
+        r->edges = (mrb_range_edges*)mrb_malloc(mrb, sizeof(mrb_range_edges));
+        r->edges->beg = mrb_gc_image_value(mrb, edges->beg);
+        r->edges->end = mrb_gc_image_value(mrb, edges->end);
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+}
+
+/* include classes share the tables of their modules, copied above */
+static void
+copy_iclass_i(mrb_state *mrb, struct RBasic *obj, void *data)
+{
+  struct RClass *ic = (struct RClass*)obj;
+  struct RClass *m;
+
+  if (obj->tt != MRB_TT_ICLASS) return;
+  m = IMAGE_PTR(mrb, struct RClass, ic->c);
+  ic->c = m;
+  ic->mt = m->mt;
+  if (ic->iv) {
+    ic->iv = m->iv;
+  }
+  ic->super = IMAGE_PTR(mrb, struct RClass, ic->super);
+}
+
+mrb_state*
+mrb_open_from_image_allocf(mrb_state *image, mrb_allocf f, void *ud)
+{
+  static const mrb_state mrb_state_zero = { 0 };
+  struct image_copy ic;
+  mrb_state *mrb;
+  int i;
+
+  if (!image_copyable_p(image)) return NULL;
+
+  mrb = (mrb_state *)(f)(NULL, NULL, sizeof(mrb_state), ud);
+  if (mrb == NULL) return NULL;
+
+  *mrb = mrb_state_zero;
+  mrb->ud = ud;
+  mrb->allocf = f;
+  mrb->gc_disabled = TRUE;
+
+  mrb_gc_copy_heap(mrb, image);
+  mrb_copy_symtbl(mrb, image);
+  mrb_gc_copy_gv(mrb, image);
+  mrb->c = mrb->root_c = copy_context(mrb, image->root_c);
+
+  mrb->exc = IMAGE_PTR(mrb, struct RObject, image->exc);
+  mrb->top_self = IMAGE_PTR(mrb, struct RObject, image->top_self);
+  mrb->object_class = IMAGE_PTR(mrb, struct RClass, image->object_class);
+  mrb->class_class = IMAGE_PTR(mrb, struct RClass, image->class_class);
+  mrb->module_class = IMAGE_PTR(mrb, struct RClass, image->module_class);
+  mrb->proc_class = IMAGE_PTR(mrb, struct RClass, image->proc_class);
+  mrb->string_class = IMAGE_PTR(mrb, struct RClass, image->string_class);
+  mrb->array_class = IMAGE_PTR(mrb, struct RClass, image->array_class);
+  mrb->hash_class = IMAGE_PTR(mrb, struct RClass, image->hash_class);
+  mrb->float_class = IMAGE_PTR(mrb, struct RClass, image->float_class);
+  mrb->fixnum_class = IMAGE_PTR(mrb, struct RClass, image->fixnum_class);
+  mrb->true_class = IMAGE_PTR(mrb, struct RClass, image->true_class);
+  mrb->false_class = IMAGE_PTR(mrb, struct RClass, image->false_class);
+  mrb->nil_class = IMAGE_PTR(mrb, struct RClass, image->nil_class);
+  mrb->symbol_class = IMAGE_PTR(mrb, struct RClass, image->symbol_class);
+  mrb->kernel_module = IMAGE_PTR(mrb, struct RClass, image->kernel_module);
+  mrb->eException_class = IMAGE_PTR(mrb, struct RClass, image->eException_class);
+  mrb->eStandardError_class = IMAGE_PTR(mrb, struct RClass, image->eStandardError_class);
+  mrb->nomem_err = IMAGE_PTR(mrb, struct RObject, image->nomem_err);
+
+#ifndef MRB_GC_FIXED_ARENA
+  mrb->arena = (struct RBasic**)mrb_malloc(mrb, sizeof(struct RBasic*)*image->arena_capa);
+  mrb->arena_capa = image->arena_capa;
+#endif
+  for (i = 0; i < image->arena_idx; i++) {
+    mrb->arena[i] = mrb_gc_image_object(mrb, image->arena[i]);
+  }
+  mrb->arena_idx = image->arena_idx;
+
+#ifdef ENABLE_DEBUG
+  mrb->code_fetch_hook = image->code_fetch_hook;
+  mrb->debug_op_hook = image->debug_op_hook;
+#endif
+
+  /* gem finalizers registered during initialization */
+  if (image->atexit_stack_len > 0) {
+#ifndef MRB_FIXED_STATE_ATEXIT_STACK
+    mrb->atexit_stack = (mrb_atexit_func*)mrb_malloc(mrb, sizeof(mrb_atexit_func)*image->atexit_stack_len);
+#endif
+    memcpy(mrb->atexit_stack, image->atexit_stack, sizeof(mrb_atexit_func)*image->atexit_stack_len);
+    mrb->atexit_stack_len = image->atexit_stack_len;
+  }
+
+  ic.image = image;
+  ic.ireps = kh_init(irepmap, mrb);
+  mrb_objspace_each_objects(mrb, copy_object_i, &ic);
+  mrb_objspace_each_objects(mrb, copy_iclass_i, &ic);
+  relocate_callinfo(mrb, image->root_c);
+  kh_destroy(irepmap, mrb, ic.ireps);
+  mrb_free(mrb, mrb->image_heaps);
+  mrb->image_heaps = NULL;
+  mrb->image_heaps_len = 0;
+
+  mrb->gc_disabled = image->gc_disabled;
+  return mrb;
+}
+
+mrb_state*
+mrb_open_from_image(mrb_state *image)
+{
+  return mrb_open_from_image_allocf(image, mrb_default_allocf, NULL);
+}
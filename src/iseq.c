@@ -0,0 +1,349 @@
+/*
+** iseq.c - compact instruction sequence
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include "mruby.h"
+#include "mruby/irep.h"
+#include "mruby/opcode.h"
+
+/* operand layout of each opcode (see mruby/opcode.h) */
+const uint8_t mrb_insn_format[128] = {
+#define OPFMT(op, fmt) MRB_IFMT_ ## fmt,
+#include "iseq_format.h"
+#undef OPFMT
+  /* OP_RSVD2..OP_RSVD5 and unused opcodes have no operand */
+};
+
+static uint32_t
+get_be(const uint8_t *p, int n)
+{
+  uint32_t v = 0;
+
+  while (n--) {
+    v = (v << 8) | *p++;
+  }
+  return v;
+}
+
+static uint8_t*
+put_be(uint8_t *p, uint32_t v, int n)
+{
+  int i;
+
+  for (i=n-1; i>=0; i--) {
+    p[i] = (uint8_t)v;
+    v >>= 8;
+  }
+  return p + n;
+}
+
+/* reads an instruction of the compact form; returns its length, or 0
+   if it is malformed or longer than avail.  Jumps keep their byte
+   offset. */
+static int
+read_insn(const uint8_t *p, size_t avail, mrb_insn *cp)
+{
+  int op, w, len;
+  uint32_t a;
+
+  if (avail < 1) return 0;
+  op = p[0] & 0x7f;
+  w = (p[0] & 0x80) ? 2 : 1;
+  if (op >= MRB_OP_MAX) return 0;
+  switch (mrb_insn_format[op]) {
+  case MRB_IFMT_Z:
+    len = 1;
+    break;
+  case MRB_IFMT_A:
+  case MRB_IFMT_Bx:
+    len = 1 + w;
+    break;
+  case MRB_IFMT_AB:
+  case MRB_IFMT_ABx:
+  case MRB_IFMT_AsBx:
+    len = 1 + 2*w;
+    break;
+  case MRB_IFMT_ABC:
+    len = 2 + 2*w;
+    break;
+  case MRB_IFMT_Ax:
+    len = 4;
+    break;
+  case MRB_IFMT_J:
+    len = 3;
+    break;
+  default:                      /* MRB_IFMT_AJ */
+    len = 3 + w;
+    break;
+  }
+  if ((size_t)len > avail) return 0;
+  switch (mrb_insn_format[op]) {
+  case MRB_IFMT_Z:
+  case MRB_IFMT_Ax:
+  case MRB_IFMT_J:
+    if (w > 1) return 0;
+    break;
+  default:
+    break;
+  }
+
+  a = (len > 1) ? get_be(p+1, w) : 0;
+  switch (mrb_insn_format[op]) {
+  case MRB_IFMT_Z:
+    *cp = MKOPCODE(op);
+    break;
+  case MRB_IFMT_A:
+    *cp = MKOP_A(op, a);
+    break;
+  case MRB_IFMT_AB:
+    *cp = MKOP_AB(op, a, get_be(p+1+w, w));
+    break;
+  case MRB_IFMT_ABC:
+    *cp = MKOP_ABC(op, a, get_be(p+1+w, w), p[1+2*w]);
+    break;
+  case MRB_IFMT_ABx:
+    *cp = MKOP_ABx(op, a, get_be(p+1+w, w));
+    break;
+  case MRB_IFMT_AsBx:
+    if (w == 1) {
+      *cp = MKOP_AsBx(op, a, (int8_t)p[2]);
+    }
+    else {
+      *cp = MKOP_AsBx(op, a, (int16_t)get_be(p+3, 2));
+    }
+    break;
+  case MRB_IFMT_Bx:
+    *cp = MKOP_Bx(op, a);
+    break;
+  case MRB_IFMT_Ax:
+    *cp = MKOP_Ax(op, get_be(p+1, 3));
+    break;
+  case MRB_IFMT_J:
+    *cp = MKOP_sBx(op, (int16_t)get_be(p+1, 2));
+    break;
+  default:                      /* MRB_IFMT_AJ */
+    *cp = MKOP_AsBx(op, a, (int16_t)get_be(p+1+w, 2));
+    break;
+  }
+  return len;
+}
+
+#ifdef MRB_COMPACT_ISEQ
+mrb_insn
+mrb_iseq_fetch_wide(const mrb_code *pc, int *lenp)
+{
+  mrb_insn c = MKOPCODE(OP_NOP);
+  int len = read_insn(pc, 8, &c);
+
+  *lenp = len > 0 ? len : 1;
+  return c;
+}
+#endif
+
+/* length of the compact form of c */
+static int
+insn_size(mrb_insn c, int *widep)
+{
+  int op = GET_OPCODE(c);
+  int fmt = mrb_insn_format[op];
+  int w = 1;
+
+  switch (fmt) {
+  case MRB_IFMT_A:
+  case MRB_IFMT_AJ:
+    if (GETARG_A(c) > 0xff) w = 2;
+    break;
+  case MRB_IFMT_AB:
+  case MRB_IFMT_ABC:
+    if (GETARG_A(c) > 0xff || GETARG_B(c) > 0xff) w = 2;
+    break;
+  case MRB_IFMT_ABx:
+    if (GETARG_A(c) > 0xff || GETARG_Bx(c) > 0xff) w = 2;
+    break;
+  case MRB_IFMT_AsBx:
+    if (GETARG_A(c) > 0xff || GETARG_sBx(c) < -128 || GETARG_sBx(c) > 127) w = 2;
+    break;
+  case MRB_IFMT_Bx:
+    if (GETARG_Bx(c) > 0xff) w = 2;
+    break;
+  default:
+    break;
+  }
+  *widep = w;
+  switch (fmt) {
+  case MRB_IFMT_Z:    return 1;
+  case MRB_IFMT_A:    return 1 + w;
+  case MRB_IFMT_Bx:   return 1 + w;
+  case MRB_IFMT_AB:   return 1 + 2*w;
+  case MRB_IFMT_ABx:  return 1 + 2*w;
+  case MRB_IFMT_AsBx: return 1 + 2*w;
+  case MRB_IFMT_ABC:  return 2 + 2*w;
+  case MRB_IFMT_Ax:   return 4;
+  case MRB_IFMT_J:    return 3;
+  default:            return 3 + w; /* MRB_IFMT_AJ */
+  }
+}
+
+static uint8_t*
+write_insn(uint8_t *p, mrb_insn c, int w, int jmp)
+{
+  int op = GET_OPCODE(c);
+
+  *p++ = (uint8_t)(op | (w > 1 ? MRB_INSN_WIDE : 0));
+  switch (mrb_insn_format[op]) {
+  case MRB_IFMT_Z:
+    break;
+  case MRB_IFMT_A:
+    p = put_be(p, GETARG_A(c), w);
+    break;
+  case MRB_IFMT_AB:
+    p = put_be(p, GETARG_A(c), w);
+    p = put_be(p, GETARG_B(c), w);
+    break;
+  case MRB_IFMT_ABC:
+    p = put_be(p, GETARG_A(c), w);
+    p = put_be(p, GETARG_B(c), w);
+    *p++ = (uint8_t)GETARG_C(c);
+    break;
+  case MRB_IFMT_ABx:
+    p = put_be(p, GETARG_A(c), w);
+    p = put_be(p, GETARG_Bx(c), w);
+    break;
+  case MRB_IFMT_AsBx:
+    p = put_be(p, GETARG_A(c), w);
+    p = put_be(p, (uint32_t)GETARG_sBx(c), w);
+    break;
+  case MRB_IFMT_Bx:
+    p = put_be(p, GETARG_Bx(c), w);
+    break;
+  case MRB_IFMT_Ax:
+    p = put_be(p, (uint32_t)GETARG_Ax(c), 3);
+    break;
+  case MRB_IFMT_J:
+    p = put_be(p, (uint32_t)jmp, 2);
+    break;
+  default:                      /* MRB_IFMT_AJ */
+    p = put_be(p, GETARG_A(c), w);
+    p = put_be(p, (uint32_t)jmp, 2);
+    break;
+  }
+  return p;
+}
+
+/* converts n packed instructions, whose jump offsets count
+   instructions, to the compact form.  Returns NULL if an instruction
+   can not be represented, e.g. a jump of more than 32767 bytes. */
+uint8_t*
+mrb_iseq_encode(mrb_state *mrb, const mrb_insn *iseq, size_t n, size_t *lenp)
+{
+  size_t *pos = (size_t*)mrb_malloc(mrb, sizeof(size_t)*(n+1));
+  uint8_t *bin, *p;
+  size_t i;
+  int w;
+
+  pos[0] = 0;
+  for (i=0; i<n; i++) {
+    pos[i+1] = pos[i] + insn_size(iseq[i], &w);
+  }
+  bin = (uint8_t*)mrb_malloc(mrb, pos[n] > 0 ? pos[n] : 1);
+  p = bin;
+  for (i=0; i<n; i++) {
+    mrb_insn c = iseq[i], c2, expect = c;
+    int op = GET_OPCODE(c);
+    int len = insn_size(c, &w);
+    int jmp = 0;
+
+    if (op >= MRB_OP_MAX) goto error;
+    if (mrb_insn_format[op] == MRB_IFMT_J || mrb_insn_format[op] == MRB_IFMT_AJ) {
+      long t = (long)i + GETARG_sBx(c);
+
+      if (t < 0 || t > (long)n) goto error;
+      jmp = (int)((long)pos[t] - (long)pos[i]);
+      if (jmp < -MAXARG_sBx || jmp > MAXARG_sBx) goto error;
+      expect = MKOP_AsBx(op, GETARG_A(c), jmp);
+    }
+    write_insn(p, c, w, jmp);
+    /* operand bits the format does not carry are lost */
+    if (read_insn(p, len, &c2) != len || c2 != expect) goto error;
+    p += len;
+  }
+  mrb_free(mrb, pos);
+  *lenp = (size_t)(p - bin);
+  return bin;
+
+ error:
+  mrb_free(mrb, pos);
+  mrb_free(mrb, bin);
+  return NULL;
+}
+
+/* converts a compact iseq of len bytes back to packed instructions,
+   with jump offsets counting instructions.  Returns NULL if it is
+   malformed. */
+mrb_insn*
+mrb_iseq_decode(mrb_state *mrb, const uint8_t *bin, size_t len, size_t *np)
+{
+  int32_t *idx = (int32_t*)mrb_malloc(mrb, sizeof(int32_t)*(len+1));
+  mrb_insn *iseq = NULL;
+  size_t i, n, pc;
+  mrb_insn c;
+  int l;
+
+  for (pc=0; pc<=len; pc++) {
+    idx[pc] = -1;
+  }
+  n = 0;
+  for (pc=0; pc<len; pc+=l) {
+    l = read_insn(bin+pc, len-pc, &c);
+    if (l == 0) goto error;
+    idx[pc] = (int32_t)n++;
+  }
+  idx[len] = (int32_t)n;
+  iseq = (mrb_insn*)mrb_malloc(mrb, sizeof(mrb_insn)*(n > 0 ? n : 1));
+  for (pc=0, i=0; pc<len; pc+=l, i++) {
+    int op;
+
+    l = read_insn(bin+pc, len-pc, &c);
+    op = GET_OPCODE(c);
+    if (mrb_insn_format[op] == MRB_IFMT_J || mrb_insn_format[op] == MRB_IFMT_AJ) {
+      long t = (long)pc + GETARG_sBx(c);
+
+      if (t < 0 || t > (long)len || idx[t] < 0) goto error;
+      c = MKOP_AsBx(op, GETARG_A(c), idx[t] - (long)i);
+    }
+    iseq[i] = c;
+  }
+  mrb_free(mrb, idx);
+  *np = n;
+  return iseq;
+
+ error:
+  mrb_free(mrb, idx);
+  mrb_free(mrb, iseq);
+  return NULL;
+}
+
+#ifdef MRB_COMPACT_ISEQ
+/* index of the instruction at pc, for the debug info; the number of
+   instructions for the end of the iseq */
+size_t
+mrb_iseq_index(mrb_irep *irep, const mrb_code *pc)
+{
+  const mrb_code *p = irep->iseq;
+  const mrb_code *end = irep->iseq + irep->ilen;
+  size_t i = 0;
+  int len;
+
+  if (pc < p || pc > end) return SIZE_MAX;
+  while (p < end) {
+    mrb_iseq_fetch(p, &len);
+    if (p + len > pc) break;
+    p += len;
+    i++;
+  }
+  return i;
+}
+#endif
@@ -0,0 +1,86 @@
+/*
+** iseq_format.h - operand layout of each opcode
+**
+** See Copyright Notice in mruby.h
+*/
+
+/* no include guard: define OPFMT(op, fmt) before including this; the
+   entries are in opcode order, and fmt names an MRB_IFMT_ layout */
+
+OPFMT(OP_NOP, Z)
+OPFMT(OP_MOVE, AB)
+OPFMT(OP_LOADL, ABx)
+OPFMT(OP_LOADI, AsBx)
+OPFMT(OP_LOADSYM, ABx)
+OPFMT(OP_LOADNIL, A)
+OPFMT(OP_LOADSELF, A)
+OPFMT(OP_LOADT, A)
+OPFMT(OP_LOADF, A)
+OPFMT(OP_GETGLOBAL, ABx)
+OPFMT(OP_SETGLOBAL, ABx)
+OPFMT(OP_GETSPECIAL, ABx)
+OPFMT(OP_SETSPECIAL, ABx)
+OPFMT(OP_GETIV, ABx)
+OPFMT(OP_SETIV, ABx)
+OPFMT(OP_GETCV, ABx)
+OPFMT(OP_SETCV, ABx)
+OPFMT(OP_GETCONST, ABx)
+OPFMT(OP_SETCONST, ABx)
+OPFMT(OP_GETMCNST, ABx)
+OPFMT(OP_SETMCNST, ABx)
+OPFMT(OP_GETUPVAR, ABC)
+OPFMT(OP_SETUPVAR, ABC)
+OPFMT(OP_JMP, J)
+OPFMT(OP_JMPIF, AJ)
+OPFMT(OP_JMPNOT, AJ)
+OPFMT(OP_ONERR, J)
+OPFMT(OP_RESCUE, A)
+OPFMT(OP_POPERR, A)
+OPFMT(OP_RAISE, A)
+OPFMT(OP_EPUSH, Bx)
+OPFMT(OP_EPOP, A)
+OPFMT(OP_SEND, ABC)
+OPFMT(OP_SENDB, ABC)
+OPFMT(OP_FSEND, ABC)
+OPFMT(OP_CALL, A)
+OPFMT(OP_SUPER, ABC)
+OPFMT(OP_ARGARY, ABx)
+OPFMT(OP_ENTER, Ax)
+OPFMT(OP_KARG, ABC)
+OPFMT(OP_KDICT, ABC)
+OPFMT(OP_RETURN, AB)
+OPFMT(OP_TAILCALL, ABC)
+OPFMT(OP_BLKPUSH, ABx)
+OPFMT(OP_ADD, ABC)
+OPFMT(OP_ADDI, ABC)
+OPFMT(OP_SUB, ABC)
+OPFMT(OP_SUBI, ABC)
+OPFMT(OP_MUL, ABC)
+OPFMT(OP_DIV, ABC)
+OPFMT(OP_EQ, ABC)
+OPFMT(OP_LT, ABC)
+OPFMT(OP_LE, ABC)
+OPFMT(OP_GT, ABC)
+OPFMT(OP_GE, ABC)
+OPFMT(OP_ARRAY, ABC)
+OPFMT(OP_ARYCAT, AB)
+OPFMT(OP_ARYPUSH, AB)
+OPFMT(OP_AREF, ABC)
+OPFMT(OP_ASET, ABC)
+OPFMT(OP_APOST, ABC)
+OPFMT(OP_STRING, ABx)
+OPFMT(OP_STRCAT, AB)
+OPFMT(OP_HASH, ABC)
+OPFMT(OP_LAMBDA, ABx)
+OPFMT(OP_RANGE, ABC)
+OPFMT(OP_OCLASS, A)
+OPFMT(OP_CLASS, AB)
+OPFMT(OP_MODULE, AB)
+OPFMT(OP_EXEC, ABx)
+OPFMT(OP_METHOD, AB)
+OPFMT(OP_SCLASS, AB)
+OPFMT(OP_TCLASS, A)
+OPFMT(OP_DEBUG, ABC)
+OPFMT(OP_STOP, Z)
+OPFMT(OP_ERR, ABx)
+OPFMT(OP_YIELD, ABC)
@@ -12,7 +12,9 @@
 #include "mruby/proc.h"
 #include "mruby/string.h"
 #include "mruby/debug.h"
+#include "dump_util.h"
 #include "mruby/error.h"
+#include "mruby/numeric.h"
 
 #if !defined(_WIN32) && SIZE_MAX < UINT32_MAX
 # define SIZE_ERROR_MUL(x, y) ((x) > SIZE_MAX / (y))
@@ -30,15 +32,72 @@
 # error This code cannot be built on your environment.
 #endif
 
+#define FLAG_SRC_MALLOC       1
+#define FLAG_SRC_STATIC       0
+#define FLAG_BYTEORDER_LIL    2
+#define FLAG_BYTEORDER_NATIVE 4
+#define FLAG_POOL_TEXT        8
+#define FLAG_ISEQ_COMPACT     16
+#define FLAG_ISEQ_UNPADDED    32
+
+#ifndef MRB_NO_CRC_CHECK
 static size_t
 offset_crc_body(void)
 {
   struct rite_binary_header header;
   return ((uint8_t *)header.binary_crc - (uint8_t *)&header) + sizeof(header.binary_crc);
 }
+#endif
 
-static mrb_irep*
-read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool alloc)
+static mrb_value
+read_pool_number(mrb_state *mrb, uint16_t tt, const uint8_t *src)
+{
+  int64_t n;
+
+  switch (tt) {
+  case IREP_TT_FIXNUM:
+    n = (int64_t)bin_to_uint64l(src);
+    if (FIXABLE(n)) {
+      return mrb_fixnum_value((mrb_int)n);
+    }
+    /* dumped with a wider mrb_int */
+    return mrb_float_pool(mrb, (mrb_float)n);
+
+  case IREP_TT_FLOAT:
+    return mrb_float_pool(mrb, (mrb_float)bin_to_double(src));
+
+  default:
+    /* should not happen */
+    return mrb_nil_value();
+  }
+}
+
+/* reads n packed instructions in the byte order given by flags */
+static void
+read_iseq_words(const uint8_t *src, size_t n, uint8_t flags, mrb_insn *iseq)
+{
+  size_t i;
+
+  if (flags & FLAG_BYTEORDER_NATIVE) {
+    memcpy(iseq, src, sizeof(uint32_t) * n);
+  }
+  else if (flags & FLAG_BYTEORDER_LIL) {
+    for (i = 0; i < n; i++) {
+      iseq[i] = (mrb_insn)bin_to_uint32l(src);     /* iseq */
+      src += sizeof(uint32_t);
+    }
+  }
+  else {
+    for (i = 0; i < n; i++) {
+      iseq[i] = (mrb_insn)bin_to_uint32(src);     /* iseq */
+      src += sizeof(uint32_t);
+    }
+  }
+}
+
+/* pos is the offset of the record from the top of the binary */
+static mrb_bool
+read_irep_record_body(mrb_state *mrb, mrb_irep *irep, const uint8_t *bin, size_t *len, size_t pos, uint8_t flags)
 {
   size_t i;
   const uint8_t *src = bin;
@@ -46,7 +105,7 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
   uint16_t tt, pool_data_len, snl;
   size_t plen;
   int ai = mrb_gc_arena_save(mrb);
-  mrb_irep *irep = mrb_add_irep(mrb);
+  mrb_bool alloc = (flags & FLAG_SRC_MALLOC) != 0;
 
   /* skip record size */
   src += sizeof(uint32_t);
@@ -67,15 +126,57 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
   /* ISEQ BLOCK */
   irep->ilen = (size_t)bin_to_uint32(src);
   src += sizeof(uint32_t);
+  if (!(flags & (FLAG_ISEQ_COMPACT|FLAG_ISEQ_UNPADDED))) {
+    src += iseq_padding(pos + (src - bin));
+  }
   if (irep->ilen > 0) {
-    if (SIZE_ERROR_MUL(sizeof(mrb_code), irep->ilen)) {
-      return NULL;
+    if (SIZE_ERROR_MUL(sizeof(uint32_t), irep->ilen)) {
+      return FALSE;
     }
-    irep->iseq = (mrb_code *)mrb_malloc(mrb, sizeof(mrb_code) * irep->ilen);
-    for (i = 0; i < irep->ilen; i++) {
-      irep->iseq[i] = (size_t)bin_to_uint32(src);     /* iseq */
-      src += sizeof(uint32_t);
+#ifdef MRB_COMPACT_ISEQ
+    if (flags & FLAG_ISEQ_COMPACT) {
+      if (!alloc) {
+        /* execute in place; the binary outlives the state */
+        irep->iseq = (mrb_code *)src;
+        irep->flags |= MRB_ISEQ_NO_FREE;
+      }
+      else {
+        irep->iseq = (mrb_code *)mrb_malloc(mrb, irep->ilen);
+        memcpy(irep->iseq, src, irep->ilen);
+      }
+      src += irep->ilen;
+    }
+    else {
+      mrb_insn *words = (mrb_insn *)mrb_malloc(mrb, sizeof(mrb_insn) * irep->ilen);
+      size_t n = irep->ilen;
+
+      read_iseq_words(src, n, flags, words);
+      src += sizeof(uint32_t) * n;
+      irep->iseq = mrb_iseq_encode(mrb, words, n, &irep->ilen);
+      mrb_free(mrb, words);
+      if (!irep->iseq) return FALSE;
+    }
+#else
+    if (flags & FLAG_ISEQ_COMPACT) {
+      size_t len = irep->ilen;
+
+      irep->iseq = mrb_iseq_decode(mrb, src, len, &irep->ilen);
+      src += len;
+      if (!irep->iseq) return FALSE;
+    }
+    else if (!alloc && (flags & FLAG_BYTEORDER_NATIVE) &&
+        ((uintptr_t)src % MRB_DUMP_ALIGNMENT) == 0) {
+      /* execute in place; the binary outlives the state */
+      irep->iseq = (mrb_code *)src;
+      irep->flags |= MRB_ISEQ_NO_FREE;
+      src += sizeof(uint32_t) * irep->ilen;
     }
+    else {
+      irep->iseq = (mrb_code *)mrb_malloc(mrb, sizeof(mrb_code) * irep->ilen);
+      read_iseq_words(src, irep->ilen, flags, irep->iseq);
+      src += sizeof(uint32_t) * irep->ilen;
+    }
+#endif
   }
 
   /* POOL BLOCK */
@@ -83,7 +184,7 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
   src += sizeof(uint32_t);
   if (plen > 0) {
     if (SIZE_ERROR_MUL(sizeof(mrb_value), plen)) {
-      return NULL;
+      return FALSE;
     }
     irep->pool = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value) * plen);
 
@@ -93,31 +194,40 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
       tt = *src++; /* pool TT */
       pool_data_len = bin_to_uint16(src); /* pool data length */
       src += sizeof(uint16_t);
-      if (alloc) {
-        s = mrb_str_new(mrb, (char *)src, pool_data_len);
+      if (tt != IREP_TT_STRING && !(flags & FLAG_POOL_TEXT)) {
+        /* numbers are stored in binary */
+        if (pool_data_len != MRB_DUMP_POOL_NUM_LEN) {
+          return FALSE;
+        }
+        irep->pool[i] = read_pool_number(mrb, tt, src);
       }
       else {
-        s = mrb_str_new_static(mrb, (char *)src, pool_data_len);
+        if (alloc) {
+          s = mrb_str_new(mrb, (char *)src, pool_data_len);
+        }
+        else {
+          s = mrb_str_new_static(mrb, (char *)src, pool_data_len);
+        }
+        switch (tt) { /* pool data */
+        case IREP_TT_FIXNUM:
+          irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
+          break;
+
+        case IREP_TT_FLOAT:
+          irep->pool[i] = mrb_float_pool(mrb, mrb_str_to_dbl(mrb, s, FALSE));
+          break;
+
+        case IREP_TT_STRING:
+          irep->pool[i] = mrb_str_pool(mrb, s);
+          break;
+
+        default:
+          /* should not happen */
+          irep->pool[i] = mrb_nil_value();
+          break;
+        }
       }
       src += pool_data_len;
-      switch (tt) { /* pool data */
-      case IREP_TT_FIXNUM:
-        irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
-        break;
-
-      case IREP_TT_FLOAT:
-        irep->pool[i] = mrb_float_pool(mrb, mrb_str_to_dbl(mrb, s, FALSE));
-        break;
-
-      case IREP_TT_STRING:
-        irep->pool[i] = mrb_str_pool(mrb, s);
-        break;
-
-      default:
-        /* should not happen */
-        irep->pool[i] = mrb_nil_value();
-        break;
-      }
       irep->plen++;
       mrb_gc_arena_restore(mrb, ai);
     }
@@ -128,7 +238,7 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
   src += sizeof(uint32_t);
   if (irep->slen > 0) {
     if (SIZE_ERROR_MUL(sizeof(mrb_sym), irep->slen)) {
-      return NULL;
+      return FALSE;
     }
     irep->syms = (mrb_sym *)mrb_malloc(mrb, sizeof(mrb_sym) * irep->slen);
 
@@ -159,33 +269,58 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool all
   mrb_assert_int_fit(ptrdiff_t, diff, size_t, SIZE_MAX);
   *len = (size_t)diff;
 
+  return TRUE;
+}
+
+static mrb_irep*
+read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, size_t pos, uint8_t flags)
+{
+  mrb_irep *irep = mrb_add_irep(mrb);
+
+  if (!read_irep_record_body(mrb, irep, bin, len, pos, flags)) {
+    return NULL;
+  }
   return irep;
 }
 
 static mrb_irep*
-read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, mrb_bool alloc)
+read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, size_t pos, uint8_t flags)
 {
-  mrb_irep *irep = read_irep_record_1(mrb, bin, len, alloc);
+  mrb_irep *irep = read_irep_record_1(mrb, bin, len, pos, flags);
   size_t i;
 
+  if (!irep) return NULL;
   bin += *len;
   for (i=0; i<irep->rlen; i++) {
     size_t rlen;
 
-    irep->reps[i] = read_irep_record(mrb, bin, &rlen, alloc);
+    irep->reps[i] = read_irep_record(mrb, bin, &rlen, pos + *len, flags);
+    if (!irep->reps[i]) return NULL;
     bin += rlen;
     *len += rlen;
   }
   return irep;
 }
 
+/* FLAG_ISEQ_COMPACT if the iseqs of the section are in the compact form */
+static uint8_t
+iseq_format_flags(const struct rite_section_irep_header *header)
+{
+  if (memcmp(header->rite_version, RITE_VM_VER_COMPACT, sizeof(header->rite_version)) == 0) {
+    return FLAG_ISEQ_COMPACT;
+  }
+  return 0;
+}
+
 static mrb_irep*
-read_section_irep(mrb_state *mrb, const uint8_t *bin, mrb_bool alloc)
+read_section_irep(mrb_state *mrb, const uint8_t *bin, size_t pos, uint8_t flags)
 {
   size_t len;
 
+  flags |= iseq_format_flags((const struct rite_section_irep_header *)bin);
   bin += sizeof(struct rite_section_irep_header);
-  return read_irep_record(mrb, bin, &len, alloc);
+  pos += sizeof(struct rite_section_irep_header);
+  return read_irep_record(mrb, bin, &len, pos, flags);
 }
 
 static int
@@ -260,17 +395,17 @@ read_section_lineno(mrb_state *mrb, const uint8_t *bin, mrb_irep *irep)
 }
 
 static int
-read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
+read_debug_record_1(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
 {
   const uint8_t *bin = start;
   ptrdiff_t diff;
-  size_t record_size, i;
+  size_t record_size;
   uint16_t f_idx;
 
   if (irep->debug_info) { return MRB_DUMP_INVALID_IREP; }
 
   irep->debug_info = (mrb_irep_debug_info*)mrb_malloc(mrb, sizeof(mrb_irep_debug_info));
-  irep->debug_info->pc_count = irep->ilen;
+  irep->debug_info->pc_count = (uint32_t)mrb_iseq_index(irep, irep->iseq + irep->ilen);
 
   record_size = (size_t)bin_to_uint32(bin);
   bin += sizeof(uint32_t);
@@ -336,12 +471,25 @@ read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *
   if (record_size != (size_t)diff) {
     return MRB_DUMP_GENERAL_FAILURE;
   }
+  *record_len = record_size;
 
-  for (i = 0; i < irep->rlen; i++) {
-    size_t len;
-    int ret;
+  return MRB_DUMP_OK;
+}
+
+static int
+read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
+{
+  const uint8_t *bin = start;
+  ptrdiff_t diff;
+  size_t len, i;
+  int ret;
+
+  ret = read_debug_record_1(mrb, bin, irep, &len, filenames, filenames_len);
+  if (ret != MRB_DUMP_OK) return ret;
+  bin += len;
 
-    ret =read_debug_record(mrb, bin, irep->reps[i], &len, filenames, filenames_len);
+  for (i = 0; i < irep->rlen; i++) {
+    ret = read_debug_record(mrb, bin, irep->reps[i], &len, filenames, filenames_len);
     if (ret != MRB_DUMP_OK) return ret;
     bin += len;
   }
@@ -353,22 +501,13 @@ read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *
   return MRB_DUMP_OK;
 }
 
-static int
-read_section_debug(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_bool alloc)
+static size_t
+read_debug_filenames(mrb_state *mrb, const uint8_t *start, mrb_sym **filenamesp, uint16_t *filenames_lenp, mrb_bool alloc)
 {
-  const uint8_t *bin;
-  ptrdiff_t diff;
-  struct rite_section_debug_header *header;
-  uint16_t i;
-  size_t len = 0;
-  int result;
-  uint16_t filenames_len;
+  const uint8_t *bin = start;
+  uint16_t i, filenames_len;
   mrb_sym *filenames;
 
-  bin = start;
-  header = (struct rite_section_debug_header *)bin;
-  bin += sizeof(struct rite_section_debug_header);
-
   filenames_len = bin_to_uint16(bin);
   bin += sizeof(uint16_t);
   filenames = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym) * (size_t)filenames_len);
@@ -383,6 +522,26 @@ read_section_debug(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_boo
     }
     bin += f_len;
   }
+  *filenamesp = filenames;
+  *filenames_lenp = filenames_len;
+  return (size_t)(bin - start);
+}
+
+static int
+read_section_debug(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_bool alloc)
+{
+  const uint8_t *bin;
+  ptrdiff_t diff;
+  struct rite_section_debug_header *header;
+  size_t len = 0;
+  int result;
+  uint16_t filenames_len;
+  mrb_sym *filenames;
+
+  bin = start;
+  header = (struct rite_section_debug_header *)bin;
+  bin += sizeof(struct rite_section_debug_header);
+  bin += read_debug_filenames(mrb, bin, &filenames, &filenames_len, alloc);
 
   result = read_debug_record(mrb, bin, irep, &len, filenames, filenames_len);
   if (result != MRB_DUMP_OK) goto debug_exit;
@@ -399,12 +558,18 @@ debug_exit:
   return result;
 }
 
+/* size of the lv record of an irep with nlocals local variables */
+static size_t
+lv_record_size(uint16_t nlocals)
+{
+  return nlocals > 0 ? (size_t)(nlocals - 1) * sizeof(uint16_t) * 2 : 0;
+}
+
 static int
-read_lv_record(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, size_t *record_len, mrb_sym const *syms, uint32_t syms_len)
+read_lv_record_1(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_sym const *syms, uint32_t syms_len)
 {
   const uint8_t *bin = start;
   size_t i;
-  ptrdiff_t diff;
 
   irep->lv = (struct mrb_locals*)mrb_malloc(mrb, sizeof(struct mrb_locals) * (irep->nlocals - 1));
 
@@ -425,10 +590,23 @@ read_lv_record(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, size_t *rec
     }
     bin += sizeof(uint16_t);
   }
+  return MRB_DUMP_OK;
+}
+
+static int
+read_lv_record(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, size_t *record_len, mrb_sym const *syms, uint32_t syms_len)
+{
+  const uint8_t *bin = start;
+  size_t i;
+  ptrdiff_t diff;
+  int ret;
+
+  ret = read_lv_record_1(mrb, bin, irep, syms, syms_len);
+  if (ret != MRB_DUMP_OK) return ret;
+  bin += lv_record_size(irep->nlocals);
 
   for (i = 0; i < irep->rlen; ++i) {
     size_t len;
-    int ret;
 
     ret = read_lv_record(mrb, bin, irep->reps[i], &len, syms, syms_len);
     if (ret != MRB_DUMP_OK) return ret;
@@ -442,23 +620,14 @@ read_lv_record(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, size_t *rec
   return MRB_DUMP_OK;
 }
 
-static int
-read_section_lv(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_bool alloc)
+static size_t
+read_lv_syms(mrb_state *mrb, const uint8_t *start, mrb_sym **symsp, uint32_t *syms_lenp, mrb_bool alloc)
 {
-  const uint8_t *bin;
-  ptrdiff_t diff;
-  struct rite_section_lv_header const *header;
-  uint32_t i;
-  size_t len = 0;
-  int result;
-  uint32_t syms_len;
+  const uint8_t *bin = start;
+  uint32_t i, syms_len;
   mrb_sym *syms;
   mrb_sym (*intern_func)(mrb_state*, const char*, size_t) = alloc? mrb_intern : mrb_intern_static;
 
-  bin = start;
-  header = (struct rite_section_lv_header const*)bin;
-  bin += sizeof(struct rite_section_lv_header);
-
   syms_len = bin_to_uint32(bin);
   bin += sizeof(uint32_t);
   syms = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym) * (size_t)syms_len);
@@ -469,6 +638,26 @@ read_section_lv(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_bool a
     syms[i] = intern_func(mrb, (const char*)bin, str_len);
     bin += str_len;
   }
+  *symsp = syms;
+  *syms_lenp = syms_len;
+  return (size_t)(bin - start);
+}
+
+static int
+read_section_lv(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, mrb_bool alloc)
+{
+  const uint8_t *bin;
+  ptrdiff_t diff;
+  struct rite_section_lv_header const *header;
+  size_t len = 0;
+  int result;
+  uint32_t syms_len;
+  mrb_sym *syms;
+
+  bin = start;
+  header = (struct rite_section_lv_header const*)bin;
+  bin += sizeof(struct rite_section_lv_header);
+  bin += read_lv_syms(mrb, bin, &syms, &syms_len, alloc);
 
   result = read_lv_record(mrb, bin, irep, &len, syms, syms_len);
   if (result != MRB_DUMP_OK) goto lv_exit;
@@ -485,16 +674,239 @@ lv_exit:
   return result;
 }
 
+/*
+ * Lazy loading: a binary loaded from a buffer that outlives the state is
+ * decoded one irep at a time.  Children are created as stubs
+ * (MRB_IREP_LAZY) that remember where their records are and are decoded
+ * when first turned into a proc; debug info is decoded when a backtrace
+ * first asks for a line number.
+ */
+
+/* shared by all ireps of a binary that still have undecoded parts */
+struct mrb_lazy_binary {
+  mrb_state *mrb;
+  const uint8_t *top;
+  uint8_t flags;
+  mrb_sym *filenames;
+  uint16_t filenames_len;
+  mrb_sym *lv_syms;
+  uint32_t lv_syms_len;
+  size_t refcnt;
+};
+
+struct mrb_irep_lazy {
+  struct mrb_lazy_binary *bin;
+  /* record offsets from the top of the binary; 0 if there is no section */
+  uint32_t irep, debug, lv;
+};
+
+static void
+lazy_binary_decref(mrb_state *mrb, struct mrb_lazy_binary *lb)
+{
+  if (--lb->refcnt > 0) return;
+  mrb_free(mrb, lb->filenames);
+  mrb_free(mrb, lb->lv_syms);
+  mrb_free(mrb, lb);
+}
+
+void
+mrb_irep_lazy_free(mrb_state *mrb, mrb_irep *irep)
+{
+  if (!irep->lazy) return;
+  lazy_binary_decref(mrb, irep->lazy->bin);
+  mrb_free(mrb, irep->lazy);
+  irep->lazy = NULL;
+}
+
+static mrb_irep*
+lazy_irep_new(mrb_state *mrb, const struct mrb_irep_lazy *pos)
+{
+  mrb_irep *irep = mrb_add_irep(mrb);
+
+  irep->lazy = (struct mrb_irep_lazy*)mrb_malloc(mrb, sizeof(struct mrb_irep_lazy));
+  *irep->lazy = *pos;
+  irep->lazy->bin->refcnt++;
+  irep->flags |= MRB_IREP_LAZY;
+  return irep;
+}
+
+/* advance pos past the records of an irep and all of its children */
+static void
+lazy_skip(const uint8_t *top, struct mrb_irep_lazy *pos)
+{
+  const uint8_t *rec = top + pos->irep;
+  uint16_t nlocals = bin_to_uint16(rec + sizeof(uint32_t));
+  uint16_t rlen = bin_to_uint16(rec + sizeof(uint32_t) + sizeof(uint16_t) * 2);
+  uint16_t i;
+
+  pos->irep += bin_to_uint32(rec);
+  if (pos->debug) pos->debug += bin_to_uint32(top + pos->debug);
+  if (pos->lv) pos->lv += (uint32_t)lv_record_size(nlocals);
+  for (i = 0; i < rlen; i++) {
+    lazy_skip(top, pos);
+  }
+}
+
+static mrb_bool
+lazy_load(mrb_state *mrb, mrb_irep *irep)
+{
+  struct mrb_irep_lazy *l = irep->lazy;
+  struct mrb_lazy_binary *lb = l->bin;
+  struct mrb_irep_lazy pos = *l;
+  size_t len, i;
+
+  if (!read_irep_record_body(mrb, irep, lb->top + l->irep, &len, l->irep, lb->flags)) {
+    return FALSE;
+  }
+  irep->flags &= ~MRB_IREP_LAZY;
+  if (l->lv && read_lv_record_1(mrb, lb->top + l->lv, irep, lb->lv_syms, lb->lv_syms_len) != MRB_DUMP_OK) {
+    return FALSE;
+  }
+
+  /* the first child follows this irep in every section */
+  pos.irep += (uint32_t)len;
+  if (pos.debug) pos.debug += bin_to_uint32(lb->top + pos.debug);
+  if (pos.lv) pos.lv += (uint32_t)lv_record_size(irep->nlocals);
+  for (i = 0; i < irep->rlen; i++) {
+    irep->reps[i] = lazy_irep_new(mrb, &pos);
+    lazy_skip(lb->top, &pos);
+  }
+
+  /* keep the debug record for later; otherwise nothing is left to load */
+  if (!l->debug) {
+    mrb_irep_lazy_free(mrb, irep);
+  }
+  return TRUE;
+}
+
+void
+mrb_irep_load_lazy(mrb_state *mrb, mrb_irep *irep)
+{
+  if (!lazy_load(mrb, irep)) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "irep load error");
+  }
+}
+
+void
+mrb_irep_load_debug(mrb_irep *irep)
+{
+  struct mrb_irep_lazy *l = irep->lazy;
+  struct mrb_lazy_binary *lb;
+  size_t len;
+
+  if (!l || (irep->flags & MRB_IREP_LAZY)) return;
+  lb = l->bin;
+  read_debug_record_1(lb->mrb, lb->top + l->debug, irep, &len, lb->filenames, lb->filenames_len);
+  mrb_irep_lazy_free(lb->mrb, irep);
+}
+
+void
+mrb_irep_load_all(mrb_state *mrb, mrb_irep *irep)
+{
+  size_t i;
+
+  if (irep->flags & MRB_IREP_LAZY) {
+    mrb_irep_load_lazy(mrb, irep);
+  }
+  mrb_irep_load_debug(irep);
+  for (i = 0; i < irep->rlen; i++) {
+    mrb_irep_load_all(mrb, irep->reps[i]);
+  }
+}
+
+static mrb_irep*
+read_binary_lazy(mrb_state *mrb, const uint8_t *top, uint8_t flags)
+{
+  const uint8_t *bin = top + sizeof(struct rite_binary_header);
+  const struct rite_section_header *section_header;
+  struct mrb_lazy_binary *lb;
+  struct mrb_irep_lazy pos = { NULL, 0, 0, 0 };
+  mrb_irep *irep;
+  size_t offset;
+
+  lb = (struct mrb_lazy_binary*)mrb_malloc(mrb, sizeof(struct mrb_lazy_binary));
+  lb->mrb = mrb;
+  lb->top = top;
+  lb->flags = flags;
+  lb->filenames = NULL;
+  lb->filenames_len = 0;
+  lb->lv_syms = NULL;
+  lb->lv_syms_len = 0;
+  lb->refcnt = 1;
+  pos.bin = lb;
+
+  do {
+    section_header = (const struct rite_section_header *)bin;
+    if (memcmp(section_header->section_identify, RITE_SECTION_IREP_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
+      pos.irep = (uint32_t)(bin - top + sizeof(struct rite_section_irep_header));
+      lb->flags |= iseq_format_flags((const struct rite_section_irep_header *)bin);
+    }
+    else if (memcmp(section_header->section_identify, RITE_SECTION_DEBUG_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
+      offset = sizeof(struct rite_section_debug_header);
+      offset += read_debug_filenames(mrb, bin + offset, &lb->filenames, &lb->filenames_len, FALSE);
+      pos.debug = (uint32_t)(bin - top + offset);
+    }
+    else if (memcmp(section_header->section_identify, RITE_SECTION_LV_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
+      offset = sizeof(struct rite_section_lv_header);
+      offset += read_lv_syms(mrb, bin + offset, &lb->lv_syms, &lb->lv_syms_len, FALSE);
+      pos.lv = (uint32_t)(bin - top + offset);
+    }
+    bin += bin_to_uint32(section_header->section_size);
+  } while (memcmp(section_header->section_identify, RITE_BINARY_EOF, sizeof(section_header->section_identify)) != 0);
+
+  irep = NULL;
+  if (pos.irep) {
+    irep = lazy_irep_new(mrb, &pos);
+    if (!lazy_load(mrb, irep)) {
+      irep = NULL;
+    }
+  }
+  lazy_binary_decref(mrb, lb);
+  return irep;
+}
+
+/* LINE sections (no per-irep debug_info) are only read eagerly */
+static mrb_bool
+has_lineno_section(const uint8_t *bin)
+{
+  const struct rite_section_header *section_header;
+
+  bin += sizeof(struct rite_binary_header);
+  do {
+    section_header = (const struct rite_section_header *)bin;
+    if (memcmp(section_header->section_identify, RITE_SECTION_LINENO_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
+      return TRUE;
+    }
+    bin += bin_to_uint32(section_header->section_size);
+  } while (memcmp(section_header->section_identify, RITE_BINARY_EOF, sizeof(section_header->section_identify)) != 0);
+  return FALSE;
+}
+
 static int
-read_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc)
+read_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc, uint8_t *flags)
 {
   const struct rite_binary_header *header = (const struct rite_binary_header *)bin;
 
-  if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify)) != 0) {
+  if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER, sizeof(header->binary_identify)) == 0) {
+    if (bigendian_p())
+      *flags |= FLAG_BYTEORDER_NATIVE;
+  }
+  else if (memcmp(header->binary_identify, RITE_BINARY_IDENTIFIER_LIL, sizeof(header->binary_identify)) == 0) {
+    *flags |= FLAG_BYTEORDER_LIL;
+    if (!bigendian_p())
+      *flags |= FLAG_BYTEORDER_NATIVE;
+  }
+  else {
     return MRB_DUMP_INVALID_FILE_HEADER;
   }
 
-  if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version)) != 0) {
+  if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_TEXT_POOL, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_POOL_TEXT;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER_UNPADDED, sizeof(header->binary_version)) == 0) {
+    *flags |= FLAG_POOL_TEXT | FLAG_ISEQ_UNPADDED;
+  }
+  else if (memcmp(header->binary_version, RITE_BINARY_FORMAT_VER, sizeof(header->binary_version)) != 0) {
     return MRB_DUMP_INVALID_FILE_HEADER;
   }
 
@@ -506,35 +918,51 @@ read_binary_header(const uint8_t *bin, size_t *bin_size, uint16_t *crc)
   return MRB_DUMP_OK;
 }
 
+static mrb_bool
+check_crc(const uint8_t *bin, size_t bin_size, uint16_t crc)
+{
+#ifdef MRB_NO_CRC_CHECK
+  return TRUE;
+#else
+  size_t n = offset_crc_body();
+
+  return crc == calc_crc_16_ccitt(bin + n, bin_size - n, 0);
+#endif
+}
+
 mrb_irep*
 mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
 {
   int result;
   mrb_irep *irep = NULL;
   const struct rite_section_header *section_header;
+  const uint8_t *top = bin;
   uint16_t crc;
   size_t bin_size = 0;
-  size_t n;
+  uint8_t flags = FLAG_SRC_STATIC;
 
   if ((mrb == NULL) || (bin == NULL)) {
     return NULL;
   }
 
-  result = read_binary_header(bin, &bin_size, &crc);
+  result = read_binary_header(bin, &bin_size, &crc, &flags);
   if (result != MRB_DUMP_OK) {
     return NULL;
   }
 
-  n = offset_crc_body();
-  if (crc != calc_crc_16_ccitt(bin + n, bin_size - n, 0)) {
+  if (!check_crc(bin, bin_size, crc)) {
     return NULL;
   }
 
+  if (!has_lineno_section(bin)) {
+    return read_binary_lazy(mrb, bin, flags);
+  }
+
   bin += sizeof(struct rite_binary_header);
   do {
     section_header = (const struct rite_section_header *)bin;
     if (memcmp(section_header->section_identify, RITE_SECTION_IREP_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
-      irep = read_section_irep(mrb, bin, FALSE);
+      irep = read_section_irep(mrb, bin, (size_t)(bin - top), flags);
       if (!irep) return NULL;
     }
     else if (memcmp(section_header->section_identify, RITE_SECTION_LINENO_IDENTIFIER, sizeof(section_header->section_identify)) == 0) {
@@ -564,6 +992,8 @@ mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
   return irep;
 }
 
+void mrb_codedump_all(mrb_state*, struct RProc*);
+
 static void
 irep_error(mrb_state *mrb)
 {
@@ -583,6 +1013,7 @@ mrb_load_irep_cxt(mrb_state *mrb, const uint8_t *bin, mrbc_context *c)
   }
   proc = mrb_proc_new(mrb, irep);
   mrb_irep_decref(mrb, irep);
+  if (c && c->dump_result) mrb_codedump_all(mrb, proc);
   if (c && c->no_exec) return mrb_obj_value(proc);
   val = mrb_toplevel_run(mrb, proc);
   return val;
@@ -644,17 +1075,18 @@ read_section_lineno_file(mrb_state *mrb, FILE *fp, mrb_irep *irep)
 }
 
 static mrb_irep*
-read_irep_record_file(mrb_state *mrb, FILE *fp)
+read_irep_record_file(mrb_state *mrb, FILE *fp, uint8_t flags)
 {
   uint8_t header[1 + 4];
   const size_t record_header_size = sizeof(header);
   size_t buf_size, i;
   size_t len;
+  long pos = ftell(fp);
   mrb_irep *irep = NULL;
   void *ptr;
   uint8_t *buf;
 
-  if (fread(header, record_header_size, 1, fp) == 0) {
+  if (pos < 0 || fread(header, record_header_size, 1, fp) == 0) {
     return NULL;
   }
   buf_size = (size_t)bin_to_uint32(&header[0]);
@@ -667,25 +1099,59 @@ read_irep_record_file(mrb_state *mrb, FILE *fp)
   if (fread(&buf[record_header_size], buf_size - record_header_size, 1, fp) == 0) {
     return NULL;
   }
-  irep = read_irep_record_1(mrb, buf, &len, TRUE);
+  irep = read_irep_record_1(mrb, buf, &len, (size_t)pos, flags);
   mrb_free(mrb, ptr);
   if (!irep) return NULL;
   for (i=0; i<irep->rlen; i++) {
-    irep->reps[i] = read_irep_record_file(mrb, fp);
+    irep->reps[i] = read_irep_record_file(mrb, fp, flags);
     if (!irep->reps[i]) return NULL;
   }
   return irep;
 }
 
 static mrb_irep*
-read_section_irep_file(mrb_state *mrb, FILE *fp)
+read_section_irep_file(mrb_state *mrb, FILE *fp, uint8_t flags)
 {
   struct rite_section_irep_header header;
 
   if (fread(&header, sizeof(struct rite_section_irep_header), 1, fp) == 0) {
     return NULL;
   }
-  return read_irep_record_file(mrb, fp);
+  flags |= iseq_format_flags(&header);
+  return read_irep_record_file(mrb, fp, flags);
+}
+
+static mrb_bool
+check_crc_file(mrb_state *mrb, FILE *fp, uint16_t crc)
+{
+#ifdef MRB_NO_CRC_CHECK
+  return TRUE;
+#else
+  uint8_t *buf = NULL;
+  uint16_t crcwk = 0;
+  size_t nbytes;
+  size_t block_size = 1 << 14;
+  const uint8_t block_fallback_count = 4;
+  int i;
+
+  /* You don't need use SIZE_ERROR as block_size is enough small. */
+  for (i = 0; i < block_fallback_count; i++,block_size >>= 1) {
+    buf = (uint8_t*)mrb_malloc_simple(mrb, block_size);
+    if (buf) break;
+  }
+  if (!buf) {
+    return FALSE;
+  }
+  fseek(fp, offset_crc_body(), SEEK_SET);
+  while ((nbytes = fread(buf, 1, block_size, fp)) > 0) {
+    crcwk = calc_crc_16_ccitt(buf, nbytes, crcwk);
+  }
+  mrb_free(mrb, buf);
+  if (nbytes == 0 && ferror(fp)) {
+    return FALSE;
+  }
+  return crcwk == crc;
+#endif
 }
 
 mrb_irep*
@@ -694,15 +1160,12 @@ mrb_read_irep_file(mrb_state *mrb, FILE* fp)
   mrb_irep *irep = NULL;
   int result;
   uint8_t *buf;
-  uint16_t crc, crcwk = 0;
+  uint16_t crc;
   size_t section_size = 0;
-  size_t nbytes;
   struct rite_section_header section_header;
   long fpos;
-  size_t block_size = 1 << 14;
-  const uint8_t block_fallback_count = 4;
-  int i;
   const size_t buf_size = sizeof(struct rite_binary_header);
+  uint8_t flags = FLAG_SRC_MALLOC;
 
   if ((mrb == NULL) || (fp == NULL)) {
     return NULL;
@@ -714,7 +1177,7 @@ mrb_read_irep_file(mrb_state *mrb, FILE* fp)
     mrb_free(mrb, buf);
     return NULL;
   }
-  result = read_binary_header(buf, NULL, &crc);
+  result = read_binary_header(buf, NULL, &crc, &flags);
   mrb_free(mrb, buf);
   if (result != MRB_DUMP_OK) {
     return NULL;
@@ -722,23 +1185,7 @@ mrb_read_irep_file(mrb_state *mrb, FILE* fp)
 
   /* verify CRC */
   fpos = ftell(fp);
-  /* You don't need use SIZE_ERROR as block_size is enough small. */
-  for (i = 0; i < block_fallback_count; i++,block_size >>= 1) {
-    buf = (uint8_t*)mrb_malloc_simple(mrb, block_size);
-    if (buf) break;
-  }
-  if (!buf) {
-    return NULL;
-  }
-  fseek(fp, offset_crc_body(), SEEK_SET);
-  while ((nbytes = fread(buf, 1, block_size, fp)) > 0) {
-    crcwk = calc_crc_16_ccitt(buf, nbytes, crcwk);
-  }
-  mrb_free(mrb, buf);
-  if (nbytes == 0 && ferror(fp)) {
-    return NULL;
-  }
-  if (crcwk != crc) {
+  if (!check_crc_file(mrb, fp, crc)) {
     return NULL;
   }
   fseek(fp, fpos + section_size, SEEK_SET);
@@ -753,7 +1200,7 @@ mrb_read_irep_file(mrb_state *mrb, FILE* fp)
 
     if (memcmp(section_header.section_identify, RITE_SECTION_IREP_IDENTIFIER, sizeof(section_header.section_identify)) == 0) {
       fseek(fp, fpos, SEEK_SET);
-      irep = read_section_irep_file(mrb, fp);
+      irep = read_section_irep_file(mrb, fp, flags);
       if (!irep) return NULL;
     }
     else if (memcmp(section_header.section_identify, RITE_SECTION_LINENO_IDENTIFIER, sizeof(section_header.section_identify)) == 0) {
@@ -799,8 +1246,6 @@ mrb_read_irep_file(mrb_state *mrb, FILE* fp)
   return irep;
 }
 
-void mrb_codedump_all(mrb_state*, struct RProc*);
-
 mrb_value
 mrb_load_irep_file_cxt(mrb_state *mrb, FILE* fp, mrbc_context *c)
 {
@@ -5296,6 +5296,7 @@ parser_init_cxt(parser_state *p, mrbc_context *cxt)
     }
   }
   p->capture_errors = cxt->capture_errors;
+  p->optimize = cxt->optimize;
   if (cxt->partial_hook) {
     p->cxt = cxt;
   }
@@ -10,7 +10,11 @@
 #include "mruby/opcode.h"
 
 static mrb_code call_iseq[] = {
+#ifdef MRB_COMPACT_ISEQ
+  OP_CALL, 0,
+#else
   MKOP_A(OP_CALL, 0),
+#endif
 };
 
 struct RProc *
@@ -149,8 +153,9 @@ mrb_proc_arity(mrb_state *mrb, mrb_value self)
 {
   struct RProc *p = mrb_proc_ptr(self);
   mrb_code *iseq = mrb_proc_iseq(mrb, p);
+  mrb_insn c;
   mrb_aspec aspec;
-  int ma, ra, pa, arity;
+  int ma, ra, pa, arity, len;
 
   if (MRB_PROC_CFUNC_P(p)) {
     /* TODO cfunc aspec not implemented yet */
@@ -158,11 +163,12 @@ mrb_proc_arity(mrb_state *mrb, mrb_value self)
   }
 
   /* arity is depend on OP_ENTER */
-  if (GET_OPCODE(*iseq) != OP_ENTER) {
+  c = mrb_iseq_fetch(iseq, &len);
+  if (GET_OPCODE(c) != OP_ENTER) {
     return mrb_fixnum_value(0);
   }
 
-  aspec = GETARG_Ax(*iseq);
+  aspec = GETARG_Ax(c);
   ma = MRB_ASPEC_REQ(aspec);
   ra = MRB_ASPEC_REST(aspec);
   pa = MRB_ASPEC_POST(aspec);
@@ -210,7 +216,7 @@ mrb_init_proc(mrb_state *mrb)
   *call_irep = mrb_irep_zero;
   call_irep->flags = MRB_ISEQ_NO_FREE;
   call_irep->iseq = call_iseq;
-  call_irep->ilen = 1;
+  call_irep->ilen = sizeof(call_iseq) / sizeof(call_iseq[0]);
 
   mrb_define_method(mrb, mrb->proc_class, "initialize", mrb_proc_initialize, MRB_ARGS_NONE());
   mrb_define_method(mrb, mrb->proc_class, "initialize_copy", mrb_proc_init_copy, MRB_ARGS_REQ(1));
@@ -158,66 +158,19 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
 #endif
   }
   mrb_free(mrb, irep->pool);
-  mrb_free(mrb, irep->syms);
   for (i=0; i<irep->rlen; i++) {
     mrb_irep_decref(mrb, irep->reps[i]);
   }
   mrb_free(mrb, irep->reps);
-  mrb_free(mrb, irep->lv);
-  mrb_free(mrb, (void *)irep->filename);
-  mrb_free(mrb, irep->lines);
-  mrb_debug_info_free(mrb, irep->debug_info);
-  mrb_free(mrb, irep);
-}
-
-mrb_value
-mrb_str_pool(mrb_state *mrb, mrb_value str)
-{
-  struct RString *s = mrb_str_ptr(str);
-  struct RString *ns;
-  char *ptr;
-  mrb_int len;
-
-  ns = (struct RString *)mrb_malloc(mrb, sizeof(struct RString));
-  ns->tt = MRB_TT_STRING;
-  ns->c = mrb->string_class;
-
-  if (RSTR_NOFREE_P(s)) {
-    ns->flags = MRB_STR_NOFREE;
-    ns->as.heap.ptr = s->as.heap.ptr;
-    ns->as.heap.len = s->as.heap.len;
-    ns->as.heap.aux.capa = 0;
+  if (!(irep->flags & MRB_IREP_DATA_NO_FREE)) {
+    mrb_free(mrb, irep->syms);
+    mrb_free(mrb, irep->lv);
+    mrb_free(mrb, (void *)irep->filename);
+    mrb_free(mrb, irep->lines);
+    mrb_debug_info_free(mrb, irep->debug_info);
   }
-  else {
-    ns->flags = 0;
-    if (RSTR_EMBED_P(s)) {
-      ptr = s->as.ary;
-      len = RSTR_EMBED_LEN(s);
-    }
-    else {
-      ptr = s->as.heap.ptr;
-      len = s->as.heap.len;
-    }
-
-    if (len < RSTRING_EMBED_LEN_MAX) {
-      RSTR_SET_EMBED_FLAG(ns);
-      RSTR_SET_EMBED_LEN(ns, len);
-      if (ptr) {
-        memcpy(ns->as.ary, ptr, len);
-      }
-      ns->as.ary[len] = '\0';
-    }
-    else {
-      ns->as.heap.ptr = (char *)mrb_malloc(mrb, (size_t)len+1);
-      ns->as.heap.len = len;
-      ns->as.heap.aux.capa = len;
-      if (ptr) {
-        memcpy(ns->as.heap.ptr, ptr, len);
-      }
-      ns->as.heap.ptr[len] = '\0';
-    }
-  }
-  return mrb_obj_value(ns);
+  mrb_irep_lazy_free(mrb, irep);
+  mrb_free(mrb, irep);
 }
 
 void
@@ -76,9 +76,26 @@ str_decref(mrb_state *mrb, mrb_shared_string *shared)
   }
 }
 
+/* copy len bytes from p into the object slot itself; p must not point
+   into s */
+static void
+str_embed(struct RString *s, const char *p, mrb_int len)
+{
+  RSTR_UNSET_SHARED_FLAG(s);
+  RSTR_UNSET_NOFREE_FLAG(s);
+  RSTR_SET_EMBED_FLAG(s);
+  RSTR_SET_EMBED_LEN(s, len);
+  if (p) {
+    memcpy(s->as.ary, p, len);
+  }
+  s->as.ary[len] = '\0';
+}
+
 void
 mrb_str_modify(mrb_state *mrb, struct RString *s)
 {
+  RSTR_UNSET_ASCII_FLAG(s);
+  RSTR_UNSET_INDEXED_FLAG(s);
   if (RSTR_SHARED_P(s)) {
     mrb_shared_string *shared = s->as.heap.aux.shared;
 
@@ -88,6 +105,11 @@ mrb_str_modify(mrb_state *mrb, struct RString *s)
       RSTR_PTR(s)[s->as.heap.len] = '\0';
       mrb_free(mrb, shared);
     }
+    else if (s->as.heap.len <= RSTRING_EMBED_LEN_MAX) {
+      str_embed(s, s->as.heap.ptr, s->as.heap.len);
+      str_decref(mrb, shared);
+      return;
+    }
     else {
       char *ptr, *p;
       mrb_int len;
@@ -109,6 +131,10 @@ mrb_str_modify(mrb_state *mrb, struct RString *s)
   if (RSTR_NOFREE_P(s)) {
     char *p = s->as.heap.ptr;
 
+    if (s->as.heap.len <= RSTRING_EMBED_LEN_MAX) {
+      str_embed(s, p, s->as.heap.len);
+      return;
+    }
     s->as.heap.ptr = (char *)mrb_malloc(mrb, (size_t)s->as.heap.len+1);
     if (p) {
       memcpy(RSTR_PTR(s), p, s->as.heap.len);
@@ -146,7 +172,7 @@ str_new(mrb_state *mrb, const char *p, size_t len)
   struct RString *s;
 
   s = mrb_obj_alloc_string(mrb);
-  if (len < RSTRING_EMBED_LEN_MAX) {
+  if (len <= RSTRING_EMBED_LEN_MAX) {
     RSTR_SET_EMBED_FLAG(s);
     RSTR_SET_EMBED_LEN(s,len);
     if (p) {
@@ -232,7 +258,7 @@ str_buf_cat(mrb_state *mrb, struct RString *s, const char *ptr, size_t len)
   if (capa <= total) {
     while (total > capa) {
       if (capa + 1 >= MRB_INT_MAX / 2) {
-        capa = (total + 4095) / 4096;
+        capa = (total + 4095) / 4096 * 4096;
         break;
       }
       capa = (capa + 1) * 2;
@@ -306,6 +332,34 @@ mrb_gc_free_str(mrb_state *mrb, struct RString *str)
     mrb_free(mrb, str->as.heap.ptr);
 }
 
+/* give a string copied from an image a buffer of its own */
+void
+mrb_gc_copy_str(mrb_state *mrb, struct RString *str)
+{
+  mrb_int len, capa;
+  char *p;
+
+  if (RSTR_EMBED_P(str) || RSTR_NOFREE_P(str)) return;
+  len = str->as.heap.len;
+  if (RSTR_SHARED_P(str)) {
+    if (str->as.heap.aux.shared->nofree) {
+      str->flags = (str->flags & ~MRB_STR_SHARED) | MRB_STR_NOFREE;
+      str->as.heap.aux.capa = 0;
+      return;
+    }
+    str->flags &= ~MRB_STR_SHARED;
+    capa = len;
+  }
+  else {
+    capa = str->as.heap.aux.capa;
+  }
+  p = (char *)mrb_malloc(mrb, (size_t)capa+1);
+  memcpy(p, str->as.heap.ptr, len);
+  p[len] = '\0';
+  str->as.heap.ptr = p;
+  str->as.heap.aux.capa = capa;
+}
+
 char *
 mrb_str_to_cstr(mrb_state *mrb, mrb_value str0)
 {
@@ -360,6 +414,70 @@ str_make_shared(mrb_state *mrb, struct RString *s)
   }
 }
 
+/*
+ * Makes a string for an irep pool.  Pool strings live outside the GC
+ * heap and are released by mrb_irep_free().  Long literals share the
+ * buffer of +str+ instead of copying it, so identical literals handed
+ * in more than once (see new_lit() in codegen.c) are stored only once.
+ */
+mrb_value
+mrb_str_pool(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = mrb_str_ptr(str);
+  struct RString *ns;
+  char *ptr;
+  mrb_int len;
+
+  ns = (struct RString *)mrb_malloc(mrb, sizeof(struct RString));
+  ns->tt = MRB_TT_STRING;
+  ns->c = mrb->string_class;
+
+  if (RSTR_NOFREE_P(s)) {
+    ns->flags = MRB_STR_NOFREE;
+    ns->as.heap.ptr = s->as.heap.ptr;
+    ns->as.heap.len = s->as.heap.len;
+    ns->as.heap.aux.capa = 0;
+  }
+  else if (!RSTR_EMBED_P(s) && s->as.heap.len > RSTRING_EMBED_LEN_MAX) {
+    str_make_shared(mrb, s);
+    ns->flags = MRB_STR_SHARED;
+    ns->as.heap.ptr = s->as.heap.ptr;
+    ns->as.heap.len = s->as.heap.len;
+    ns->as.heap.aux.shared = s->as.heap.aux.shared;
+    ns->as.heap.aux.shared->refcnt++;
+  }
+  else {
+    ns->flags = 0;
+    if (RSTR_EMBED_P(s)) {
+      ptr = s->as.ary;
+      len = RSTR_EMBED_LEN(s);
+    }
+    else {
+      ptr = s->as.heap.ptr;
+      len = s->as.heap.len;
+    }
+
+    if (len <= RSTRING_EMBED_LEN_MAX) {
+      RSTR_SET_EMBED_FLAG(ns);
+      RSTR_SET_EMBED_LEN(ns, len);
+      if (ptr) {
+        memcpy(ns->as.ary, ptr, len);
+      }
+      ns->as.ary[len] = '\0';
+    }
+    else {
+      ns->as.heap.ptr = (char *)mrb_malloc(mrb, (size_t)len+1);
+      ns->as.heap.len = len;
+      ns->as.heap.aux.capa = len;
+      if (ptr) {
+        memcpy(ns->as.heap.ptr, ptr, len);
+      }
+      ns->as.heap.ptr[len] = '\0';
+    }
+  }
+  return mrb_obj_value(ns);
+}
+
 /*
  *  call-seq: (Caution! String("abcd") change)
  *     String("abcdefg") = String("abcd") + String("efg")
@@ -370,21 +488,13 @@ void
 mrb_str_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RString *s1 = mrb_str_ptr(self), *s2;
-  mrb_int len;
 
-  mrb_str_modify(mrb, s1);
   if (!mrb_string_p(other)) {
     other = mrb_str_to_str(mrb, other);
   }
   s2 = mrb_str_ptr(other);
-  len = RSTR_LEN(s1) + RSTR_LEN(s2);
-
-  if (RSTRING_CAPA(self) < len) {
-    resize_capa(mrb, s1, len);
-  }
-  memcpy(RSTR_PTR(s1)+RSTR_LEN(s1), RSTR_PTR(s2), RSTR_LEN(s2));
-  RSTR_SET_LEN(s1, len);
-  RSTR_PTR(s1)[len] = '\0';
+  /* grows the buffer geometrically; repeated appends stay linear */
+  str_buf_cat(mrb, s1, RSTR_PTR(s2), RSTR_LEN(s2));
 }
 
 /*
@@ -665,30 +775,12 @@ regexp_check(mrb_state *mrb, mrb_value obj)
   }
 }
 
-static inline mrb_int
-mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mrb_int n)
-{
-  const unsigned char *x = xs, *xe = xs + m;
-  const unsigned char *y = ys;
-  int i, qstable[256];
-
-  /* Preprocessing */
-  for (i = 0; i < 256; ++i)
-    qstable[i] = m + 1;
-  for (; x < xe; ++x)
-    qstable[*x] = xe - x;
-  /* Searching */
-  for (; y + m <= ys + n; y += *(qstable + y[m])) {
-    if (*xs == *y && memcmp(xs, y, m) == 0)
-        return y - ys;
-  }
-  return -1;
-}
-
-static mrb_int
+mrb_int
 mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
 {
   const unsigned char *x = (const unsigned char *)x0, *y = (const unsigned char *)y0;
+  const unsigned char *ys = y, *ye;
+  unsigned char first, last;
 
   if (m > n) return -1;
   else if (m == n) {
@@ -698,14 +790,24 @@ mrb_memsearch(const void *x0, mrb_int m, const void *y0, mrb_int n)
     return 0;
   }
   else if (m == 1) {
-    const unsigned char *ys = y, *ye = ys + n;
-    for (; y < ye; ++y) {
-      if (*x == *y)
-        return y - ys;
+    const unsigned char *p = (const unsigned char *)memchr(y, *x, n);
+    return p ? p - ys : -1;
+  }
+
+  /* let memchr() skip to candidates for the first byte, then filter
+     them by the last byte before comparing the whole pattern */
+  first = x[0];
+  last = x[m-1];
+  ye = ys + n - m;
+  while (y <= ye) {
+    y = (const unsigned char *)memchr(y, first, ye - y + 1);
+    if (!y) break;
+    if (y[m-1] == last && memcmp(x+1, y+1, m-2) == 0) {
+      return y - ys;
     }
-    return -1;
+    y++;
   }
-  return mrb_memsearch_qs((const unsigned char *)x0, m, (const unsigned char *)y0, n);
+  return -1;
 }
 
 static mrb_int
@@ -1156,8 +1258,9 @@ mrb_str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
   mrb_shared_string *shared;
 
   orig = mrb_str_ptr(str);
-  if (RSTR_EMBED_P(orig)) {
-    s = str_new(mrb, orig->as.ary+beg, len);
+  if (RSTR_EMBED_P(orig) || len <= RSTRING_EMBED_LEN_MAX) {
+    /* short substrings are copied inline rather than sharing the buffer */
+    s = str_new(mrb, RSTR_PTR(orig)+beg, len);
   } else {
     str_make_shared(mrb, orig);
     shared = orig->as.heap.aux.shared;
@@ -1352,6 +1455,8 @@ str_replace(mrb_state *mrb, struct RString *s1, struct RString *s2)
   }
 
   RSTR_UNSET_NOFREE_FLAG(s1);
+  RSTR_UNSET_ASCII_FLAG(s1);
+  RSTR_UNSET_INDEXED_FLAG(s1);
 
   if (RSTR_SHARED_P(s2)) {
 L_SHARE:
@@ -1367,6 +1472,7 @@ L_SHARE:
       RSTR_UNSET_SHARED_FLAG(s1);
       RSTR_SET_EMBED_FLAG(s1);
       memcpy(s1->as.ary, RSTR_PTR(s2), len);
+      s1->as.ary[len] = '\0';
       RSTR_SET_EMBED_LEN(s1, len);
     }
     else {
@@ -1588,7 +1694,7 @@ mrb_str_rindex(mrb_state *mrb, mrb_value str, mrb_value sub, mrb_int pos)
   t = RSTRING_PTR(sub);
   if (len) {
     while (sbeg <= s) {
-      if (memcmp(s, t, len) == 0) {
+      if (*s == *t && memcmp(s, t, len) == 0) {
         return s - RSTR_PTR(ps);
       }
       s--;
@@ -2488,7 +2594,7 @@ mrb_init_string(mrb_state *mrb)
   s = mrb->string_class = mrb_define_class(mrb, "String", mrb->object_class);             /* 15.2.10 */
   MRB_SET_INSTANCE_TT(s, MRB_TT_STRING);
 
-  mrb_define_method(mrb, s, "bytesize",        mrb_str_bytesize,        MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "bytesize",        mrb_str_bytesize,        MRB_ARGS_LEAF());
 
   mrb_define_method(mrb, s, "<=>",             mrb_str_cmp_m,           MRB_ARGS_REQ(1)); /* 15.2.10.5.1  */
   mrb_define_method(mrb, s, "==",              mrb_str_equal_m,         MRB_ARGS_REQ(1)); /* 15.2.10.5.2  */
@@ -2503,7 +2609,7 @@ mrb_init_string(mrb_state *mrb)
   mrb_define_method(mrb, s, "chop!",           mrb_str_chop_bang,       MRB_ARGS_REQ(1)); /* 15.2.10.5.12 */
   mrb_define_method(mrb, s, "downcase",        mrb_str_downcase,        MRB_ARGS_NONE()); /* 15.2.10.5.13 */
   mrb_define_method(mrb, s, "downcase!",       mrb_str_downcase_bang,   MRB_ARGS_NONE()); /* 15.2.10.5.14 */
-  mrb_define_method(mrb, s, "empty?",          mrb_str_empty_p,         MRB_ARGS_NONE()); /* 15.2.10.5.16 */
+  mrb_define_method(mrb, s, "empty?",          mrb_str_empty_p,         MRB_ARGS_LEAF()); /* 15.2.10.5.16 */
   mrb_define_method(mrb, s, "eql?",            mrb_str_eql,             MRB_ARGS_REQ(1)); /* 15.2.10.5.17 */
 
   mrb_define_method(mrb, s, "hash",            mrb_str_hash_m,          MRB_ARGS_REQ(1)); /* 15.2.10.5.20 */
@@ -2512,12 +2618,12 @@ mrb_init_string(mrb_state *mrb)
   mrb_define_method(mrb, s, "initialize",      mrb_str_init,            MRB_ARGS_REQ(1)); /* 15.2.10.5.23 */
   mrb_define_method(mrb, s, "initialize_copy", mrb_str_replace,         MRB_ARGS_REQ(1)); /* 15.2.10.5.24 */
   mrb_define_method(mrb, s, "intern",          mrb_str_intern,          MRB_ARGS_NONE()); /* 15.2.10.5.25 */
-  mrb_define_method(mrb, s, "length",          mrb_str_size,            MRB_ARGS_NONE()); /* 15.2.10.5.26 */
+  mrb_define_method(mrb, s, "length",          mrb_str_size,            MRB_ARGS_LEAF()); /* 15.2.10.5.26 */
   mrb_define_method(mrb, s, "replace",         mrb_str_replace,         MRB_ARGS_REQ(1)); /* 15.2.10.5.28 */
   mrb_define_method(mrb, s, "reverse",         mrb_str_reverse,         MRB_ARGS_NONE()); /* 15.2.10.5.29 */
   mrb_define_method(mrb, s, "reverse!",        mrb_str_reverse_bang,    MRB_ARGS_NONE()); /* 15.2.10.5.30 */
   mrb_define_method(mrb, s, "rindex",          mrb_str_rindex_m,        MRB_ARGS_ANY());  /* 15.2.10.5.31 */
-  mrb_define_method(mrb, s, "size",            mrb_str_size,            MRB_ARGS_NONE()); /* 15.2.10.5.33 */
+  mrb_define_method(mrb, s, "size",            mrb_str_size,            MRB_ARGS_LEAF()); /* 15.2.10.5.33 */
   mrb_define_method(mrb, s, "slice",           mrb_str_aref_m,          MRB_ARGS_ANY());  /* 15.2.10.5.34 */
   mrb_define_method(mrb, s, "split",           mrb_str_split_m,         MRB_ARGS_ANY());  /* 15.2.10.5.35 */
 
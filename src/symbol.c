@@ -169,6 +169,22 @@ mrb_init_symtbl(mrb_state *mrb)
   mrb->name2sym = kh_init(n2s, mrb);
 }
 
+/* the names stay in the image, which must outlive the copy */
+void
+mrb_copy_symtbl(mrb_state *mrb, mrb_state *image)
+{
+  khash_t(n2s) *h;
+  khiter_t k;
+
+  h = mrb->name2sym = kh_copy(n2s, mrb, image->name2sym);
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      kh_key(h, k).lit = TRUE;
+    }
+  }
+  mrb->symidx = image->symidx;
+}
+
 /**********************************************************************
  * Document-class: Symbol
  *
@@ -479,7 +495,7 @@ mrb_init_symbol(mrb_state *mrb)
   mrb_define_method(mrb, sym, "===",             sym_equal,      MRB_ARGS_REQ(1));              /* 15.2.11.3.1  */
   mrb_define_method(mrb, sym, "id2name",         mrb_sym_to_s,   MRB_ARGS_NONE());              /* 15.2.11.3.2  */
   mrb_define_method(mrb, sym, "to_s",            mrb_sym_to_s,   MRB_ARGS_NONE());              /* 15.2.11.3.3  */
-  mrb_define_method(mrb, sym, "to_sym",          sym_to_sym,     MRB_ARGS_NONE());              /* 15.2.11.3.4  */
+  mrb_define_method(mrb, sym, "to_sym",          sym_to_sym,     MRB_ARGS_LEAF());              /* 15.2.11.3.4  */
   mrb_define_method(mrb, sym, "inspect",         sym_inspect,    MRB_ARGS_NONE());              /* 15.2.11.3.5(x)  */
   mrb_define_method(mrb, sym, "<=>",             sym_cmp,        MRB_ARGS_REQ(1));
 }
@@ -8,6 +8,7 @@
 #include "mruby.h"
 #include "mruby/array.h"
 #include "mruby/class.h"
+#include "mruby/gc.h"
 #include "mruby/proc.h"
 #include "mruby/string.h"
 
@@ -281,6 +282,22 @@ iv_free(mrb_state *mrb, iv_tbl *t)
   mrb_free(mrb, t);
 }
 
+static void
+iv_relocate(mrb_state *mrb, iv_tbl *t)
+{
+  segment *seg;
+  size_t i;
+
+  for (seg = t->rootseg; seg; seg = seg->next) {
+    for (i=0; i<MRB_SEGMENT_SIZE; i++) {
+      if ((seg->next == NULL) && (i >= t->last_len)) {
+        return;
+      }
+      seg->val[i] = mrb_gc_image_value(mrb, seg->val[i]);
+    }
+  }
+}
+
 #else
 
 #include "mruby/khash.h"
@@ -388,6 +405,19 @@ iv_free(mrb_state *mrb, iv_tbl *t)
   kh_destroy(iv, mrb, &t->h);
 }
 
+static void
+iv_relocate(mrb_state *mrb, iv_tbl *t)
+{
+  khash_t(iv) *h = &t->h;
+  khiter_t k;
+
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) {
+      kh_value(h, k) = mrb_gc_image_value(mrb, kh_value(h, k));
+    }
+  }
+}
+
 #endif
 
 static int
@@ -438,6 +468,30 @@ mrb_gc_free_iv(mrb_state *mrb, struct RObject *obj)
   }
 }
 
+/* copy a table of an image object, relocating its values */
+static iv_tbl*
+iv_copy_image(mrb_state *mrb, iv_tbl *t)
+{
+  iv_tbl *t2 = iv_copy(mrb, t);
+
+  iv_relocate(mrb, t2);
+  return t2;
+}
+
+void
+mrb_gc_copy_gv(mrb_state *mrb, mrb_state *image)
+{
+  mrb->globals = image->globals ? iv_copy_image(mrb, image->globals) : NULL;
+}
+
+void
+mrb_gc_copy_iv(mrb_state *mrb, struct RObject *obj)
+{
+  if (obj->iv) {
+    obj->iv = iv_copy_image(mrb, obj->iv);
+  }
+}
+
 mrb_value
 mrb_vm_special_get(mrb_state *mrb, mrb_sym i)
 {
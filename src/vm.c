@@ -213,6 +213,18 @@ top_env(mrb_state *mrb, struct RProc *proc)
 #define CI_ACC_SKIP    -1
 #define CI_ACC_DIRECT  -2
 
+/* child irep n, decoding it first if it was loaded lazily */
+static inline mrb_irep*
+child_irep(mrb_state *mrb, mrb_irep *irep, int n)
+{
+  mrb_irep *rep = irep->reps[n];
+
+  if (MRB_IREP_LAZY_P(rep)) {
+    mrb_irep_load_lazy(mrb, rep);
+  }
+  return rep;
+}
+
 static mrb_callinfo*
 cipush(mrb_state *mrb)
 {
@@ -686,20 +698,50 @@ argnum_error(mrb_state *mrb, mrb_int num)
 #define DIRECT_THREADED
 #endif
 
+#ifdef MRB_COMPACT_ISEQ
+/* ILEN is the length of the current instruction, JMP_LEN the length
+   of the entries of the jump table after OP_ENTER */
+#define FETCH() i = mrb_iseq_fetch(pc, &ilen)
+/* operand layout of each opcode, known at compile time */
+enum {
+#define OPFMT(op, fmt) FMT_ ## op = MRB_IFMT_ ## fmt,
+#include "iseq_format.h"
+#undef OPFMT
+};
+#define FETCH_FMT(fmt) do {\
+  mrb_assert(mrb_insn_format[*pc & 0x7f] == (fmt));\
+  if (*pc & MRB_INSN_WIDE) i = mrb_iseq_fetch_wide(pc, &ilen);\
+  else i = mrb_iseq_fetch_narrow(pc, (fmt), &ilen);\
+} while (0)
+#define ILEN ilen
+#define JMP_LEN MRB_ISEQ_JMP_LEN
+#else
+#define FETCH() i = *pc
+#define ILEN 1
+#define JMP_LEN 1
+#endif
+
 #ifndef DIRECT_THREADED
 
-#define INIT_DISPATCH for (;;) { i = *pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); switch (GET_OPCODE(i)) {
+#define INIT_DISPATCH for (;;) { FETCH(); CODE_FETCH_HOOK(mrb, irep, pc, regs); switch (GET_OPCODE(i)) {
 #define CASE(op) case op:
-#define NEXT pc++; break
+#define NEXT pc += ILEN; break
 #define JUMP break
 #define END_DISPATCH }}
 
 #else
 
 #define INIT_DISPATCH JUMP; return mrb_nil_value();
+#ifdef MRB_COMPACT_ISEQ
+/* each handler decodes its own operand layout */
+#define CASE(op) L_ ## op: FETCH_FMT(FMT_ ## op);
+#define NEXT pc += ILEN; CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[*pc & 0x7f]
+#define JUMP CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[*pc & 0x7f]
+#else
 #define CASE(op) L_ ## op:
-#define NEXT i=*++pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
-#define JUMP i=*pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
+#define NEXT pc += ILEN; FETCH(); CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
+#define JUMP FETCH(); CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
+#endif
 
 #define END_DISPATCH
 
@@ -719,7 +761,10 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
   mrb_value *pool = irep->pool;
   mrb_sym *syms = irep->syms;
   mrb_value *regs = NULL;
-  mrb_code i;
+  mrb_insn i;
+#ifdef MRB_COMPACT_ISEQ
+  int ilen;
+#endif
   int ai = mrb_gc_arena_save(mrb);
   struct mrb_jmpbuf *prev_jmp = mrb->jmp;
   struct mrb_jmpbuf c_jmp;
@@ -745,7 +790,7 @@ mrb_context_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int
     &&L_OP_LAMBDA, &&L_OP_RANGE, &&L_OP_OCLASS,
     &&L_OP_CLASS, &&L_OP_MODULE, &&L_OP_EXEC,
     &&L_OP_METHOD, &&L_OP_SCLASS, &&L_OP_TCLASS,
-    &&L_OP_DEBUG, &&L_OP_STOP, &&L_OP_ERR,
+    &&L_OP_DEBUG, &&L_OP_STOP, &&L_OP_ERR, &&L_OP_YIELD,
   };
 #endif
 
@@ -999,7 +1044,7 @@ RETRY_TRY_BLOCK:
       /* Bx     ensure_push(SEQ[Bx]) */
       struct RProc *p;
 
-      p = mrb_closure_new(mrb, irep->reps[GETARG_Bx(i)]);
+      p = mrb_closure_new(mrb, child_irep(mrb, irep, GETARG_Bx(i)));
       /* push ensure_stack */
       if (mrb->c->esize <= mrb->c->ci->eidx) {
         if (mrb->c->esize == 0) mrb->c->esize = 16;
@@ -1037,8 +1082,9 @@ RETRY_TRY_BLOCK:
       /* fall through */
     };
 
-  L_SEND:
-    CASE(OP_SEND) {
+    CASE(OP_SEND)
+    L_SEND:     /* after the decode: jumpers may rewrite i */
+    {
       /* A B C  R(A) := call(R(A),Syms(B),R(A+1),...,R(A+C)) */
       int a = GETARG_A(i);
       int n = GETARG_C(i);
@@ -1072,6 +1118,15 @@ RETRY_TRY_BLOCK:
           regs[a+1] = sym;
         }
       }
+      else if (MRB_PROC_LEAF_P(m)) {
+        /* leaf cfunc: call directly without a frame; keep the error pc
+           so that a backtrace still points at this call */
+        ERR_PC_SET(mrb, pc);
+        regs[a] = m->body.func(mrb, recv);
+        ERR_PC_CLR(mrb);
+        mrb_gc_arena_restore(mrb, ai);
+        NEXT;
+      }
 
       /* push callinfo */
       ci = cipush(mrb);
@@ -1085,7 +1140,7 @@ RETRY_TRY_BLOCK:
         ci->target_class = c;
       }
 
-      ci->pc = pc + 1;
+      ci->pc = pc + ILEN;
       ci->acc = a;
 
       /* prepare stack */
@@ -1186,6 +1241,7 @@ RETRY_TRY_BLOCK:
         irep = m->body.irep;
         if (!irep) {
           mrb->c->stack[0] = mrb_nil_value();
+          i = MKOP_AB(OP_RETURN, GETARG_A(i), OP_R_NORMAL);
           goto L_RETURN;
         }
         pool = irep->pool;
@@ -1204,6 +1260,60 @@ RETRY_TRY_BLOCK:
       }
     }
 
+    CASE(OP_YIELD) {
+      /* A B C  R(A) := R(A).call(R(A+1),...,R(A+C)) (Syms(B)=:call) */
+      int a = GETARG_A(i);
+      int n = GETARG_C(i);
+      struct RProc *m;
+      mrb_callinfo *ci;
+
+      /* anything but a plain Ruby block takes the ordinary send path */
+      if (mrb_type(regs[a]) != MRB_TT_PROC) goto L_SEND;
+      m = mrb_proc_ptr(regs[a]);
+      if (MRB_PROC_CFUNC_P(m) || !m->body.irep || !m->env) goto L_SEND;
+
+      if (n == CALL_MAXARGS) {
+        SET_NIL_VALUE(regs[a+2]);
+      }
+      else {
+        SET_NIL_VALUE(regs[a+n+1]);
+      }
+
+      /* push callinfo for the block itself; no Proc#call frame */
+      ci = cipush(mrb);
+      ci->mid = m->env->mid ? m->env->mid : syms[GETARG_B(i)];
+      ci->proc = m;
+      ci->stackent = mrb->c->stack;
+      ci->target_class = m->target_class;
+      ci->pc = pc + ILEN;
+      ci->acc = a;
+
+      /* prepare stack */
+      mrb->c->stack += a;
+      if (!m->env->stack) {
+        m->env->stack = mrb->c->stack;
+      }
+
+      /* setup environment for calling block */
+      proc = m;
+      irep = m->body.irep;
+      pool = irep->pool;
+      syms = irep->syms;
+      ci->nregs = irep->nregs;
+      if (n == CALL_MAXARGS) {
+        ci->argc = -1;
+        stack_extend(mrb, (irep->nregs < 3) ? 3 : irep->nregs, 3);
+      }
+      else {
+        ci->argc = n;
+        stack_extend(mrb, irep->nregs, n+2);
+      }
+      regs = mrb->c->stack;
+      regs[0] = m->env->stack[0];
+      pc = irep->iseq;
+      JUMP;
+    }
+
     CASE(OP_SUPER) {
       /* A C  R(A) := super(R(A+1),... ,R(A+C+1)) */
       mrb_value recv;
@@ -1241,7 +1351,7 @@ RETRY_TRY_BLOCK:
         ci->argc = n;
       }
       ci->target_class = c;
-      ci->pc = pc + 1;
+      ci->pc = pc + ILEN;
 
       /* prepare stack */
       mrb->c->stack += a;
@@ -1310,21 +1420,21 @@ RETRY_TRY_BLOCK:
         if (mrb_array_p(stack[m1])) {
           struct RArray *ary = mrb_ary_ptr(stack[m1]);
 
-          pp = ary->ptr;
-          len = ary->len;
+          pp = ARY_PTR(ary);
+          len = ARY_LEN(ary);
         }
         regs[a] = mrb_ary_new_capa(mrb, m1+len+m2);
         rest = mrb_ary_ptr(regs[a]);
         if (m1 > 0) {
-          stack_copy(rest->ptr, stack, m1);
+          stack_copy(ARY_PTR(rest), stack, m1);
         }
         if (len > 0) {
-          stack_copy(rest->ptr+m1, pp, len);
+          stack_copy(ARY_PTR(rest)+m1, pp, len);
         }
         if (m2 > 0) {
-          stack_copy(rest->ptr+m1+len, stack+m1+1, m2);
+          stack_copy(ARY_PTR(rest)+m1+len, stack+m1+1, m2);
         }
-        rest->len = m1+len+m2;
+        ARY_SET_LEN(rest, m1+len+m2);
       }
       regs[a+1] = stack[m1+r+m2];
       ARENA_RESTORE(mrb, ai);
@@ -1353,10 +1463,15 @@ RETRY_TRY_BLOCK:
       if (!mrb_nil_p(*blk) && mrb_type(*blk) != MRB_TT_PROC) {
         *blk = mrb_convert_type(mrb, *blk, MRB_TT_PROC, "Proc", "to_proc");
       }
+      /* fast path: only required arguments, passed exactly (typical block) */
+      if (argc == len && len == m1) {
+        pc += ILEN;
+        JUMP;
+      }
       if (argc < 0) {
         struct RArray *ary = mrb_ary_ptr(regs[1]);
-        argv = ary->ptr;
-        argc = ary->len;
+        argv = ARY_PTR(ary);
+        argc = ARY_LEN(ary);
         mrb_gc_protect(mrb, regs[1]);
       }
       if (mrb->c->ci->proc && MRB_PROC_STRICT_P(mrb->c->ci->proc)) {
@@ -1369,8 +1484,8 @@ RETRY_TRY_BLOCK:
       }
       else if (len > 1 && argc == 1 && mrb_array_p(argv[0])) {
         mrb_gc_protect(mrb, argv[0]);
-        argc = mrb_ary_ptr(argv[0])->len;
-        argv = mrb_ary_ptr(argv[0])->ptr;
+        argc = RARRAY_LEN(argv[0]);
+        argv = RARRAY_PTR(argv[0]);
       }
       mrb->c->ci->argc = len;
       if (argc < len) {
@@ -1392,9 +1507,9 @@ RETRY_TRY_BLOCK:
         if (r) {
           regs[m1+o+1] = mrb_ary_new_capa(mrb, 0);
         }
-        if (o == 0 || argc < m1+m2) pc++;
+        if (o == 0 || argc < m1+m2) pc += ILEN;
         else
-          pc += argc - m1 - m2 + 1;
+          pc += ILEN + (argc - m1 - m2) * JMP_LEN;
       }
       else {
         int rnum = 0;
@@ -1414,7 +1529,7 @@ RETRY_TRY_BLOCK:
         if (argv0 == argv) {
           regs[len+1] = *blk; /* move block */
         }
-        pc += o + 1;
+        pc += ILEN + o * JMP_LEN;
       }
       JUMP;
     }
@@ -1431,10 +1546,9 @@ RETRY_TRY_BLOCK:
       NEXT;
     }
 
+    CASE(OP_RETURN)
     L_RETURN:
-      i = MKOP_AB(OP_RETURN, GETARG_A(i), OP_R_NORMAL);
-      /* fall through */
-    CASE(OP_RETURN) {
+    {
       /* A B     return R(A) (B=normal,in-block return/break) */
       if (mrb->exc) {
         mrb_callinfo *ci;
@@ -1624,6 +1738,7 @@ RETRY_TRY_BLOCK:
       if (MRB_PROC_CFUNC_P(m)) {
         mrb->c->stack[0] = m->body.func(mrb, recv);
         mrb_gc_arena_restore(mrb, ai);
+        i = MKOP_AB(OP_RETURN, GETARG_A(i), OP_R_NORMAL);
         goto L_RETURN;
       }
       else {
@@ -2109,19 +2224,19 @@ RETRY_TRY_BLOCK:
       }
       else {
         struct RArray *ary = mrb_ary_ptr(v);
-        int len = ary->len;
+        int len = ARY_LEN(ary);
         int i;
 
         if (len > pre + post) {
-          regs[a++] = mrb_ary_new_from_values(mrb, len - pre - post, ary->ptr+pre);
+          regs[a++] = mrb_ary_new_from_values(mrb, len - pre - post, ARY_PTR(ary)+pre);
           while (post--) {
-            regs[a++] = ary->ptr[len-post-1];
+            regs[a++] = ARY_PTR(ary)[len-post-1];
           }
         }
         else {
           regs[a++] = mrb_ary_new_capa(mrb, 0);
           for (i=0; i+pre<len; i++) {
-            regs[a+i] = ary->ptr[pre+i];
+            regs[a+i] = ARY_PTR(ary)[pre+i];
           }
           while (i < post) {
             SET_NIL_VALUE(regs[a+i]);
@@ -2168,10 +2283,10 @@ RETRY_TRY_BLOCK:
       int c = GETARG_c(i);
 
       if (c & OP_L_CAPTURE) {
-        p = mrb_closure_new(mrb, irep->reps[GETARG_b(i)]);
+        p = mrb_closure_new(mrb, child_irep(mrb, irep, GETARG_b(i)));
       }
       else {
-        p = mrb_proc_new(mrb, irep->reps[GETARG_b(i)]);
+        p = mrb_proc_new(mrb, child_irep(mrb, irep, GETARG_b(i)));
       }
       if (c & OP_L_STRICT) p->flags |= MRB_PROC_STRICT;
       regs[GETARG_A(i)] = mrb_obj_value(p);
@@ -2226,10 +2341,11 @@ RETRY_TRY_BLOCK:
       mrb_callinfo *ci;
       mrb_value recv = regs[a];
       struct RProc *p;
+      mrb_irep *body = child_irep(mrb, irep, GETARG_Bx(i));
 
       /* prepare stack */
       ci = cipush(mrb);
-      ci->pc = pc + 1;
+      ci->pc = pc + ILEN;
       ci->acc = a;
       ci->mid = 0;
       ci->stackent = mrb->c->stack;
@@ -2239,7 +2355,7 @@ RETRY_TRY_BLOCK:
       /* prepare stack */
       mrb->c->stack += a;
 
-      p = mrb_proc_new(mrb, irep->reps[GETARG_Bx(i)]);
+      p = mrb_proc_new(mrb, body);
       p->target_class = ci->target_class;
       ci->proc = p;
 
@@ -14,3 +14,16 @@ assert('ArgumentError', '15.2.24') do
   assert_equal(Class, ArgumentError.class)
   assert_equal(ArgumentError, e2.class)
 end
+
+assert('ArgumentError from C method argument specs') do
+  h = {}
+  assert_raise(ArgumentError) { h[] }
+  assert_raise(ArgumentError) { h[1, 2] }
+  assert_raise(ArgumentError) { h.store(1) }
+  assert_raise(ArgumentError) { [1][0, 1, 2] }
+  assert_raise(ArgumentError) { "a".==("b", "c") }
+  assert_equal [2, 3], [1, 2, 3][1, 2]
+  assert_equal 2, [1, 2, 3][1]
+  assert_equal "10", 10.to_s
+  assert_equal "1010", 10.to_s(2)
+end
@@ -119,6 +119,23 @@ assert('Array#each', '15.2.12.5.10') do
   assert_equal(6, b)
 end
 
+assert('Array#each (modified during iteration)') do
+  a = [1,2,3,4]
+  b = []
+  a.each {|i| b << i; a.pop if i == 1}
+  assert_equal([1,2,3], b)
+
+  a = [1,2]
+  b = []
+  a.each {|i| b << i; a << i + 2 if i < 4}
+  assert_equal([1,2,3,4,5], b)
+
+  a = [1,nil,3]
+  b = []
+  a.each {|i| b << i}
+  assert_equal([1,nil,3], b)
+end
+
 assert('Array#each_index', '15.2.12.5.11') do
   a = [1]
   b = nil
@@ -291,6 +308,59 @@ assert('Array#unshift', '15.2.12.5.30') do
   assert_equal([0,1,2,3], d)
 end
 
+assert('Small arrays growing and shrinking') do
+  a = [1]
+  a.concat(a)
+  assert_equal([1, 1], a)
+  a.concat(a)
+  assert_equal([1, 1, 1, 1], a)
+  b = [1, 2]
+  b[1, 0] = b
+  assert_equal([1, 1, 2, 2], b)
+  c = [1, 2, 3, 4, 5]
+  d = c[1, 2]
+  d << 9
+  assert_equal([2, 3, 9], d)
+  assert_equal([1, 2, 3, 4, 5], c)
+  c.clear
+  c.push(1, 2, 3, 4)
+  assert_equal([1, 2, 3, 4], c)
+  e = []
+  e.unshift(1)
+  e[3] = 4
+  assert_equal([1, nil, nil, 4], e)
+  assert_equal(1, e.shift)
+  assert_equal(4, e.pop)
+  assert_equal([nil, nil], e)
+  k, v = *[:k, :v]
+  assert_equal([:k, :v], [k, v])
+  assert_equal([[1, 2]], {1 => 2}.to_a)
+end
+
+assert('Array used as a queue') do
+  q = (1..20).to_a
+  s = q[5, 3]
+  out = []
+  100.times do |i|
+    out << q.shift
+    q.push(i)
+  end
+  assert_equal(20, q.size)
+  assert_equal((1..20).to_a + (0..79).to_a, out)
+  assert_equal((80..99).to_a, q)
+  assert_equal([6, 7, 8], s)
+
+  d = []
+  50.times { |i| d.unshift(i); d.push(-i) }
+  50.times { |i| assert_equal(49 - i, d.shift); assert_equal(-49 + i, d.pop) }
+  assert_equal([], d)
+  d.unshift(1, 2)
+  d << 3
+  assert_equal([1, 2, 3], d)
+  d[0] = 0
+  assert_equal([0, 2, 3], d)
+end
+
 assert('Array#to_s', '15.2.12.5.31 / 15.2.12.5.32') do
   a = [2, 3,   4, 5]
   r1 = a.to_s
@@ -334,6 +404,36 @@ end
 
 # Not ISO specified
 
+assert('Array#sort') do
+  a = [5, 3.5, -1, 2, 10, 0.25]
+  assert_equal([-1, 0.25, 2, 3.5, 5, 10], a.sort)
+  assert_equal([5, 3.5, -1, 2, 10, 0.25], a)
+  assert_equal(%w(a ab b ba), %w(ba b ab a).sort)
+  assert_equal([[1, 2], [1, 3], [2, 0]], [[2, 0], [1, 3], [1, 2]].sort)
+  assert_equal([3, 2, 1], [1, 3, 2].sort {|x, y| y <=> x})
+  b = (1..100).to_a
+  assert_equal(b, b.reverse.sort)
+  assert_equal(b, (b.select {|i| i % 2 == 1} + b.select {|i| i % 2 == 0}).sort)
+  assert_raise(ArgumentError) { [1, "a"].sort }
+  assert_raise(ArgumentError) { [1, 0.0 / 0.0].sort }
+
+  c = [3, 1, 2]
+  assert_equal([1, 2, 3], c.sort!)
+  assert_equal([1, 2, 3], c)
+end
+
+assert('Array#map, Array#select and Array#each_with_index') do
+  a = [1,2,3,4]
+  assert_equal([2,4,6,8], a.map {|i| i * 2})
+  assert_equal([2,4], a.select {|i| i % 2 == 0})
+  assert_equal([[1,2],[3,4]], [[1,2],[3,4]].map {|x, y| [x, y]})
+  b = []
+  assert_equal(a, a.each_with_index {|e, i| b << [e, i]})
+  assert_equal([[1,0],[2,1],[3,2],[4,3]], b)
+  assert_equal([1,2], a.map {|i| a.pop; i})
+  assert_equal(1, [1,2,3].select {|i| break i})
+end
+
 assert("Array (Shared Array Corruption)") do
   a = [ "a", "b", "c", "d", "e", "f" ]
   b = a.slice(1, 3)
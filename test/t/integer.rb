@@ -255,4 +255,20 @@ assert('Integer#step') do
 
   assert_equal [1, 2, 3], a
   assert_equal [1, 3, 5], b
+
+  c = []
+  10.step(1, -4) { |i| c << i }
+  assert_equal [10, 6, 2], c
+  d = []
+  1.step(2, 0.5) { |i| d << i }
+  assert_equal [1.0, 1.5, 2.0], d
+  assert_raise(ArgumentError) { 1.step(2, 0) { } }
+end
+
+assert('Integer loops with break and next') do
+  assert_equal :done, 10.times { |i| break :done if i == 3 }
+  a = []
+  1.upto(5) { |i| next if i % 2 == 0; a << i }
+  assert_equal [1, 3, 5], a
+  assert_equal 2, 5.downto(0) { |i| break i if i == 2 }
 end
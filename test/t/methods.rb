@@ -107,3 +107,35 @@ assert('The undef statement (method undefined)', '13.3.7 a) 5)') do
     undef :non_existing_method
   end
 end
+
+assert('Leaf C methods called without a frame') do
+  class LeafSizeArray < Array
+    def size
+      super + 100
+    end
+  end
+  a = [1, 2, 3]
+  assert_equal 3, a.size
+  assert_equal 3, a.length(*[])
+  assert_equal 3, a.size { :ignored }
+  assert_equal 103, LeafSizeArray.new.push(1, 2, 3).size
+  assert_equal [false, true], [1, nil].map { |x| x.nil? }
+  assert_equal Fixnum, 1.class
+  assert_equal 1.5, 1.5.to_f
+
+  class LeafRedefined
+    alias leaf_class class
+    def class
+      :redefined
+    end
+  end
+  assert_equal :redefined, LeafRedefined.new.class
+  assert_equal LeafRedefined, LeafRedefined.new.leaf_class
+
+  def leaf_then_raise(a)
+    a.size
+    a.no_such_leaf_method
+  end
+  assert_raise(NoMethodError) { leaf_then_raise([]) }
+  assert_equal 0, [].size
+end
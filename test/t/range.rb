@@ -27,6 +27,21 @@ assert('Range#each', '15.2.14.4.4') do
   b = 0
   a.each {|i| b += i}
   assert_equal 6, b
+
+  c = []
+  (1...4).each {|i| c << i}
+  assert_equal [1, 2, 3], c
+  class RangeEachSucc
+    include Comparable
+    attr_reader :v
+    def initialize(v); @v = v; end
+    def succ; RangeEachSucc.new(@v + 1); end
+    def <=>(o); @v <=> o.v; end
+  end
+  d = []
+  (RangeEachSucc.new(1)..RangeEachSucc.new(3)).each {|s| d << s.v}
+  assert_equal [1, 2, 3], d
+  assert_equal 3, (1..10).each {|i| break i if i == 3}
 end
 
 assert('Range#end', '15.2.14.4.5') do
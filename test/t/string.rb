@@ -270,12 +270,22 @@ assert('String#include?', '15.2.10.5.21') do
   assert_false 'abc'.include?(100)
   assert_true 'abc'.include?('a')
   assert_false 'abc'.include?('d')
+  hay = 'x' * 100 + 'needle' + 'x' * 100
+  assert_true hay.include?('needle')
+  assert_false hay.include?('needles')
 end
 
 assert('String#index', '15.2.10.5.22') do
   assert_equal 0, 'abc'.index('a')
   assert_nil 'abc'.index('d')
   assert_equal 3, 'abcabc'.index('a', 1)
+  assert_equal 2, 'ababc'.index('abc')
+  assert_equal 5, 'aaaaab'.index('b')
+  assert_equal 4, 'aaaaaab'.index('aab')
+  assert_nil 'aaaaaab'.index('aac')
+  assert_equal 8, 'xxyxyxxyxyz'.index('xyz')
+  assert_equal 1, "a\0b\0c".index("\0")
+  assert_equal 3, "a\0b\0c".index("\0c")
 end
 
 assert('String#initialize', '15.2.10.5.23') do
@@ -346,6 +356,8 @@ assert('String#rindex', '15.2.10.5.31') do
   assert_nil 'abc'.rindex('d')
   assert_equal 0, 'abcabc'.rindex('a', 1)
   assert_equal 3, 'abcabc'.rindex('a', 4)
+  assert_equal 3, 'abcabc'.rindex('abc')
+  assert_equal 4, 'aaaaaa'.rindex('aa')
 
   assert_equal 3,   'abcabc'.rindex(97)
   assert_equal nil, 'abcabc'.rindex(0)
@@ -494,6 +506,48 @@ assert('String interpolation (mrb_str_concat for shared strings)') do
   assert_equal "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA:", "#{a}:"
 end
 
+assert('String interpolation (repeated mrb_str_concat)') do
+  s = ""
+  1000.times { |i| s = "#{s}#{i % 10}" }
+  assert_equal 1000, s.size
+  assert_equal "0123456789", s[0, 10]
+  assert_equal "0123456789", s[990, 10]
+
+  a = "a" * 30
+  b = "#{a}#{a}"
+  assert_equal "a" * 60, b
+  assert_equal "a" * 30, a
+end
+
+assert('String literals are copied on write') do
+  f = lambda { "a literal long enough to be kept out of line" }
+  g = lambda { "a literal long enough to be kept out of line" }
+  a = f.call
+  a.chop!
+  a.upcase!
+  b = g.call
+  b.replace("short")
+  assert_equal "A LITERAL LONG ENOUGH TO BE KEPT OUT OF LIN", a
+  assert_equal "a literal long enough to be kept out of line", f.call
+  assert_equal "a literal long enough to be kept out of line", g.call
+  assert_equal "a literal long enough to be kept out of line", "a literal long enough to be kept out of line"
+end
+
+assert('Short substrings of long strings are independent') do
+  long = "abcdefghij" * 5
+  a = long[3, 5]
+  b = long[0, 23]
+  c = long[0, 24]
+  a.upcase!
+  b[0] = "X"
+  c[0] = "Y"
+  assert_equal "DEFGH", a
+  assert_equal "Xbcdefghijabcdefghijabc", b
+  assert_equal "Ybcdefghijabcdefghijabcd", c
+  assert_equal "abcdefghij" * 5, long
+  assert_equal ["ab", "cd", "ef"], "ab,cd,ef".split(",")
+end
+
 assert('Check the usage of a NUL character') do
   "qqq\0ppp"
 end
@@ -40,6 +40,40 @@ assert('yield', '11.3.5') do
   end
 end
 
+assert('yield bypasses Proc#call') do
+  def yield_args(*a)
+    yield(*a)
+  end
+  def yield_nested
+    [1, 2].map { |x| yield x }
+  end
+  def yield_without_block
+    yield
+  end
+
+  assert_equal [1, 2, 3], yield_args(1, 2, 3) { |*a| a }
+  assert_equal [2, 4], yield_nested { |x| x * 2 }
+  assert_equal 3, yield_args(1, 2) { |a, b| next a + b; 0 }
+  assert_equal :b, [1, 2].each { break :b }
+  assert_raise(NoMethodError) { yield_without_block }
+
+  class Proc
+    alias yield_test_call call
+    def call(*a)
+      :redefined
+    end
+  end
+  begin
+    assert_equal :redefined, Proc.new { :block }.call
+    assert_equal :block, yield_args { :block }
+    assert_equal [1, 2], [1, 2].map { |x| x }
+  ensure
+    class Proc
+      alias call yield_test_call
+    end
+  end
+end
+
 assert('Abbreviated variable assignment', '11.4.2.3.2') do
   a ||= 1
   b &&= 1
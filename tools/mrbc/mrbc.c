@@ -4,8 +4,16 @@
 #include "mruby.h"
 #include "mruby/compile.h"
 #include "mruby/dump.h"
+#include "mruby/irep.h"
+#include "mruby/debug.h"
+#include "mruby/opcode.h"
 #include "mruby/proc.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define USE_THREADS
+#endif
+
 #define RITEBIN_EXT ".mrb"
 #define C_EXT       ".c"
 
@@ -13,10 +21,12 @@
 extern "C" {
 void mrb_show_version(mrb_state *);
 void mrb_show_copyright(mrb_state *);
+void mrb_codedump_all(mrb_state*, struct RProc*);
 }
 #else
 void mrb_show_version(mrb_state *);
 void mrb_show_copyright(mrb_state *);
+void mrb_codedump_all(mrb_state*, struct RProc*);
 #endif
 
 struct mrbc_args {
@@ -26,9 +36,11 @@ struct mrbc_args {
   const char *prog;
   const char *outfile;
   const char *initname;
+  int jobs;
+  uint8_t optimize;
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
-  mrb_bool debug_info   : 1;
+  uint8_t flags;
 };
 
 static void
@@ -40,7 +52,11 @@ usage(const char *name)
   "-o<outfile>  place the output into <outfile>",
   "-v           print version number, then turn on verbose mode",
   "-g           produce debugging information",
+  "-e           generate little endian iseq data",
+  "-E           generate big endian iseq data (default)",
   "-B<symbol>   binary <symbol> output in C language format",
+  "-j<n>        compile each file separately, <n> files at a time",
+  "-O<level>    optimization level 0-2 (default 0, -O means 1)",
   "--verbose    run at verbose mode",
   "--version    print the version",
   "--copyright  print the copyright",
@@ -119,12 +135,44 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
       case 'c':
         args->check_syntax = TRUE;
         break;
+      case 'j':
+        if (argv[i][2] == '\0' && argv[i+1]) {
+          i++;
+          args->jobs = atoi(argv[i]);
+        }
+        else {
+          args->jobs = atoi(argv[i] + 2);
+        }
+        if (args->jobs <= 0) {
+          fprintf(stderr, "%s: invalid number of jobs.\n", args->prog);
+          return -1;
+        }
+        break;
+      case 'O':
+        if (argv[i][2] == '\0') {
+          args->optimize = 1;
+        }
+        else if (argv[i][2] >= '0' && argv[i][2] <= '9' && argv[i][3] == '\0') {
+          args->optimize = argv[i][2] - '0';
+          if (args->optimize > 2) args->optimize = 2;
+        }
+        else {
+          fprintf(stderr, "%s: invalid optimization level. (%s)\n", args->prog, argv[i]);
+          return -1;
+        }
+        break;
       case 'v':
         if (!args->verbose) mrb_show_version(mrb);
         args->verbose = TRUE;
         break;
       case 'g':
-        args->debug_info = TRUE;
+        args->flags |= DUMP_DEBUG_INFO;
+        break;
+      case 'e':
+        args->flags = (args->flags & ~DUMP_ENDIAN_MASK) | DUMP_ENDIAN_LIL;
+        break;
+      case 'E':
+        args->flags = (args->flags & ~DUMP_ENDIAN_MASK) | DUMP_ENDIAN_BIG;
         break;
       case 'h':
         return -1;
@@ -199,6 +247,7 @@ load_file(mrb_state *mrb, struct mrbc_args *args)
   if (args->verbose)
     c->dump_result = TRUE;
   c->no_exec = TRUE;
+  c->optimize = args->optimize;
   if (input[0] == '-' && input[1] == '\0') {
     infile = stdin;
   }
@@ -225,6 +274,263 @@ load_file(mrb_state *mrb, struct mrbc_args *args)
   return result;
 }
 
+/*
+ * With -j, each file is compiled on its own, in a state of its own, by
+ * a pool of threads.  The ireps of the files are then loaded in order
+ * as the children of a top level irep that runs each of them as a block
+ * of the top level, so the output is the same whatever the number of
+ * threads.  Unlike the default, where the files are read as one stream,
+ * top level local variables are not shared between the files.
+ */
+struct mrbc_job {
+  const char *file;
+  uint8_t *bin;                 /* RiteBinary of the file; NULL on error */
+  size_t bin_size;
+};
+
+struct mrbc_pool {
+  struct mrbc_args *args;
+  struct mrbc_job *jobs;
+  int njobs;
+  int next;
+#ifdef USE_THREADS
+  pthread_mutex_t lock;
+#endif
+};
+
+static void
+compile_job(struct mrbc_args *args, struct mrbc_job *job)
+{
+  mrb_state *mrb = mrb_open();
+  mrbc_context *c;
+  FILE *fp;
+  mrb_value result;
+
+  if (mrb == NULL) return;
+  if (strcmp(job->file, "-") == 0) {
+    fp = stdin;
+  }
+  else if ((fp = fopen(job->file, "r")) == NULL) {
+    fprintf(stderr, "%s: cannot open program file. (%s)\n", args->prog, job->file);
+    mrb_close(mrb);
+    return;
+  }
+  c = mrbc_context_new(mrb);
+  c->no_exec = TRUE;
+  c->optimize = args->optimize;
+  mrbc_filename(mrb, c, job->file);
+  result = mrb_load_file_cxt(mrb, fp, c);
+  if (fp != stdin) fclose(fp);
+  mrbc_context_free(mrb, c);
+  if (!mrb_undef_p(result) && !args->check_syntax) {
+    if (mrb_dump_irep(mrb, mrb_proc_ptr(result)->body.irep,
+                      (args->flags & ~DUMP_ENDIAN_MASK) | DUMP_ENDIAN_NAT,
+                      &job->bin, &job->bin_size) != MRB_DUMP_OK) {
+      job->bin = NULL;
+      job->bin_size = 0;
+    }
+  }
+  else if (!mrb_undef_p(result)) {
+    job->bin_size = 1;          /* syntax OK */
+  }
+  mrb_close(mrb);
+}
+
+static void*
+compile_worker(void *data)
+{
+  struct mrbc_pool *pool = (struct mrbc_pool*)data;
+  int i;
+
+  for (;;) {
+#ifdef USE_THREADS
+    pthread_mutex_lock(&pool->lock);
+#endif
+    i = pool->next++;
+#ifdef USE_THREADS
+    pthread_mutex_unlock(&pool->lock);
+#endif
+    if (i >= pool->njobs) break;
+    compile_job(pool->args, &pool->jobs[i]);
+  }
+  return NULL;
+}
+
+static void
+compile_jobs(struct mrbc_pool *pool)
+{
+#ifdef USE_THREADS
+  pthread_t *threads;
+  int n = pool->args->jobs < pool->njobs ? pool->args->jobs : pool->njobs;
+  int i;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  threads = (pthread_t*)malloc(sizeof(pthread_t) * n);
+  for (i = 1; i < n; i++) {
+    if (pthread_create(&threads[i], NULL, compile_worker, pool) != 0) break;
+  }
+  n = i;
+  compile_worker(pool);
+  for (i = 1; i < n; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&pool->lock);
+#else
+  compile_worker(pool);
+#endif
+}
+
+/*
+ * The top level irep of a file runs as a block of the merged top level.
+ * It stops the VM at its end, where a block has to return.  A return
+ * from the top level raises LocalJumpError; from a block it would just
+ * go on with the next file, so it is made a return from the block's
+ * home, which raises the same error.
+ */
+static void
+patch_returns(mrb_insn *iseq, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    if (GET_OPCODE(iseq[i]) == OP_RETURN && GETARG_B(iseq[i]) == OP_R_NORMAL) {
+      iseq[i] = MKOP_AB(OP_RETURN, GETARG_A(iseq[i]), OP_R_RETURN);
+    }
+  }
+  if (n > 0 && GET_OPCODE(iseq[n-1]) == OP_STOP) {
+    iseq[n-1] = MKOP_AB(OP_RETURN, 0, OP_R_NORMAL);
+  }
+}
+
+static void
+return_at_end(mrb_state *mrb, mrb_irep *rep)
+{
+#ifdef MRB_COMPACT_ISEQ
+  /* OP_RETURN is longer than OP_STOP */
+  size_t n, len;
+  mrb_insn *iseq = mrb_iseq_decode(mrb, rep->iseq, rep->ilen, &n);
+  uint8_t *bin;
+
+  if (!iseq) return;
+  patch_returns(iseq, n);
+  bin = mrb_iseq_encode(mrb, iseq, n, &len);
+  if (bin) {
+    if (!(rep->flags & MRB_ISEQ_NO_FREE)) {
+      mrb_free(mrb, rep->iseq);
+    }
+    rep->flags &= ~MRB_ISEQ_NO_FREE;
+    rep->iseq = bin;
+    rep->ilen = len;
+  }
+  mrb_free(mrb, iseq);
+#else
+  if (rep->flags & MRB_ISEQ_NO_FREE) {
+    /* the iseq is still in the binary of the file */
+    mrb_code *iseq = (mrb_code*)mrb_malloc(mrb, sizeof(mrb_code) * rep->ilen);
+
+    memcpy(iseq, rep->iseq, sizeof(mrb_code) * rep->ilen);
+    rep->iseq = iseq;
+    rep->flags &= ~MRB_ISEQ_NO_FREE;
+  }
+  patch_returns(rep->iseq, rep->ilen);
+#endif
+}
+
+/*
+ * The top level irep running the ireps of the files in order.  Each one
+ * is called by OP_YIELD with a null method name, so its frame shows in
+ * backtraces as the top level does.  The irep has debug info without
+ * any file, so its own frame does not show at all.
+ */
+static mrb_irep*
+merge_ireps(mrb_state *mrb, mrb_irep **reps, int n)
+{
+  mrb_irep *irep = mrb_add_irep(mrb);
+  size_t ilen = 2 * n + 1;
+  mrb_insn *iseq;
+  int i;
+
+  irep->nlocals = 1;
+  irep->nregs = 3;
+  irep->rlen = n;
+  irep->reps = reps;
+  irep->slen = 1;
+  irep->syms = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym));
+  irep->syms[0] = 0;
+  iseq = (mrb_insn*)mrb_malloc(mrb, sizeof(mrb_insn) * ilen);
+  for (i = 0; i < n; i++) {
+    iseq[2*i] = MKOP_Abc(OP_LAMBDA, 1, i, OP_L_CAPTURE);
+    iseq[2*i+1] = MKOP_ABC(OP_YIELD, 1, 0, 0);
+    mrb_irep_load_all(mrb, reps[i]);
+    return_at_end(mrb, reps[i]);
+  }
+  iseq[2*n] = MKOP_A(OP_STOP, 0);
+#ifdef MRB_COMPACT_ISEQ
+  irep->iseq = mrb_iseq_encode(mrb, iseq, ilen, &irep->ilen);
+  mrb_free(mrb, iseq);
+#else
+  irep->iseq = iseq;
+  irep->ilen = ilen;
+#endif
+
+  if (reps[0]->debug_info) {
+    mrb_debug_info_alloc(mrb, irep);
+  }
+  return irep;
+}
+
+static mrb_value
+load_files(mrb_state *mrb, struct mrbc_args *args, struct mrbc_pool *pool)
+{
+  mrb_irep **reps;
+  struct RProc *proc;
+  int i;
+
+  pool->args = args;
+  pool->njobs = args->argc - args->idx;
+  pool->next = 0;
+  pool->jobs = (struct mrbc_job*)calloc(pool->njobs, sizeof(struct mrbc_job));
+  if (!pool->jobs) return mrb_nil_value();
+  for (i = 0; i < pool->njobs; i++) {
+    pool->jobs[i].file = args->argv[args->idx + i];
+  }
+  compile_jobs(pool);
+
+  for (i = 0; i < pool->njobs; i++) {
+    if (!pool->jobs[i].bin && !pool->jobs[i].bin_size) return mrb_nil_value();
+  }
+  if (args->check_syntax) return mrb_true_value();
+
+  /* the ireps may use the binaries in place until the state is closed */
+  reps = (mrb_irep**)mrb_malloc(mrb, sizeof(mrb_irep*) * pool->njobs);
+  for (i = 0; i < pool->njobs; i++) {
+    reps[i] = mrb_read_irep(mrb, pool->jobs[i].bin);
+    if (!reps[i]) {
+      fprintf(stderr, "%s: cannot merge (%s)\n", args->prog, pool->jobs[i].file);
+      while (i-- > 0) mrb_irep_decref(mrb, reps[i]);
+      mrb_free(mrb, reps);
+      return mrb_nil_value();
+    }
+  }
+  proc = mrb_proc_new(mrb, merge_ireps(mrb, reps, pool->njobs));
+  mrb_irep_decref(mrb, proc->body.irep);
+  if (args->verbose) mrb_codedump_all(mrb, proc);
+  return mrb_obj_value(proc);
+}
+
+static void
+free_jobs(struct mrbc_pool *pool)
+{
+  int i;
+
+  if (!pool->jobs) return;
+  for (i = 0; i < pool->njobs; i++) {
+    free(pool->jobs[i].bin);
+  }
+  free(pool->jobs);
+}
+
 static int
 dump_file(mrb_state *mrb, FILE *wfp, const char *outfile, struct RProc *proc, struct mrbc_args *args)
 {
@@ -232,13 +538,13 @@ dump_file(mrb_state *mrb, FILE *wfp, const char *outfile, struct RProc *proc, st
   mrb_irep *irep = proc->body.irep;
 
   if (args->initname) {
-    n = mrb_dump_irep_cfunc(mrb, irep, args->debug_info, wfp, args->initname);
+    n = mrb_dump_irep_cfunc(mrb, irep, args->flags, wfp, args->initname);
     if (n == MRB_DUMP_INVALID_ARGUMENT) {
       fprintf(stderr, "%s: invalid C language symbol name\n", args->initname);
     }
   }
   else {
-    n = mrb_dump_irep_binary(mrb, irep, args->debug_info, wfp);
+    n = mrb_dump_irep_binary(mrb, irep, args->flags, wfp);
   }
   if (n != MRB_DUMP_OK) {
     fprintf(stderr, "%s: error in mrb dump (%s) %d\n", args->prog, outfile, n);
@@ -252,6 +558,7 @@ main(int argc, char **argv)
   mrb_state *mrb = mrb_open();
   int n, result;
   struct mrbc_args args;
+  struct mrbc_pool pool = { 0 };
   FILE *wfp;
   mrb_value load;
 
@@ -281,9 +588,15 @@ main(int argc, char **argv)
   }
 
   args.idx = n;
-  load = load_file(mrb, &args);
+  if (args.jobs > 0) {
+    load = load_files(mrb, &args, &pool);
+  }
+  else {
+    load = load_file(mrb, &args);
+  }
   if (mrb_nil_p(load)) {
     cleanup(mrb, &args);
+    free_jobs(&pool);
     return EXIT_FAILURE;
   }
   if (args.check_syntax) {
@@ -292,6 +605,7 @@ main(int argc, char **argv)
 
   if (args.check_syntax) {
     cleanup(mrb, &args);
+    free_jobs(&pool);
     return EXIT_SUCCESS;
   }
 
@@ -311,6 +625,7 @@ main(int argc, char **argv)
   result = dump_file(mrb, wfp, args.outfile, mrb_proc_ptr(load), &args);
   fclose(wfp);
   cleanup(mrb, &args);
+  free_jobs(&pool);
   if (result != MRB_DUMP_OK) {
     return EXIT_FAILURE;
   }